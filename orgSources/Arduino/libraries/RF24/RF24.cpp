@@ -12,28 +12,6 @@
 
 /****************************************************************************/
 
-void RF24::csn(bool mode)
-{
-  // Minimum ideal SPI bus speed is 2x data rate
-  // If we assume 2Mbs data rate and 16Mhz clock, a
-  // divider of 4 is the minimum we want.
-  // CLK:BUS 8Mhz:2Mhz, 16Mhz:4Mhz, or 20Mhz:5Mhz
-#ifdef ARDUINO
-	#if !defined( __AVR_ATtiny85__ ) && !defined( __AVR_ATtiny84__) && !defined (__arm__)
- 			SPI.setBitOrder(MSBFIRST);
-  			SPI.setDataMode(SPI_MODE0);
-			SPI.setClockDivider(SPI_CLOCK_DIV2);
-	#endif
-#endif
-
-#ifndef __arm__
-	digitalWrite(csn_pin,mode);
-#endif
-
-}
-
-/****************************************************************************/
-
 void RF24::ce(bool level)
 {
   digitalWrite(ce_pin,level);
@@ -43,44 +21,15 @@ void RF24::ce(bool level)
 
 uint8_t RF24::read_register(uint8_t reg, uint8_t* buf, uint8_t len)
 {
-  uint8_t status;
-
-#if defined (__arm__)
-  status = SPI.transfer(csn_pin, R_REGISTER | ( REGISTER_MASK & reg ), SPI_CONTINUE );
-  while ( len-- > 1 ){
-    *buf++ = SPI.transfer(csn_pin,0xff, SPI_CONTINUE);
-  }
-  *buf++ = SPI.transfer(csn_pin,0xff);
-
-#else
-  csn(LOW);
-  status = SPI.transfer( R_REGISTER | ( REGISTER_MASK & reg ) );
-  while ( len-- ){
-    *buf++ = SPI.transfer(0xff);
-  }
-  csn(HIGH);
-
-#endif
-
-  return status;
+  return spi->command( R_REGISTER | ( REGISTER_MASK & reg ), NULL, buf, len );
 }
 
 /****************************************************************************/
 
 uint8_t RF24::read_register(uint8_t reg)
 {
-
-  #if defined (__arm__)
-  SPI.transfer(csn_pin, R_REGISTER | ( REGISTER_MASK & reg ) , SPI_CONTINUE);
-  uint8_t result = SPI.transfer(csn_pin,0xff);
-  #else
-  csn(LOW);
-  SPI.transfer( R_REGISTER | ( REGISTER_MASK & reg ) );
-  uint8_t result = SPI.transfer(0xff);
-
-  csn(HIGH);
-  #endif
-
+  uint8_t result;
+  spi->command( R_REGISTER | ( REGISTER_MASK & reg ), NULL, &result, 1 );
   return result;
 }
 
@@ -88,56 +37,22 @@ uint8_t RF24::read_register(uint8_t reg)
 
 uint8_t RF24::write_register(uint8_t reg, const uint8_t* buf, uint8_t len)
 {
-  uint8_t status;
-
-  #if defined (__arm__)
-  	status = SPI.transfer(csn_pin, W_REGISTER | ( REGISTER_MASK & reg ), SPI_CONTINUE );
-    while ( len-- > 1){
-    	SPI.transfer(csn_pin,*buf++, SPI_CONTINUE);
-	}
-	SPI.transfer(csn_pin,*buf++);
-  #else
-
-  csn(LOW);
-  status = SPI.transfer( W_REGISTER | ( REGISTER_MASK & reg ) );
-  while ( len-- )
-    SPI.transfer(*buf++);
-
-  csn(HIGH);
-
-  #endif
-
-  return status;
+  return spi->command( W_REGISTER | ( REGISTER_MASK & reg ), buf, NULL, len );
 }
 
 /****************************************************************************/
 
 uint8_t RF24::write_register(uint8_t reg, uint8_t value)
 {
-  uint8_t status;
-
   IF_SERIAL_DEBUG(printf_P(PSTR("write_register(%02x,%02x)\r\n"),reg,value));
 
-  #if defined (__arm__)
-  status = SPI.transfer(csn_pin, W_REGISTER | ( REGISTER_MASK & reg ), SPI_CONTINUE);
-  SPI.transfer(csn_pin,value);
-  #else
-
-  csn(LOW);
-  status = SPI.transfer( W_REGISTER | ( REGISTER_MASK & reg ) );
-  SPI.transfer(value);
-  csn(HIGH);
-
-  #endif
-
-  return status;
+  return spi->command( W_REGISTER | ( REGISTER_MASK & reg ), &value, NULL, 1 );
 }
 
 /****************************************************************************/
 
 uint8_t RF24::write_payload(const void* buf, uint8_t data_len, const uint8_t writeType)
 {
-  uint8_t status;
   const uint8_t* current = reinterpret_cast<const uint8_t*>(buf);
 
   if(data_len > payload_size) data_len = payload_size;
@@ -145,40 +60,15 @@ uint8_t RF24::write_payload(const void* buf, uint8_t data_len, const uint8_t wri
 
   //printf("[Writing %u bytes %u blanks]",data_len,blank_len);
 
- #if defined (__arm__)
-
-  status = SPI.transfer(csn_pin, writeType , SPI_CONTINUE);
-
-  if(blank_len){
-    while ( data_len--){
-      SPI.transfer(csn_pin,*current++, SPI_CONTINUE);
-    }
-    while ( --blank_len ){
-      SPI.transfer(csn_pin,0, SPI_CONTINUE);
-    }
-    SPI.transfer(csn_pin,0);
-  }else{
-    while( --data_len ){
-      SPI.transfer(csn_pin,*current++, SPI_CONTINUE);
-    }
-    SPI.transfer(csn_pin,*current);
-  }
-
-  #else
-
-  csn(LOW);
-  status = SPI.transfer( writeType );
-  while ( data_len-- ) {
-    SPI.transfer(*current++);
+  if ( !blank_len ){
+    return spi->command( writeType, current, NULL, data_len );
   }
-  while ( blank_len-- ) {
-    SPI.transfer(0);
-  }
-  csn(HIGH);
-
-  #endif
 
-  return status;
+  // Pad with zeroes, so the payload still goes out in a single transfer.
+  uint8_t padded[32];
+  memcpy( padded, current, data_len );
+  memset( padded + data_len, 0, blank_len );
+  return spi->command( writeType, padded, NULL, data_len + blank_len );
 }
 
 /****************************************************************************/
@@ -193,40 +83,26 @@ uint8_t RF24::read_payload(void* buf, uint8_t data_len)
 
   //printf("[Reading %u bytes %u blanks]",data_len,blank_len);
 
-
-  #if defined (__arm__)
-
-  status = SPI.transfer(csn_pin, R_RX_PAYLOAD, SPI_CONTINUE );
-
-  if( blank_len ){
-
-	while ( data_len-- ){
-      *current++ = SPI.transfer(csn_pin,0xFF, SPI_CONTINUE);
-	}
-	while ( --blank_len ){
-	  SPI.transfer(csn_pin,0xFF, SPI_CONTINUE);
-	}
-	SPI.transfer(csn_pin,0xFF);
-  }else{
-	while ( --data_len ){
-	  *current++ = SPI.transfer(csn_pin,0xFF, SPI_CONTINUE);
-	}
-	*current = SPI.transfer(csn_pin,0xFF);
-  }
-
-  #else
-
-  csn(LOW);
-  status = SPI.transfer( R_RX_PAYLOAD );
-  while ( data_len-- ) {
-    *current++ = SPI.transfer(0xFF);
+  if ( esb_ctrl_offset < data_len ){
+    // Clock in address byte(s) & first control field byte, then only as much as the frame is long.
+    // Chip select is only kept when more bytes follow: an empty transfer() can't release it.
+    uint8_t head_len = esb_ctrl_offset + 1;
+    status = spi->command( R_RX_PAYLOAD, NULL, current, head_len, head_len < data_len );
+    if ( head_len < data_len ){
+      // A frame is always longer than its head.
+      uint8_t frame_len = esb_frame_length( current[esb_ctrl_offset] >> 2 );
+      if ( frame_len < data_len ){
+        data_len = frame_len;
+      }
+      spi->transfer( NULL, current + head_len, data_len - head_len );
+    }
   }
-  while ( blank_len-- ) {
-    SPI.transfer(0xff);
+  else{
+    status = spi->command( R_RX_PAYLOAD, NULL, current, data_len, blank_len > 0 );
+    if ( blank_len ){
+      spi->transfer( NULL, NULL, blank_len );
+    }
   }
-  csn(HIGH);
-
-  #endif
 
   return status;
 }
@@ -249,16 +125,7 @@ uint8_t RF24::flush_tx(void)
 
 uint8_t RF24::spiTrans(uint8_t cmd){
 
-  uint8_t status;
-  #if defined (__arm__)
-	status = SPI.transfer(csn_pin, cmd );
-  #else
-
-  csn(LOW);
-  status = SPI.transfer( cmd );
-  csn(HIGH);
-  #endif
-  return status;
+  return spi->command( cmd, NULL, NULL, 0 );
 
 }
 
@@ -329,10 +196,25 @@ void RF24::print_address_register(const char* name, uint8_t reg, uint8_t qty)
 
 /****************************************************************************/
 
+#if defined (ARDUINO)
 RF24::RF24(uint8_t _cepin, uint8_t _cspin):
-  ce_pin(_cepin), csn_pin(_cspin), wide_band(false), p_variant(false),
+  ce_pin(_cepin), arduino_spi(_cspin), spi(&arduino_spi), wide_band(false), p_variant(false),
+  payload_size(32), dynamic_payloads_enabled(false),
+  pipe0_reading_address(0), esb_ctrl_offset(0xFF), esb_crc_length(0)
+{
+}
+#endif
+
+/****************************************************************************/
+
+RF24::RF24(uint8_t _cepin, RF24_SPI& _spi):
+  ce_pin(_cepin),
+#if defined (ARDUINO)
+  arduino_spi(0xff),
+#endif
+  spi(&_spi), wide_band(false), p_variant(false),
   payload_size(32), dynamic_payloads_enabled(false),
-  pipe0_reading_address(0)
+  pipe0_reading_address(0), esb_ctrl_offset(0xFF), esb_crc_length(0)
 {
 }
 
@@ -363,6 +245,33 @@ uint8_t RF24::getPayloadSize(void)
 
 /****************************************************************************/
 
+void RF24::enableLengthAwareRead(uint8_t ctrlOffset, uint8_t crcLength)
+{
+  esb_ctrl_offset = ctrlOffset;
+  esb_crc_length = min(crcLength,2);
+}
+
+/****************************************************************************/
+
+void RF24::disableLengthAwareRead(void)
+{
+  esb_ctrl_offset = 0xFF;
+}
+
+/****************************************************************************/
+
+uint8_t RF24::esb_frame_length(uint8_t payload_len)
+{
+  // Invalid length; only the header is of any use.
+  if ( payload_len > 32 )
+    return esb_ctrl_offset + 2;
+
+  // Address byte(s), 9 bit control field, payload & CRC, rounded up to full bytes.
+  return ( (esb_ctrl_offset << 3) + 9 + (payload_len << 3) + (esb_crc_length << 3) + 7 ) >> 3;
+}
+
+/****************************************************************************/
+
 #if !defined (MINIMAL)
 
 static const char rf24_datarate_e_str_0[] PROGMEM = "1MBPS";
@@ -414,7 +323,7 @@ void RF24::printDetails(void)
   print_byte_register(PSTR("CONFIG"),CONFIG);
   print_byte_register(PSTR("DYNPD/FEATURE"),DYNPD,2);
 
-#if defined(__arm__)
+#if defined(__arm__) || defined(ESP_PLATFORM) || ! defined(ARDUINO)
   printf_P(PSTR("Data Rate\t = %s\r\n"),pgm_read_word(&rf24_datarate_e_str_P[getDataRate()]));
   printf_P(PSTR("Model\t\t = %s\r\n"),pgm_read_word(&rf24_model_e_str_P[isPVariant()]));
   printf_P(PSTR("CRC Length\t = %s\r\n"),pgm_read_word(&rf24_crclength_e_str_P[getCRCLength()]));
@@ -434,20 +343,8 @@ void RF24::begin(void)
 {
   // Initialize pins
   pinMode(ce_pin,OUTPUT);
-
-  #if defined(__arm__)
-  	SPI.begin(csn_pin);					// Using the extended SPI features of the DUE
-	SPI.setClockDivider(csn_pin, 9);   // Set the bus speed to 8.4mhz on Due
-	SPI.setBitOrder(csn_pin,MSBFIRST);	// Set the bit order and mode specific to this device
-  	SPI.setDataMode(csn_pin,SPI_MODE0);
-	ce(LOW);
-  	//csn(HIGH);
-  #else
-    pinMode(csn_pin,OUTPUT);
-    SPI.begin();
-    ce(LOW);
-  	csn(HIGH);
-  #endif
+  spi->begin();
+  ce(LOW);
 
   // Must allow the radio time to settle else configuration bits will not necessarily stick.
   // This is actually only required following power up but some settling time also appears to
@@ -736,16 +633,7 @@ uint8_t RF24::getDynamicPayloadSize(void)
 {
   uint8_t result = 0;
 
-  #if defined (__arm__)
-  SPI.transfer(csn_pin, R_RX_PL_WID, SPI_CONTINUE );
-  result = SPI.transfer(csn_pin,0xff);
-  #else
-  csn(LOW);
-  SPI.transfer( R_RX_PL_WID );
-  result = SPI.transfer(0xff);
-  csn(HIGH);
-
-  #endif
+  spi->command( R_RX_PL_WID, NULL, &result, 1 );
 
   if(result > 32) { flush_rx(); return 0; }
   return result;
@@ -795,6 +683,34 @@ void RF24::read( void* buf, uint8_t len ){
 
 /****************************************************************************/
 
+uint8_t RF24::readBurst( void* buf, uint8_t maxPackets, uint8_t len, uint8_t* pipes ){
+
+  uint8_t* current = reinterpret_cast<uint8_t*>(buf);
+  uint8_t count = 0;
+
+  // Clear RX_DR once. The status returned holds the pipe number of the payload at the head
+  // of the RX FIFO, or B111 when it is empty.
+  uint8_t status = write_register(STATUS,_BV(RX_DR) );
+
+  while ( count < maxPackets && ((status >> RX_P_NO) & B111) != B111 ){
+    if ( pipes ){
+      *pipes++ = ( status >> RX_P_NO ) & B111;
+    }
+    read_payload( current, len );
+    current += len;
+    ++count;
+
+    // A single NOP tells whether another payload moved up to the head of the FIFO.
+    if ( count < maxPackets ){
+      status = get_status();
+    }
+  }
+
+  return count;
+}
+
+/****************************************************************************/
+
 void RF24::whatHappened(bool& tx_ok,bool& tx_fail,bool& rx_ready)
 {
   // Read the status & reset the status in one easy call
@@ -874,16 +790,8 @@ void RF24::closeReadingPipe( uint8_t pipe )
 
 void RF24::toggle_features(void)
 {
-
-  #if defined (__arm__)
-  SPI.transfer(csn_pin, ACTIVATE, SPI_CONTINUE );
-  SPI.transfer(csn_pin, 0x73 );
-  #else
-  csn(LOW);
-  SPI.transfer( ACTIVATE );
-  SPI.transfer( 0x73 );
-  csn(HIGH);
-  #endif
+  const uint8_t value = 0x73;
+  spi->command( ACTIVATE, &value, NULL, 1 );
 }
 
 /****************************************************************************/
@@ -949,23 +857,7 @@ void RF24::writeAckPayload(uint8_t pipe, const void* buf, uint8_t len)
 
   uint8_t data_len = min(len,32);
 
-  #if defined (__arm__)
-	SPI.transfer(csn_pin, W_ACK_PAYLOAD | ( pipe & B111 ), SPI_CONTINUE);
-	while ( data_len-- > 1 ){
-		SPI.transfer(csn_pin,*current++, SPI_CONTINUE);
-	}
-	SPI.transfer(csn_pin,*current++);
-
-  #else
-  csn(LOW);
-  SPI.transfer(W_ACK_PAYLOAD | ( pipe & B111 ) );
-
-  while ( data_len-- )
-    SPI.transfer(*current++);
-
-  csn(HIGH);
-
-  #endif
+  spi->command( W_ACK_PAYLOAD | ( pipe & B111 ), current, NULL, data_len );
 }
 
 /****************************************************************************/
@@ -984,6 +876,14 @@ bool RF24::isPVariant(void)
 
 /****************************************************************************/
 
+bool RF24::isChipConnected(void)
+{
+  uint8_t setup = read_register(SETUP_AW);
+  return ( setup >= 1 ) && ( setup <= 3 );
+}
+
+/****************************************************************************/
+
 void RF24::setAutoAck(bool enable)
 {
   if ( enable )
@@ -1027,6 +927,23 @@ bool RF24::testRPD(void)
 
 /****************************************************************************/
 
+uint8_t RF24::sampleRPD( uint8_t channel, uint8_t numSamples )
+{
+  ce(LOW);
+  write_register(RF_CH,min(channel,(uint8_t)127));
+  ce(HIGH);
+
+  // RPD is valid Tstby2a (130us) + Tdelay_AGC (40us) after entering RX mode.
+  delayMicroseconds(130 + 40);
+
+  uint8_t hits = 0;
+  while ( numSamples-- )
+    hits += read_register(RPD) & 1;
+  return hits;
+}
+
+/****************************************************************************/
+
 void RF24::setPALevel(uint8_t level)
 {
 
@@ -15,6 +15,8 @@
 #ifndef __RF24_H__
 #define __RF24_H__
 
+#include "RF24_spi.h"
+
 
 /**
  * Power Amplifier level.
@@ -45,12 +47,17 @@ class RF24
 {
 private:
   uint8_t ce_pin; /**< "Chip Enable" pin, activates the RX or TX role */
-  uint8_t csn_pin; /**< SPI Chip select */
+#if defined (ARDUINO)
+  RF24_SPI_Arduino arduino_spi; /**< Default SPI transport, unused when another transport is passed in. */
+#endif
+  RF24_SPI* spi; /**< SPI transport talking to the chip */
   bool wide_band; /* 2Mbs data rate in use? */
   bool p_variant; /* False for RF24L01 and true for RF24L01P */
   uint8_t payload_size; /**< Fixed size of payloads */
   bool dynamic_payloads_enabled; /**< Whether dynamic payloads are enabled. */
   uint64_t pipe0_reading_address; /**< Last address set on pipe 0 for reading. */
+  uint8_t esb_ctrl_offset; /**< Offset of ESB control field in raw payloads, or 0xFF when length aware reads are disabled. */
+  uint8_t esb_crc_length; /**< Length of the ESB CRC trailing raw payloads, in bytes. */
 
 public:
 
@@ -72,6 +79,16 @@ public:
    */
   RF24(uint8_t _cepin, uint8_t _cspin);
 
+  /**
+   * Constructor using a custom SPI transport
+   *
+   * Chip select is handled by the transport, e.g. in hardware.
+   *
+   * @param _cepin The pin attached to Chip Enable on the RF module
+   * @param _spi SPI transport to talk to the chip. Must outlive this instance.
+   */
+  RF24(uint8_t _cepin, RF24_SPI& _spi);
+
   /**
    * Begin operation of the chip
    *
@@ -244,6 +261,22 @@ public:
    */
   bool available(uint8_t* pipe_num);
 
+  /**
+   * Read all payloads queued in the RX FIFO with the minimum number of SPI transactions
+   *
+   * RX_DR is cleared once, up front. From then on the STATUS byte clocked out with
+   * every command tells whether (and on which pipe) another payload is pending, so
+   * no FIFO_STATUS reads or per-payload STATUS writes are needed.
+   * Payloads arriving while draining set RX_DR again and will raise a new interrupt.
+   *
+   * @param[out] buf Buffer of at least maxPackets * len bytes. Payloads are stored back to back.
+   * @param maxPackets Maximum number of payloads to read, e.g. 3 to empty the RX FIFO.
+   * @param len Number of bytes to read per payload, see read_payload()
+   * @param[out] pipes Optional buffer of at least maxPackets bytes receiving the pipe number of each payload
+   * @return Number of payloads read. Less than maxPackets means the RX FIFO was found empty.
+   */
+  uint8_t readBurst( void* buf, uint8_t maxPackets, uint8_t len, uint8_t* pipes = NULL );
+
   /**
    * Enter low-power mode
    *
@@ -565,14 +598,28 @@ public:
    */
   bool testRPD(void) ;
 
+  /**
+   * Tune to a channel and sample RPD a number of times, for a spectrum survey
+   *
+   * Retunes in standby (CE low), which takes a single register write instead of the
+   * CONFIG read-modify-writes and FIFO flushes of stopListening()/startListening().
+   * After the PLL has settled and the AGC has had time to come up, RPD is read back to
+   * back; each read is one 2-byte SPI transaction. Must be listening already.
+   *
+   * @param channel Channel to sample, range [0..125]
+   * @param numSamples Number of RPD reads
+   * @return Number of reads that found a signal => -64dBm
+   */
+  uint8_t sampleRPD( uint8_t channel, uint8_t numSamples );
+
   /**
    * Test whether this is a real radio, or a mock shim for
-   * debugging.  Setting either pin to 0xff is the way to
+   * debugging.  Setting the CE pin to 0xff is the way to
    * indicate that this is not a real radio.
    *
    * @return true if this is a legitimate radio
    */
-  bool isValid() { return ce_pin != 0xff && csn_pin != 0xff; }
+  bool isValid() { return ce_pin != 0xff; }
 
   /**
   * The radio will generate interrupt signals when a transmission is complete,
@@ -643,6 +690,29 @@ public:
    */
   uint8_t getPayloadSize(void);
 
+  /**
+   * Enable length aware payload reads for raw Enhanced Shockburst frames
+   *
+   * Meant for promiscuous capturing with CRC disabled, where the fixed size payload
+   * read from the FIFO holds the remaining address byte(s), the 9 bit packet control
+   * field, the actual payload and the CRC. read_payload() then first clocks in the
+   * bytes up to and including the control field, decodes the 6 bit payload length
+   * and raises CSN as soon as payload and CRC bits are in; the nRF24 discards the
+   * unread remainder of the payload. Bytes past the end of the frame are left
+   * untouched in the buffer.
+   *
+   * @param ctrlOffset Offset in the payload of the first byte of the control field
+   * @param crcLength Length of the frame CRC in bytes, range [0..2]
+   */
+  void enableLengthAwareRead(uint8_t ctrlOffset, uint8_t crcLength);
+
+  /**
+   * Disable length aware payload reads; read_payload() always clocks the full payload size.
+   *
+   * @see enableLengthAwareRead()
+   */
+  void disableLengthAwareRead(void);
+
   /**
    * Get Dynamic Payload Size
    *
@@ -684,6 +754,15 @@ public:
    */
   bool isPVariant(void) ;
 
+  /**
+   * Check whether a chip answers on the SPI bus
+   *
+   * SETUP_AW only ever holds 1..3; an absent chip reads back as all zeros or all ones.
+   *
+   * @return true if a radio is connected
+   */
+  bool isChipConnected(void) ;
+
   /**
    * Enable or disable auto-acknowlede packets
    *
@@ -793,18 +872,6 @@ private:
    */
   /**@{*/
 
-  /**
-   * Set chip select pin
-   *
-   * Running SPI bus at PI_CLOCK_DIV2 so we don't waste time transferring data
-   * and best of all, we make use of the radio's FIFO buffers. A lower speed
-   * means we're less likely to effectively leverage our FIFOs and pay a higher
-   * AVR runtime cost as toll.
-   *
-   * @param mode HIGH to take this unit off the SPI bus, LOW to put it on
-   */
-  void csn(bool mode);
-
   /**
    * Set chip enable
    *
@@ -872,6 +939,16 @@ private:
    */
   uint8_t read_payload(void* buf, uint8_t len);
 
+  /**
+   * Number of bytes a raw Enhanced Shockburst frame occupies in the payload
+   *
+   * @see enableLengthAwareRead()
+   *
+   * @param payload_len Payload length decoded from the packet control field
+   * @return Bytes from start of payload up to and including the last CRC bit
+   */
+  uint8_t esb_frame_length(uint8_t payload_len);
+
   /**
    * Retrieve the current status of the chip
    *
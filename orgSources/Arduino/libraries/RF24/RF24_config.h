@@ -12,11 +12,15 @@
 #ifndef __RF24_CONFIG_H__
 #define __RF24_CONFIG_H__
 
+#if defined (ARDUINO)
   #if ARDUINO < 100
 	#include <WProgram.h>
   #else
 	#include <Arduino.h>
   #endif
+#else
+	#include "RF24_host.h"
+#endif
 
   #include <stddef.h>
 
@@ -30,7 +34,6 @@
 	#include <stdint.h>
 	#include <stdio.h>
 	#include <string.h>
-	extern HardwareSPI SPI;
 	#define _BV(x) (1<<(x))
   #endif
 
@@ -48,7 +51,7 @@
 // Avoid spurious warnings
 // Arduino DUE is arm and uses traditional PROGMEM constructs
 #if 1
-#if ! defined( NATIVE ) && defined( ARDUINO ) && ! defined(__arm__)
+#if ! defined( NATIVE ) && defined( ARDUINO ) && ! defined(__arm__) && ! defined(ESP_PLATFORM)
 #undef PROGMEM
 #define PROGMEM __attribute__(( section(".progmem.data") ))
 #undef PSTR
@@ -62,11 +65,8 @@
 	#include <avr/pgmspace.h>
 	#define PRIPSTR "%S"
 #else
-#if ! defined(ARDUINO) // This doesn't work on Arduino DUE
-	typedef char const char;
-#else // Fill in pgm_read_byte that is used, but missing from DUE
+	// Fill in pgm_read_byte that is used, but missing from DUE and hosts
 	#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
-#endif
 
 	typedef uint16_t prog_uint16_t;
 	#define PSTR(x) (x)
@@ -0,0 +1,67 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RF24_host.h
+ *
+ * The few Arduino core definitions RF24 uses, for building it on a host against RF24_SPI_Mock
+ */
+
+#ifndef __RF24_HOST_H__
+#define __RF24_HOST_H__
+
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include <type_traits>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define B111    7
+#define B1111   15
+#define B111111 63
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// A function rather than the Arduino macro, so it doesn't clash with the C++ library.
+template <class A, class B>
+inline typename std::common_type<A, B>::type min(A a, B b)
+{
+  return a < b ? a : b;
+}
+
+// There are no pins; CE only matters to a real radio.
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+// Real time, so that the timeouts in RF24 expire.
+inline unsigned long micros(void)
+{
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned long millis(void)
+{
+  return micros() / 1000UL;
+}
+
+inline void delayMicroseconds(unsigned int us)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+inline void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#endif // __RF24_HOST_H__
@@ -0,0 +1,97 @@
+/*
+ Copyright (C) 2011 J. Coliz <maniacbug@ymail.com>
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ version 2 as published by the Free Software Foundation.
+ */
+
+#include "RF24_config.h"
+#include "RF24_spi.h"
+
+#if defined (ARDUINO)
+
+/****************************************************************************/
+
+RF24_SPI_Arduino::RF24_SPI_Arduino(uint8_t _cspin):
+  csn_pin(_cspin)
+{
+}
+
+/****************************************************************************/
+
+void RF24_SPI_Arduino::csn(bool mode)
+{
+  // Minimum ideal SPI bus speed is 2x data rate
+  // If we assume 2Mbs data rate and 16Mhz clock, a
+  // divider of 4 is the minimum we want.
+  // CLK:BUS 8Mhz:2Mhz, 16Mhz:4Mhz, or 20Mhz:5Mhz
+	#if !defined( __AVR_ATtiny85__ ) && !defined( __AVR_ATtiny84__) && !defined (__arm__)
+ 			SPI.setBitOrder(MSBFIRST);
+  			SPI.setDataMode(SPI_MODE0);
+			SPI.setClockDivider(SPI_CLOCK_DIV2);
+	#endif
+
+#ifndef __arm__
+	digitalWrite(csn_pin,mode);
+#endif
+
+}
+
+/****************************************************************************/
+
+void RF24_SPI_Arduino::begin(void)
+{
+  #if defined(__arm__)
+  	SPI.begin(csn_pin);					// Using the extended SPI features of the DUE
+	SPI.setClockDivider(csn_pin, 9);   // Set the bus speed to 8.4mhz on Due
+	SPI.setBitOrder(csn_pin,MSBFIRST);	// Set the bit order and mode specific to this device
+  	SPI.setDataMode(csn_pin,SPI_MODE0);
+  #else
+    pinMode(csn_pin,OUTPUT);
+    SPI.begin();
+  	csn(HIGH);
+  #endif
+}
+
+/****************************************************************************/
+
+uint8_t RF24_SPI_Arduino::command(uint8_t cmd, const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected)
+{
+  uint8_t status;
+
+  #if defined (__arm__)
+  status = SPI.transfer(csn_pin, cmd, ( len || keep_selected ) ? SPI_CONTINUE : SPI_LAST );
+  #else
+  csn(LOW);
+  status = SPI.transfer( cmd );
+  #endif
+
+  transfer( tx, rx, len, keep_selected );
+
+  return status;
+}
+
+/****************************************************************************/
+
+void RF24_SPI_Arduino::transfer(const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected)
+{
+  while ( len-- ){
+  #if defined (__arm__)
+    uint8_t value = SPI.transfer(csn_pin, tx ? *tx++ : 0xff, ( len || keep_selected ) ? SPI_CONTINUE : SPI_LAST );
+  #else
+    uint8_t value = SPI.transfer( tx ? *tx++ : 0xff );
+  #endif
+    if ( rx ){
+      *rx++ = value;
+    }
+  }
+
+  #if !defined (__arm__)
+  if ( !keep_selected ){
+    csn(HIGH);
+  }
+  #endif
+}
+
+#endif // ARDUINO
@@ -0,0 +1,109 @@
+/*
+ Copyright (C) 2011 J. Coliz <maniacbug@ymail.com>
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RF24_spi.h
+ *
+ * SPI transport interface used by RF24, plus the default Arduino SPI backend
+ */
+
+#ifndef __RF24_SPI_H__
+#define __RF24_SPI_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Largest number of bytes in one transaction: command byte plus a full 32 byte payload.
+ */
+#define RF24_SPI_MAX_TRANSFER (33)
+
+/**
+ * Maximum SPI clock supported by the nRF24L01(+)
+ */
+#define RF24_SPI_MAX_CLOCK_HZ (10000000UL)
+
+/**
+ * SPI transport for RF24
+ *
+ * A transaction starts with command(), which asserts chip select and clocks out the
+ * command byte followed by @p len data bytes. Unless @p keep_selected is set, chip select
+ * is released afterwards. Otherwise the transaction continues with one or more
+ * transfer() calls, the last of which passes keep_selected = false.
+ */
+class RF24_SPI
+{
+public:
+  virtual ~RF24_SPI() {}
+
+  /**
+   * Prepare the bus and chip select. Called from RF24::begin().
+   */
+  virtual void begin(void) = 0;
+
+  /**
+   * Start a transaction
+   *
+   * @param cmd Command byte
+   * @param tx Bytes to clock out after the command, or NULL to clock out 0xFF
+   * @param rx Where to store the bytes clocked in after the command, or NULL to discard them
+   * @param len Number of bytes following the command
+   * @param keep_selected Keep chip select asserted, to continue with transfer()
+   * @return STATUS register, clocked in with the command byte
+   */
+  virtual uint8_t command(uint8_t cmd, const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected = false) = 0;
+
+  /**
+   * Continue a transaction started by command() with keep_selected set
+   *
+   * @param tx Bytes to clock out, or NULL to clock out 0xFF
+   * @param rx Where to store the bytes clocked in, or NULL to discard them
+   * @param len Number of bytes. At least 1 to end the transaction: some backends only
+   * release chip select along with the last byte clocked.
+   * @param keep_selected Keep chip select asserted for yet another transfer()
+   */
+  virtual void transfer(const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected = false) = 0;
+};
+
+#if defined (ARDUINO)
+
+/**
+ * Default transport: Arduino SPI library with chip select toggled through digitalWrite(),
+ * or through the extended SPI interface on Arduino Due.
+ */
+class RF24_SPI_Arduino : public RF24_SPI
+{
+public:
+  /**
+   * @param _cspin The pin attached to Chip Select
+   */
+  RF24_SPI_Arduino(uint8_t _cspin);
+
+  void begin(void);
+  uint8_t command(uint8_t cmd, const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected = false);
+  void transfer(const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected = false);
+
+private:
+  uint8_t csn_pin; /**< SPI Chip select */
+
+  /**
+   * Set chip select pin
+   *
+   * Running SPI bus at PI_CLOCK_DIV2 so we don't waste time transferring data
+   * and best of all, we make use of the radio's FIFO buffers. A lower speed
+   * means we're less likely to effectively leverage our FIFOs and pay a higher
+   * AVR runtime cost as toll.
+   *
+   * @param mode HIGH to take this unit off the SPI bus, LOW to put it on
+   */
+  void csn(bool mode);
+};
+
+#endif // ARDUINO
+
+#endif // __RF24_SPI_H__
@@ -0,0 +1,136 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ version 2 as published by the Free Software Foundation.
+ */
+
+#include "RF24_spi_esp32.h"
+
+#if defined (ESP_PLATFORM)
+
+#include <string.h>
+
+/****************************************************************************/
+
+RF24_SPI_ESP32::RF24_SPI_ESP32(spi_host_device_t _host, int8_t _sck, int8_t _miso, int8_t _mosi, int8_t _cs,
+                               uint32_t _clock_hz):
+  host(_host), sck_pin(_sck), miso_pin(_miso), mosi_pin(_mosi), cs_pin(_cs),
+  clock_hz(_clock_hz > RF24_SPI_MAX_CLOCK_HZ ? RF24_SPI_MAX_CLOCK_HZ : _clock_hz),
+  device(NULL), acquired(false)
+{
+}
+
+/****************************************************************************/
+
+void RF24_SPI_ESP32::begin(void)
+{
+  if ( device )
+    return;
+
+  spi_bus_config_t bus;
+  memset( &bus, 0, sizeof(bus) );
+  bus.sclk_io_num = sck_pin;
+  bus.miso_io_num = miso_pin;
+  bus.mosi_io_num = mosi_pin;
+  bus.quadwp_io_num = -1;
+  bus.quadhd_io_num = -1;
+  bus.max_transfer_sz = RF24_SPI_MAX_TRANSFER;
+  // ESP_ERR_INVALID_STATE: bus already set up, e.g. for another radio sharing it.
+  (void)spi_bus_initialize( host, &bus, SPI_DMA_CH_AUTO );
+
+  spi_device_interface_config_t dev;
+  memset( &dev, 0, sizeof(dev) );
+  dev.mode = 0;
+  dev.clock_speed_hz = clock_hz;
+  dev.spics_io_num = cs_pin;
+  dev.queue_size = 1;
+  ESP_ERROR_CHECK( spi_bus_add_device( host, &dev, &device ) );
+}
+
+/****************************************************************************/
+
+void RF24_SPI_ESP32::exchange(uint8_t len, bool keep_selected)
+{
+  spi_transaction_t t;
+  memset( &t, 0, sizeof(t) );
+
+  // Keeping CS asserted across transactions requires exclusive use of the bus.
+  if ( keep_selected && !acquired ){
+    spi_device_acquire_bus( device, portMAX_DELAY );
+    acquired = true;
+  }
+
+  t.length = len << 3;
+  if ( keep_selected ){
+    t.flags |= SPI_TRANS_CS_KEEP_ACTIVE;
+  }
+  if ( len <= 4 ){
+    t.flags |= SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+    memcpy( t.tx_data, tx_buf, len );
+  }
+  else{
+    t.tx_buffer = tx_buf;
+    t.rx_buffer = rx_buf;
+  }
+
+  ESP_ERROR_CHECK( spi_device_polling_transmit( device, &t ) );
+
+  if ( len <= 4 ){
+    memcpy( rx_buf, t.rx_data, len );
+  }
+
+  if ( !keep_selected && acquired ){
+    spi_device_release_bus( device );
+    acquired = false;
+  }
+}
+
+/****************************************************************************/
+
+uint8_t RF24_SPI_ESP32::command(uint8_t cmd, const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected)
+{
+  if ( len > RF24_SPI_MAX_TRANSFER - 1 )
+    len = RF24_SPI_MAX_TRANSFER - 1;
+
+  tx_buf[0] = cmd;
+  if ( tx )
+    memcpy( tx_buf + 1, tx, len );
+  else
+    memset( tx_buf + 1, 0xff, len );
+
+  exchange( len + 1, keep_selected );
+
+  if ( rx )
+    memcpy( rx, rx_buf + 1, len );
+  return rx_buf[0];
+}
+
+/****************************************************************************/
+
+void RF24_SPI_ESP32::transfer(const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected)
+{
+  if ( len > RF24_SPI_MAX_TRANSFER )
+    len = RF24_SPI_MAX_TRANSFER;
+
+  if ( !len ){
+    // Nothing to clock. Chip select only goes high at the end of a transaction, so it stays
+    // asserted; see RF24_SPI::transfer().
+    if ( !keep_selected && acquired ){
+      spi_device_release_bus( device );
+      acquired = false;
+    }
+    return;
+  }
+
+  if ( tx )
+    memcpy( tx_buf, tx, len );
+  else
+    memset( tx_buf, 0xff, len );
+
+  exchange( len, keep_selected );
+
+  if ( rx )
+    memcpy( rx, rx_buf, len );
+}
+
+#endif // ESP_PLATFORM
@@ -0,0 +1,68 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RF24_spi_esp32.h
+ *
+ * ESP-IDF SPI master transport for RF24
+ */
+
+#ifndef __RF24_SPI_ESP32_H__
+#define __RF24_SPI_ESP32_H__
+
+#include "RF24_spi.h"
+
+#if defined (ESP_PLATFORM)
+
+#include <driver/spi_master.h>
+
+/**
+ * SPI transport on top of the ESP-IDF SPI master driver
+ *
+ * The device configuration is set up once in begin() and chip select is driven by the
+ * SPI peripheral, so a transaction costs a single spi_device_polling_transmit() call.
+ * Transactions of up to 4 bytes (register access, status) go through the transaction
+ * descriptor itself; longer ones (payloads) are moved by DMA.
+ *
+ * @note The DMA buffers are part of this object, so instances must live in internal RAM
+ * (e.g. a global), not in PSRAM.
+ */
+class RF24_SPI_ESP32 : public RF24_SPI
+{
+public:
+  /**
+   * @param _host SPI peripheral to use, e.g. SPI3_HOST (VSPI)
+   * @param _sck SCK pin
+   * @param _miso MISO pin
+   * @param _mosi MOSI pin
+   * @param _cs Chip select pin, driven by hardware
+   * @param _clock_hz SPI clock, limited to RF24_SPI_MAX_CLOCK_HZ
+   */
+  RF24_SPI_ESP32(spi_host_device_t _host, int8_t _sck, int8_t _miso, int8_t _mosi, int8_t _cs,
+                 uint32_t _clock_hz = RF24_SPI_MAX_CLOCK_HZ);
+
+  void begin(void);
+  uint8_t command(uint8_t cmd, const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected = false);
+  void transfer(const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected = false);
+
+private:
+  spi_host_device_t host;
+  int8_t sck_pin, miso_pin, mosi_pin, cs_pin;
+  uint32_t clock_hz;
+  spi_device_handle_t device;
+  bool acquired; /**< Bus is held by a transaction spanning multiple calls. */
+  alignas(4) uint8_t tx_buf[RF24_SPI_MAX_TRANSFER];
+  alignas(4) uint8_t rx_buf[RF24_SPI_MAX_TRANSFER];
+
+  /**
+   * Exchange the first len bytes of tx_buf with rx_buf
+   */
+  void exchange(uint8_t len, bool keep_selected);
+};
+
+#endif // ESP_PLATFORM
+
+#endif // __RF24_SPI_ESP32_H__
@@ -0,0 +1,195 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RF24_spi_mock.h
+ *
+ * Mock SPI transport for RF24, emulating the nRF24L01+ register file and RX FIFO
+ */
+
+#ifndef __RF24_SPI_MOCK_H__
+#define __RF24_SPI_MOCK_H__
+
+#include <string.h>
+#include "RF24_spi.h"
+#include "nRF24L01.h"
+
+/**
+ * Mock SPI transport
+ *
+ * Emulates just enough of the nRF24L01+ to drive RF24 without hardware: the register
+ * file, STATUS/FIFO_STATUS flags and a 3 level RX FIFO. Every transaction (chip select
+ * cycle) and every byte clocked is counted, so the SPI cost of RF24 calls can be
+ * measured on a host.
+ */
+class RF24_SPI_Mock : public RF24_SPI
+{
+public:
+  uint32_t transactions; /**< Number of chip select cycles */
+  uint32_t bytes;        /**< Number of bytes clocked, including command bytes */
+
+  RF24_SPI_Mock() { reset(); }
+
+  /**
+   * Clear registers, FIFOs and counters
+   */
+  void reset(void)
+  {
+    memset( regs, 0, sizeof(regs) );
+    regs[SETUP_AW][0] = 3;
+    rx_count = 0;
+    rx_head = 0;
+    rx_dr = false;
+    selected = false;
+    resetCounters();
+  }
+
+  /**
+   * Clear transaction & byte counters only
+   */
+  void resetCounters(void)
+  {
+    transactions = 0;
+    bytes = 0;
+  }
+
+  /**
+   * Put a payload in the RX FIFO, as if it was received on the air
+   *
+   * @return False when the RX FIFO is full
+   */
+  bool receive(uint8_t pipe, const uint8_t* data, uint8_t len)
+  {
+    if ( rx_count >= 3 )
+      return false;
+    uint8_t idx = (rx_head + rx_count) % 3;
+    memset( rx_fifo[idx], 0, sizeof(rx_fifo[idx]) );
+    memcpy( rx_fifo[idx], data, len > 32 ? 32 : len );
+    rx_pipe[idx] = pipe;
+    ++rx_count;
+    rx_dr = true;
+    return true;
+  }
+
+  /**
+   * Number of payloads in the RX FIFO
+   */
+  uint8_t rxCount(void) const { return rx_count; }
+
+  /**
+   * Register contents, for checking what RF24 configured
+   */
+  uint8_t reg(uint8_t reg, uint8_t idx = 0) const { return regs[reg & REGISTER_MASK][idx % 5]; }
+
+  /**
+   * True while chip select is asserted, i.e. a transaction is open
+   */
+  bool isSelected(void) const { return selected; }
+
+  void begin(void) {}
+
+  uint8_t command(uint8_t cmd, const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected = false)
+  {
+    if ( !selected ){
+      selected = true;
+      ++transactions;
+    }
+    current_cmd = cmd;
+    pos = 0;
+    ++bytes;
+    uint8_t st = status();
+    exchange( tx, rx, len );
+    if ( !keep_selected )
+      deselect();
+    return st;
+  }
+
+  void transfer(const uint8_t* tx, uint8_t* rx, uint8_t len, bool keep_selected = false)
+  {
+    exchange( tx, rx, len );
+    // Like the real backends, chip select is only released along with a byte.
+    if ( !keep_selected && len )
+      deselect();
+  }
+
+private:
+  uint8_t regs[32][5];
+  uint8_t rx_fifo[3][32];
+  uint8_t rx_pipe[3];
+  uint8_t rx_count;
+  uint8_t rx_head;
+  bool rx_dr;
+  bool selected;
+  uint8_t current_cmd;
+  uint8_t pos;
+
+  uint8_t status(void) const
+  {
+    uint8_t pipe = rx_count ? rx_pipe[rx_head] : 7;
+    return (rx_dr ? (1 << RX_DR) : 0) | (pipe << RX_P_NO) | (regs[STATUS][0] & ((1 << TX_DS) | (1 << MAX_RT)));
+  }
+
+  uint8_t read_reg(uint8_t reg, uint8_t idx) const
+  {
+    if ( reg == STATUS )
+      return status();
+    if ( reg == FIFO_STATUS )
+      return (1 << TX_EMPTY) | (rx_count == 3 ? (1 << RX_FULL) : 0) | (rx_count == 0 ? (1 << RX_EMPTY) : 0);
+    return regs[reg][idx % 5];
+  }
+
+  void write_reg(uint8_t reg, uint8_t idx, uint8_t value)
+  {
+    if ( reg == STATUS ){
+      // Interrupt flags are cleared by writing 1.
+      if ( value & (1 << RX_DR) )
+        rx_dr = false;
+      regs[STATUS][0] &= ~(value & ((1 << TX_DS) | (1 << MAX_RT)));
+      return;
+    }
+    regs[reg][idx % 5] = value;
+  }
+
+  void exchange(const uint8_t* tx, uint8_t* rx, uint8_t len)
+  {
+    while ( len-- ){
+      uint8_t value = clock( tx ? *tx++ : 0xff );
+      if ( rx )
+        *rx++ = value;
+    }
+  }
+
+  uint8_t clock(uint8_t mosi)
+  {
+    uint8_t miso = 0xff;
+    ++bytes;
+    if ( current_cmd < W_REGISTER )
+      miso = read_reg( current_cmd & REGISTER_MASK, pos );
+    else if ( current_cmd < ACTIVATE )
+      write_reg( current_cmd & REGISTER_MASK, pos, mosi );
+    else if ( current_cmd == R_RX_PAYLOAD )
+      miso = ( rx_count && pos < 32 ) ? rx_fifo[rx_head][pos] : 0;
+    else if ( current_cmd == R_RX_PL_WID )
+      miso = 32;
+    ++pos;
+    return miso;
+  }
+
+  void deselect(void)
+  {
+    selected = false;
+    // Payload is removed from the FIFO once chip select goes high, however many bytes were read.
+    if ( current_cmd == R_RX_PAYLOAD && rx_count ){
+      rx_head = (rx_head + 1) % 3;
+      --rx_count;
+    }
+    else if ( current_cmd == FLUSH_RX ){
+      rx_count = 0;
+    }
+  }
+};
+
+#endif // __RF24_SPI_MOCK_H__
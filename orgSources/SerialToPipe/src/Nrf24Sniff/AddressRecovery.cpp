@@ -0,0 +1,143 @@
+/**
+ * NRF24Sniff -- Nordic NRF24L01+ 2.4Ghz wireless module sniffer
+ *
+ * This file is part of NRF24Sniff, licensed GPL-3.0+; see Nrf24Sniff.cpp.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "AddressRecovery.h"
+
+// The CRCs of the nRF24, MSB first: CRC16-CCITT, and CRC8 with polynomial 0x07.
+#define CRC16_POLY    (0x1021)
+#define CRC16_INIT    (0xFFFF)
+#define CRC8_POLY     (0x07)
+#define CRC8_INIT     (0xFF)
+
+AddressRecovery::AddressRecovery()
+{
+  begin(5, 2, RECOVERY_MAX_PREFIX_LEN);
+}
+
+void AddressRecovery::begin( const uint8_t addressLen, const uint8_t crcLength, const uint8_t maxPrefixLen )
+{
+  m_addressLen = addressLen;
+  m_crcLength = crcLength == 1 ? 1 : 2;
+  m_maxPrefixLen = maxPrefixLen < RECOVERY_MAX_PREFIX_LEN ? maxPrefixLen : RECOVERY_MAX_PREFIX_LEN;
+  m_numFrames = 0;
+  (void)memset(m_targets, 0, sizeof(m_targets));
+
+  // CRC of every byte, as a CRC16 or CRC8 state with the byte in its top bits.
+  for (uint16_t b = 0; b < 256; ++b)
+  {
+    uint16_t crc = m_crcLength == 2 ? b << 8 : b;
+    const uint16_t top = m_crcLength == 2 ? 0x8000 : 0x80;
+    for (uint8_t i = 0; i < 8; ++i)
+      crc = (crc & top) ? (crc << 1) ^ (m_crcLength == 2 ? CRC16_POLY : CRC8_POLY) : crc << 1;
+    m_table[b] = m_crcLength == 2 ? crc : crc & 0xFF;
+  }
+}
+
+uint16_t AddressRecovery::unstep( uint16_t state, const uint8_t bit ) const
+{
+  // A step shifts the state left and adds the polynomial when the bit shifted out differed from the
+  // input bit. Both polynomials have their lowest bit set, so bit 0 after the step tells whether it did.
+  const uint16_t feedback = state & 1;
+  if (m_crcLength == 2)
+  {
+    if (feedback)
+      state ^= CRC16_POLY;
+    return (state >> 1) | ((feedback ^ bit) << 15);
+  }
+  if (feedback)
+    state ^= CRC8_POLY;
+  return ((state & 0xFF) >> 1) | ((feedback ^ bit) << 7);
+}
+
+bool AddressRecovery::add( const uint8_t* record, const uint8_t len )
+{
+  if ((m_numFrames >= RECOVERY_MAX_FRAMES) || (len <= m_addressLen))
+    return false;
+
+  // Address, the 9 bits of the control field & the payload are covered; the CRC follows right behind.
+  const uint8_t payloadLen = record[m_addressLen] >> 2;
+  const uint8_t n = m_addressLen + 1 + payloadLen;
+  if ((payloadLen > 32) || (n + m_crcLength >= len))
+    return false;
+  uint16_t state = m_crcLength == 2
+                 ? (uint16_t)(((uint32_t)record[n] << 16 | (uint32_t)record[n+1] << 8 | record[n+2]) >> 7)
+                 : (uint16_t)((((uint16_t)record[n] << 8 | record[n+1]) >> 7) & 0xFF);
+
+  // Run the CRC backwards to the start of the address; the state found is what the bytes in front,
+  // if any, must leave behind.
+  state = unstep(state, record[n] >> 7);
+  for (uint8_t i = n; i-- > 0;)
+  {
+    for (uint8_t b = 0; b < 8; ++b)
+      state = unstep(state, (record[i] >> b) & 1);
+  }
+  m_targets[state]++;
+  m_numFrames++;
+  return true;
+}
+
+uint32_t AddressRecovery::numCandidates() const
+{
+  uint32_t num = 0;
+  for (uint8_t len = 0; len <= m_maxPrefixLen; ++len)
+    num += 1UL << (8 * len);
+  return num;
+}
+
+Recovery_candidate_t AddressRecovery::candidate( uint32_t index ) const
+{
+  // Index 0 is no prefix at all, the next 256 the prefixes of 1 byte, and so on.
+  Recovery_candidate_t c;
+  c.prefixLen = 0;
+  while (index >= (1UL << (8 * c.prefixLen)))
+  {
+    index -= 1UL << (8 * c.prefixLen);
+    c.prefixLen++;
+  }
+  c.prefix = index;
+
+  uint16_t crc = m_crcLength == 2 ? CRC16_INIT : CRC8_INIT;
+  for (uint8_t i = c.prefixLen; i-- > 0;)
+  {
+    const uint8_t b = (uint8_t)(c.prefix >> (8 * i));
+    crc = m_crcLength == 2 ? (uint16_t)((crc << 8) ^ m_table[(crc >> 8) ^ b]) : m_table[crc ^ b];
+  }
+  c.frames = m_targets[crc];
+  return c;
+}
+
+void AddressRecovery::insert( Recovery_candidate_t* best, uint8_t& numBest, const Recovery_candidate_t& c )
+{
+  // Sorted on frames, the shortest prefix first among equals.
+  uint8_t pos = numBest;
+  while ((pos > 0) && (   (best[pos-1].frames < c.frames)
+                       || ((best[pos-1].frames == c.frames) && (best[pos-1].prefixLen > c.prefixLen))))
+    --pos;
+  if (pos >= RECOVERY_MAX_RESULTS)
+    return;
+  const uint8_t last = numBest < RECOVERY_MAX_RESULTS ? numBest : RECOVERY_MAX_RESULTS - 1;
+  for (uint8_t i = last; i > pos; --i)
+    best[i] = best[i-1];
+  best[pos] = c;
+  if (numBest < RECOVERY_MAX_RESULTS)
+    numBest++;
+}
+
+uint8_t AddressRecovery::run( Recovery_candidate_t* results ) const
+{
+  uint8_t numResults = 0;
+  const uint32_t total = numCandidates();
+  for (uint32_t i = 0; i < total; ++i)
+  {
+    const Recovery_candidate_t c = candidate(i);
+    if (c.frames)
+      insert(results, numResults, c);
+  }
+  return numResults;
+}
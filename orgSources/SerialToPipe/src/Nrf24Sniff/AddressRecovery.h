@@ -0,0 +1,66 @@
+/**
+ * NRF24Sniff -- Nordic NRF24L01+ 2.4Ghz wireless module sniffer
+ *
+ * This file is part of NRF24Sniff, licensed GPL-3.0+; see Nrf24Sniff.cpp.
+ */
+
+#ifndef AddressRecovery_h
+#define AddressRecovery_h
+
+#include <stdint.h>
+
+// Recovery of the address bytes sent before the ones the sniffer listens on. The nRF24 finds an
+// address anywhere in the bit stream, so a sniffer listening on the last bytes of a longer address
+// captures its frames, but not the bytes in front; its CRC check then fails, as the CRC covers the
+// whole address. Run backwards over the captured part, the CRC of every frame tells the one CRC state
+// the missing bytes must leave behind. Each candidate then only takes a CRC over its own bytes and a
+// lookup: all 65793 of up to 2 bytes take about a millisecond, so they're tried on the calling thread.
+// Those that fit the most frames are the best bets.
+// A CRC8 tells only one byte apart: longer prefixes come out as ties.
+// Portable on purpose, so it can be fed recorded or synthetic frames on any host.
+
+#define RECOVERY_MAX_PREFIX_LEN   (2)       // Bytes searched; an address is 5 bytes at most and 3 at least
+#define RECOVERY_MAX_FRAMES       (1024)
+#define RECOVERY_MAX_RESULTS      (5)
+
+typedef struct _Recovery_candidate_t
+{
+  uint8_t  prefixLen;                     // Bytes sent before the address the sniffer listens on; 0 = none
+  uint32_t prefix;                        // Their value, first byte sent in the MSB
+  uint16_t frames;                        // Frames whose CRC is right with them
+} Recovery_candidate_t;
+
+class AddressRecovery
+{
+public:
+  AddressRecovery();
+
+  // Start over for frames captured with an address of addressLen bytes and a CRC of crcLength bytes,
+  // searching up to maxPrefixLen bytes in front of the address.
+  void begin( const uint8_t addressLen, const uint8_t crcLength, const uint8_t maxPrefixLen );
+
+  // Add a captured frame: its address, then the NRF24 frame from the control field on. Returns false
+  // when it can't be used: there's no room left, or the frame has been cut short before the end of its CRC.
+  bool add( const uint8_t* record, const uint8_t len );
+
+  uint16_t numFrames() const { return m_numFrames; }
+
+  // Try every prefix. Fills in up to RECOVERY_MAX_RESULTS candidates that fit any frames, best first;
+  // returns how many.
+  uint8_t run( Recovery_candidate_t* results ) const;
+
+private:
+  uint16_t m_table[256];                  // CRC of every byte value, for the CRC length in use
+  uint16_t m_targets[1 << 16];            // Frames per CRC state required behind the prefix
+  uint16_t m_numFrames;
+  uint8_t  m_addressLen;
+  uint8_t  m_crcLength;
+  uint8_t  m_maxPrefixLen;
+
+  uint16_t unstep( uint16_t state, const uint8_t bit ) const;
+  uint32_t numCandidates() const;
+  Recovery_candidate_t candidate( uint32_t index ) const;
+  static void insert( Recovery_candidate_t* best, uint8_t& numBest, const Recovery_candidate_t& c );
+};
+
+#endif // AddressRecovery_h
@@ -0,0 +1,190 @@
+/**
+ * NRF24Sniff -- Nordic NRF24L01+ 2.4Ghz wireless module sniffer
+ *
+ * This file is part of NRF24Sniff, licensed GPL-3.0+; see Nrf24Sniff.cpp.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Discovery.h"
+
+// True when a has at least ratio times the rate of frames with a valid CRC of b.
+static bool outperforms( const Discovery_candidate_t& a, const Discovery_candidate_t& b, const uint32_t ratio )
+{
+  const uint64_t listenA = a.listenMs ? a.listenMs : 1;
+  const uint64_t listenB = b.listenMs ? b.listenMs : 1;
+  return (uint64_t)a.packetsCrcOk * listenB >= ratio * (uint64_t)b.packetsCrcOk * listenA;
+}
+
+Discovery::Discovery()
+{
+  begin(NULL, 0, DISCOVERY_MIN_ADDRESS_LEN, DISCOVERY_DEFAULT_DWELL_MS);
+}
+
+void Discovery::begin( const uint8_t* channels, const uint8_t numChannels, const uint8_t minAddressLen, const uint16_t dwellMs )
+{
+  // Ascending and each channel once, whatever order & overlap the ranges given had.
+  bool wanted[RF_NUM_CHANNELS] = { false };
+  for (uint8_t i = 0; i < numChannels; ++i)
+  {
+    if (channels[i] < RF_NUM_CHANNELS)
+      wanted[channels[i]] = true;
+  }
+  m_numChannels = 0;
+  for (uint8_t ch = 0; ch < RF_NUM_CHANNELS; ++ch)
+  {
+    if (wanted[ch])
+      m_channels[m_numChannels++] = ch;
+  }
+
+  m_minAddressLen = minAddressLen < DISCOVERY_MIN_ADDRESS_LEN ? DISCOVERY_MIN_ADDRESS_LEN
+                  : minAddressLen > DISCOVERY_MAX_ADDRESS_LEN ? DISCOVERY_MAX_ADDRESS_LEN : minAddressLen;
+  const uint8_t numAddressLens = DISCOVERY_MAX_ADDRESS_LEN - m_minAddressLen + 1;
+  m_numPasses = DISCOVERY_NUM_RATES * numAddressLens;
+  (void)memset(m_candidates, 0, sizeof(m_candidates));
+  for (uint8_t p = 0; p < m_numPasses; ++p)
+  {
+    for (uint8_t i = 0; i < m_numChannels; ++i)
+    {
+      Discovery_candidate_t& c = m_candidates[p * m_numChannels + i];
+      c.channel = m_channels[i];
+      c.rate = p / numAddressLens;
+      c.addressLen = m_minAddressLen + p % numAddressLens;
+    }
+  }
+  // The first round listens to all of them.
+  for (uint16_t i = 0; i < DISCOVERY_MAX_CANDIDATES; ++i)
+    m_active[i] = true;
+  m_pass = 0;
+  m_nextPass = 0;
+  m_round = 0;
+  m_dwellMs = dwellMs ? dwellMs : DISCOVERY_DEFAULT_DWELL_MS;
+  m_done = m_numChannels == 0;
+}
+
+bool Discovery::nextPass( Discovery_pass_t& pass )
+{
+  if (m_done || decided())
+  {
+    m_done = true;
+    return false;
+  }
+  const uint8_t numAddressLens = DISCOVERY_MAX_ADDRESS_LEN - m_minAddressLen + 1;
+  for (;;)
+  {
+    while (m_nextPass < m_numPasses)
+    {
+      const uint8_t p = m_nextPass++;
+      pass.numChannels = 0;
+      for (uint8_t i = 0; i < m_numChannels; ++i)
+      {
+        if (m_active[p * m_numChannels + i])
+          pass.channels[pass.numChannels++] = m_channels[i];
+      }
+      if (pass.numChannels)
+      {
+        m_pass = p;
+        pass.rate = p / numAddressLens;
+        pass.addressLen = m_minAddressLen + p % numAddressLens;
+        pass.dwellMs = m_dwellMs;
+        return true;
+      }
+    }
+    if (m_round + 1 >= DISCOVERY_MAX_ROUNDS)
+    {
+      m_done = true;
+      return false;
+    }
+    nextRound();
+  }
+}
+
+void Discovery::nextRound()
+{
+  // Revisit the candidates with the highest rates of valid frames. When there were none at
+  // all, listen to everything again; the network might just have been quiet.
+  const uint16_t numCandidates = m_numPasses * m_numChannels;
+  (void)memset(m_active, 0, sizeof(m_active));
+  uint8_t numContenders = 0;
+  for (; numContenders < DISCOVERY_MAX_CONTENDERS; ++numContenders)
+  {
+    int16_t next = -1;
+    for (uint16_t i = 0; i < numCandidates; ++i)
+    {
+      if (!m_active[i] && m_candidates[i].packetsCrcOk && ((next < 0) || !outperforms(m_candidates[next], m_candidates[i], 1)))
+        next = i;
+    }
+    if (next < 0)
+      break;
+    m_active[next] = true;
+  }
+  if (numContenders == 0)
+  {
+    for (uint16_t i = 0; i < numCandidates; ++i)
+      m_active[i] = true;
+  }
+  m_round++;
+  m_nextPass = 0;
+  if (m_dwellMs <= 0xFFFF / 2)
+    m_dwellMs *= 2;
+}
+
+void Discovery::add( const Channel_stats_t& stats )
+{
+  for (uint8_t i = 0; i < m_numChannels; ++i)
+  {
+    if (m_channels[i] != stats.channel)
+      continue;
+    // More valid frames than frames heard can't come from a CRC check.
+    if (stats.packetsCrcOk > stats.packets)
+      return;
+    Discovery_candidate_t& c = m_candidates[m_pass * m_numChannels + i];
+    c.packets += stats.packets;
+    c.packetsCrcOk += stats.packetsCrcOk;
+    c.listenMs += stats.listenMs;
+    return;
+  }
+}
+
+const Discovery_candidate_t* Discovery::bestCandidate() const
+{
+  const Discovery_candidate_t* best = NULL;
+  for (uint16_t i = 0; i < m_numPasses * m_numChannels; ++i)
+  {
+    const Discovery_candidate_t& c = m_candidates[i];
+    if (c.packetsCrcOk && (!best || !outperforms(*best, c, 1) || ((c.packetsCrcOk > best->packetsCrcOk) && outperforms(c, *best, 1))))
+      best = &c;
+  }
+  return best;
+}
+
+bool Discovery::best( Discovery_candidate_t& candidate ) const
+{
+  const Discovery_candidate_t* best = bestCandidate();
+  if (!best)
+    return false;
+  candidate = *best;
+  return true;
+}
+
+bool Discovery::decided() const
+{
+  const Discovery_candidate_t* best = bestCandidate();
+  if (!best || (best->packetsCrcOk < DISCOVERY_MIN_FRAMES))
+    return false;
+  for (uint16_t i = 0; i < m_numPasses * m_numChannels; ++i)
+  {
+    const Discovery_candidate_t& c = m_candidates[i];
+    if ((&c == best) || !c.packetsCrcOk)
+      continue;
+    // The winner heard on a neighbouring channel is no rival.
+    const int8_t distance = (int8_t)c.channel - (int8_t)best->channel;
+    if (   (c.rate == best->rate) && (c.addressLen == best->addressLen)
+        && (distance >= -DISCOVERY_ADJACENT_CHANNELS) && (distance <= DISCOVERY_ADJACENT_CHANNELS))
+      continue;
+    if (!outperforms(*best, c, DISCOVERY_WIN_RATIO))
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,92 @@
+/**
+ * NRF24Sniff -- Nordic NRF24L01+ 2.4Ghz wireless module sniffer
+ *
+ * This file is part of NRF24Sniff, licensed GPL-3.0+; see Nrf24Sniff.cpp.
+ */
+
+#ifndef Discovery_h
+#define Discovery_h
+
+#include <stdint.h>
+
+#include "NRF24_sniff_protocol.h"
+
+// Search for the channel, data rate & address length of an unknown network. The sniffer listens through
+// one data rate & address length per pass, hopping through the channels, and reports the frames with a
+// valid CRC per channel; a wrong data rate or address length yields none. Rounds after the first only
+// revisit the candidates that had any, listening longer. The search ends as soon as one candidate clearly
+// wins. Portable on purpose, so it can be fed simulated channel statistics on any host.
+
+#define DISCOVERY_NUM_RATES           (3)       // rf24_datarate_e 0..2
+#define DISCOVERY_MAX_ADDRESS_LEN     (5)
+#define DISCOVERY_MIN_ADDRESS_LEN     (3)
+#define DISCOVERY_MAX_CANDIDATES      (RF_NUM_CHANNELS * DISCOVERY_NUM_RATES * (DISCOVERY_MAX_ADDRESS_LEN - DISCOVERY_MIN_ADDRESS_LEN + 1))
+#define DISCOVERY_DEFAULT_DWELL_MS    (20)      // Listening time per channel in the first round
+#define DISCOVERY_MAX_ROUNDS          (4)       // Each following round doubles the listening time
+#define DISCOVERY_MAX_CONTENDERS      (8)       // Candidates revisited after the first round
+#define DISCOVERY_MIN_FRAMES          (5)       // Frames with a valid CRC a winner needs at least
+#define DISCOVERY_WIN_RATIO           (4)       // ... at this many times the rate of the runner-up
+#define DISCOVERY_ADJACENT_CHANNELS   (2)       // A strong transmitter is heard this far off its channel
+
+typedef struct _Discovery_candidate_t
+{
+  uint8_t  channel;
+  uint8_t  rate;
+  uint8_t  addressLen;
+  uint32_t packets;                       // Frames heard, over all rounds
+  uint32_t packetsCrcOk;                  // ... of which with a valid CRC
+  uint32_t listenMs;
+} Discovery_candidate_t;
+
+// One pass of the sniffer: a data rate & address length, hopping through channels.
+typedef struct _Discovery_pass_t
+{
+  uint8_t  rate;
+  uint8_t  addressLen;
+  uint16_t dwellMs;
+  uint8_t  numChannels;
+  uint8_t  channels[RF_NUM_CHANNELS];     // Ascending
+} Discovery_pass_t;
+
+class Discovery
+{
+public:
+  Discovery();
+
+  // Start a search through the given channels at all data rates, for address lengths from minAddressLen up.
+  void begin( const uint8_t* channels, const uint8_t numChannels, const uint8_t minAddressLen, const uint16_t dwellMs );
+
+  // Fetch the next pass for the sniffer to listen through. Returns false when the search is over.
+  bool nextPass( Discovery_pass_t& pass );
+
+  // Account the statistics of a channel the sniffer sent during the current pass. Only frames with a
+  // verified CRC score, so the sniffer must check CRCs; frames it couldn't check don't count as valid.
+  void add( const Channel_stats_t& stats );
+
+  // Fetch the candidate with the highest rate of frames with a valid CRC so far.
+  // Returns false when none had any.
+  bool best( Discovery_candidate_t& candidate ) const;
+
+  // True when the best candidate clearly beats all others.
+  bool decided() const;
+
+  uint8_t round() const { return m_round; }
+
+private:
+  Discovery_candidate_t m_candidates[DISCOVERY_MAX_CANDIDATES];
+  bool     m_active[DISCOVERY_MAX_CANDIDATES];  // Listened to in the current round
+  uint8_t  m_channels[RF_NUM_CHANNELS];
+  uint8_t  m_numChannels;
+  uint8_t  m_minAddressLen;
+  uint8_t  m_numPasses;                   // Data rates times address lengths
+  uint8_t  m_pass;                        // Current pass; candidates of pass n are at n * m_numChannels
+  uint8_t  m_nextPass;
+  uint8_t  m_round;
+  uint16_t m_dwellMs;
+  bool     m_done;
+
+  const Discovery_candidate_t* bestCandidate() const;
+  void nextRound();
+};
+
+#endif // Discovery_h
@@ -0,0 +1,190 @@
+/**
+ * NRF24Sniff -- Nordic NRF24L01+ 2.4Ghz wireless module sniffer
+ *
+ * This file is part of NRF24Sniff, licensed GPL-3.0+; see Nrf24Sniff.cpp.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "DiversityCombiner.h"
+
+void diversityKey( DiversityFrame& frame, const uint8_t addressLen )
+{
+  // The first byte of the control field holds payload length & PID; the NO_ACK bit follows.
+  const uint8_t keyLen = frame.len < addressLen + 1 ? frame.len : addressLen + 1;
+  frame.key = 0;
+  for (uint8_t i = 0; i < keyLen; ++i)
+    frame.key = (frame.key << 8) | frame.record[i];
+
+  // FNV-1a. Only the MSbit of the last byte is part of the frame; the other bits are noise, which
+  // differs between sniffers.
+  uint32_t hash = 2166136261UL;
+  for (uint8_t i = keyLen; i < frame.len; ++i)
+  {
+    hash ^= (i == frame.len - 1) ? frame.record[i] & 0x80 : frame.record[i];
+    hash *= 16777619UL;
+  }
+  frame.hash = hash;
+}
+
+DiversityCombiner::DiversityCombiner()
+{
+  clear(1);
+}
+
+void DiversityCombiner::clear( const uint8_t numPorts )
+{
+  (void)memset(m_groups, 0, sizeof(m_groups));
+  m_numGroups = 0;
+  (void)memset(m_clocks, 0, sizeof(m_clocks));
+  m_numPorts = numPorts < DIVERSITY_MAX_PORTS ? numPorts : DIVERSITY_MAX_PORTS;
+  clearStats();
+}
+
+void DiversityCombiner::clearStats()
+{
+  (void)memset(&m_stats, 0, sizeof(m_stats));
+}
+
+uint64_t DiversityCombiner::toHostTime( const uint8_t port, const uint32_t snifferTimestamp_us, const uint64_t hostNow_us )
+{
+  PortClock& clock = m_clocks[port];
+  if (!clock.anchored)
+  {
+    // First estimate; it is off by the serial latency, which align() takes out later on.
+    clock.anchored = true;
+    clock.offset_us = (int64_t)(hostNow_us - snifferTimestamp_us);
+  }
+  else if ((snifferTimestamp_us < clock.last) && (clock.last - snifferTimestamp_us > 0x80000000UL))
+  {
+    // Only a step back by more than half the range is a wrap around; a small one is reordering.
+    clock.high += 1ULL << 32;
+  }
+  clock.last = snifferTimestamp_us;
+  return (uint64_t)((int64_t)(clock.high + snifferTimestamp_us) + clock.offset_us);
+}
+
+bool DiversityCombiner::locked( const uint8_t port ) const
+{
+  // The first sniffer sets the timeline the others align to.
+  return (port == 0) || (m_clocks[port].matches >= DIVERSITY_LOCK_MATCHES);
+}
+
+void DiversityCombiner::align( const uint8_t port, const int64_t error_us )
+{
+  // Follow slowly; a single copy may be delayed a bit by the sniffer.
+  PortClock& clock = m_clocks[port];
+  clock.offset_us += error_us / 4;
+  if (clock.matches < DIVERSITY_LOCK_MATCHES)
+    ++clock.matches;
+}
+
+void DiversityCombiner::add( const uint8_t port, const uint32_t snifferTimestamp_us, const uint64_t hostNow_us, const DiversityFrame& frame )
+{
+  if (port >= m_numPorts)
+    return;
+  const uint8_t bit = 1 << port;
+  const uint64_t t = toHostTime(port, snifferTimestamp_us, hostNow_us);
+  m_stats.port[port].heard++;
+  if (frame.crcOk)
+    m_stats.port[port].crcOk++;
+
+  // Closest transmission on the same channel this copy fits. A sniffer hears every transmission once,
+  // so one it already has a copy of is a retransmission. Copies with a valid CRC must match entirely;
+  // a corrupt one can only be matched on its key.
+  Group* best = NULL;
+  uint64_t bestDelta = 0;
+  for (uint16_t i = 0; i < DIVERSITY_MAX_GROUPS; ++i)
+  {
+    Group& g = m_groups[i];
+    if (!g.used || (g.ports & bit) || (g.frame.key != frame.key) || (g.frame.channel != frame.channel))
+      continue;
+    if (frame.crcOk && g.frame.crcOk && (g.frame.hash != frame.hash))
+      continue;
+    const uint64_t delta = t > g.timestamp_us ? t - g.timestamp_us : g.timestamp_us - t;
+    const uint32_t window = locked(port) && locked(g.refPort) ? DIVERSITY_WINDOW_US : DIVERSITY_ACQUIRE_US;
+    if ((delta <= window) && (!best || (delta < bestDelta)))
+    {
+      best = &g;
+      bestDelta = delta;
+    }
+  }
+
+  if (!best)
+  {
+    for (uint16_t i = 0; (i < DIVERSITY_MAX_GROUPS) && !best; ++i)
+    {
+      if (!m_groups[i].used)
+        best = &m_groups[i];
+    }
+    if (!best)
+    {
+      m_stats.dropped++;
+      return;
+    }
+    (void)memset(best, 0, sizeof(*best));
+    best->used = true;
+    best->timestamp_us = t;
+    best->arrival_us = hostNow_us;
+    best->refPort = port;
+    best->frame = frame;
+    m_numGroups++;
+  }
+  else
+  {
+    // Only copies both sniffers got right tell the clock offset reliably.
+    if (frame.crcOk && (port != 0) && (best->validPorts & 1))
+      align(port, (int64_t)(best->portTimestamp_us[0] - t));
+    if (frame.crcOk && (port == 0))
+    {
+      for (uint8_t p = 1; p < m_numPorts; ++p)
+      {
+        if (best->validPorts & (1 << p))
+          align(p, (int64_t)(t - best->portTimestamp_us[p]));
+      }
+    }
+    if (frame.crcOk && !best->frame.crcOk)
+      best->frame = frame;
+    if (port < best->refPort)
+    {
+      best->refPort = port;
+      best->timestamp_us = t;
+    }
+  }
+  best->ports |= bit;
+  if (frame.crcOk)
+    best->validPorts |= bit;
+  best->portTimestamp_us[port] = t;
+}
+
+bool DiversityCombiner::pop( const uint64_t hostNow_us, DiversityFrame& frame )
+{
+  Group* oldest = NULL;
+  for (uint16_t i = 0; i < DIVERSITY_MAX_GROUPS; ++i)
+  {
+    Group& g = m_groups[i];
+    if (g.used && (!oldest || (g.timestamp_us < oldest->timestamp_us)))
+      oldest = &g;
+  }
+  // A full table can't wait any longer.
+  if (!oldest || ((hostNow_us - oldest->arrival_us < DIVERSITY_HOLD_US) && (m_numGroups < DIVERSITY_MAX_GROUPS)))
+    return false;
+
+  m_stats.frames++;
+  if (!oldest->validPorts)
+    m_stats.framesBadCrc++;
+  for (uint8_t p = 0; p < m_numPorts; ++p)
+  {
+    const uint8_t bit = 1 << p;
+    if (!(oldest->ports & bit))
+      m_stats.port[p].missed++;
+    if (oldest->validPorts == bit)
+      m_stats.port[p].sole++;
+  }
+  frame = oldest->frame;
+  frame.timestamp_us = oldest->timestamp_us;
+  oldest->used = false;
+  m_numGroups--;
+  return true;
+}
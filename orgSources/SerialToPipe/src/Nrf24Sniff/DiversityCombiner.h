@@ -0,0 +1,114 @@
+/**
+ * NRF24Sniff -- Nordic NRF24L01+ 2.4Ghz wireless module sniffer
+ *
+ * This file is part of NRF24Sniff, licensed GPL-3.0+; see Nrf24Sniff.cpp.
+ */
+
+#ifndef DiversityCombiner_h
+#define DiversityCombiner_h
+
+#include <stdint.h>
+
+// Combines the frames of several sniffers listening to the same channel & address into one stream.
+// Copies of a transmission are matched on address, PID, payload length and payload, within a time
+// window; the combined stream holds one copy of each, one with a valid CRC when any sniffer heard one.
+// Portable on purpose, so it can be fed recorded or synthetic streams on any host.
+
+#define DIVERSITY_MAX_PORTS     (4)       // Sniffers combined, the first one included
+#define DIVERSITY_MAX_RECORD    (48)      // Bytes of address & frame kept per copy, room for the maximum payload
+#define DIVERSITY_MAX_GROUPS    (256)     // Transmissions waiting for the copies of the other sniffers
+#define DIVERSITY_WINDOW_US     (1000)    // Copies of one transmission lie this close, once the clocks are aligned
+#define DIVERSITY_ACQUIRE_US    (20000)   // ... and this close before; serial latency blurs the first estimate
+#define DIVERSITY_LOCK_MATCHES  (8)       // Matched copies after which the clock of a sniffer counts as aligned
+#define DIVERSITY_HOLD_US       (50000)   // Host time to wait for the copies of the other sniffers
+
+// Copy of a frame as heard by one sniffer.
+struct DiversityFrame
+{
+  uint64_t timestamp_us;                  // Set by the combiner: time on the host timeline
+  uint64_t key;                           // Address, PID & payload length; see diversityKey()
+  uint32_t hash;                          // Of the frame after the control field
+  bool     crcOk;
+  bool     crcChecked;                    // False when the sniffer captured too little of the frame to check its CRC
+  uint8_t  rxPipe;                        // Sniffer details passed on with the copy that is kept
+  uint8_t  channel;
+  uint8_t  radio;
+  uint8_t  len;
+  uint8_t  record[DIVERSITY_MAX_RECORD+1];  // Address & NRF24 frame; one byte spare, see Nrf24Sniff.cpp
+};
+
+struct DiversityPortStats
+{
+  uint32_t heard;                         // Copies received
+  uint32_t crcOk;                         // ... of which with a valid CRC
+  uint32_t missed;                        // Combined frames this sniffer has no copy of
+  uint32_t sole;                          // Combined frames only this sniffer has a valid copy of
+};
+
+struct DiversityStats
+{
+  uint32_t frames;                        // Combined frames
+  uint32_t framesBadCrc;                  // ... of which no sniffer has a valid copy
+  uint32_t dropped;                       // Copies dropped as no more transmissions could be held
+  DiversityPortStats port[DIVERSITY_MAX_PORTS];
+};
+
+// Fill in key & hash of a frame whose record and len are set. The record holds an address of
+// addressLen bytes, then the NRF24 frame from its control field on.
+void diversityKey( DiversityFrame& frame, const uint8_t addressLen );
+
+class DiversityCombiner
+{
+public:
+  DiversityCombiner();
+
+  // Start over with the given number of sniffers; frames held and statistics are dropped.
+  void clear( const uint8_t numPorts );
+
+  // Add a copy heard by a sniffer at its own time snifferTimestamp_us, which arrived at host time hostNow_us.
+  // Copies of a sniffer must be added in the order it sent them.
+  void add( const uint8_t port, const uint32_t snifferTimestamp_us, const uint64_t hostNow_us, const DiversityFrame& frame );
+
+  // Fetch the oldest combined frame once the other sniffers had time to deliver their copies.
+  // Returns false when none is due yet.
+  bool pop( const uint64_t hostNow_us, DiversityFrame& frame );
+
+  const DiversityStats& stats() const { return m_stats; }
+
+  // Reset the statistics, e.g. after reporting them.
+  void clearStats();
+
+private:
+  struct Group
+  {
+    bool     used;
+    uint64_t timestamp_us;                // Of the copy of the lowest port
+    uint64_t arrival_us;                  // Host time the first copy arrived
+    uint8_t  ports;                       // Bit per port that has a copy
+    uint8_t  validPorts;                  // ... with a valid CRC
+    uint8_t  refPort;                     // Lowest port with a copy
+    uint64_t portTimestamp_us[DIVERSITY_MAX_PORTS];
+    DiversityFrame frame;                 // Copy that is kept
+  };
+
+  struct PortClock
+  {
+    bool     anchored;
+    uint32_t last;                        // Previous sniffer timestamp, to spot wrap arounds
+    uint64_t high;                        // Wrap arounds so far, in the upper 32 bits
+    int64_t  offset_us;                   // Sniffer time to host timeline
+    uint16_t matches;
+  };
+
+  Group     m_groups[DIVERSITY_MAX_GROUPS];
+  uint16_t  m_numGroups;
+  PortClock m_clocks[DIVERSITY_MAX_PORTS];
+  uint8_t   m_numPorts;
+  DiversityStats m_stats;
+
+  uint64_t toHostTime( const uint8_t port, const uint32_t snifferTimestamp_us, const uint64_t hostNow_us );
+  bool locked( const uint8_t port ) const;
+  void align( const uint8_t port, const int64_t error_us );
+};
+
+#endif // DiversityCombiner_h
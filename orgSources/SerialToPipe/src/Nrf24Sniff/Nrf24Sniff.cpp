@@ -29,13 +29,14 @@
 #include <assert.h>
 #include <stddef.h>
 #include <errno.h>
+#include <ctype.h>
 #include "XGetopt.h"
+#include "NRF24_sniff_protocol.h"     // Shared with the sniffer firmware, in <repo>/src
+#include "DiversityCombiner.h"
+#include "Discovery.h"
+#include "AddressRecovery.h"
 
-#define MSG_TYPE_PACKET          (0)
-#define MSG_TYPE_CONFIG          (1)
-#define GET_MSG_LEN(var)         ((var) & 0x3F)
-#define SET_MSG_TYPE(var,type)   (((var) & 0x3F) | ((type) << 6))
-#define GET_MSG_TYPE(var)        ((var) >> 6)
+#define RECORD_V2_MINIMUM_LENGTH (3)      // Flags, 1 byte timestamp delta and at least 1 byte of frame
 
 #define BITS_TO_BYTES(x)  (((x)+7)>>3)
 #define BYTES_TO_BITS(x)  ((x)<<3)
@@ -49,8 +50,16 @@
 #define NRF_CRC_LENGTH             (2)      // Length of NRF24 CRC field, in bytes
 #define SERIAL_PACKET_LENGTH(payloadLen)  (TIMESTAMP_LENGTH+PACKETS_LOST_LENGTH+NRF_ADDRESS_LENGTH+BITS_TO_BYTES(NRF_CONTROL_LENGTH_BITS+BYTES_TO_BITS(payloadLen)+BYTES_TO_BITS(NRF_CRC_LENGTH)))
 #define SERIAL_MINIMUM_PACKET_LENGTH      (SERIAL_PACKET_LENGTH(NRF_MIN_PAYLOAD_LENGTH))
+#define SERIAL_HEADER_ONLY_LENGTH         (TIMESTAMP_LENGTH+PACKETS_LOST_LENGTH+NRF_ADDRESS_LENGTH+BITS_TO_BYTES(NRF_CONTROL_LENGTH_BITS))
 #define SERIAL_MAXIMUM_PACKET_LENGTH      (SERIAL_PACKET_LENGTH(NRF_MAX_PAYLOAD_LENGTH))
-#define PCAP_MAXIMUM_PACKET_LENGTH        (SERIAL_MAXIMUM_PACKET_LENGTH)
+#define PCAP_MAXIMUM_PACKET_LENGTH        (NRF24_META_LENGTH+SERIAL_MAXIMUM_PACKET_LENGTH)
+
+#define LINKTYPE_NRF24             (147)    // LINKTYPE_USER0: NRF24 frame, decoded by the "nrf24" dissector
+#define LINKTYPE_NRF24_META        (148)    // LINKTYPE_USER1: pseudo header & NRF24 frame, decoded by the "nrf24meta" dissector
+#define NRF24_META_LENGTH          (5)      // Pseudo header: its length, RX pipe, RF channel, flags & radio
+#define NRF24_META_FLAG_BADCRC     (0x01)   // Sniffer found the NRF24 CRC of the frame invalid
+#define NRF24_META_FLAG_NOCRC      (0x02)   // Sniffer captured too little of the frame to check its CRC
+#define NRF24_META_UNKNOWN         (0xFF)   // RX pipe or RF channel the record doesn't tell
 
 #define DEFAULT_BAUDRATE                (115200)
 #define DEFAULT_COMPORT                 (0)
@@ -61,6 +70,23 @@
 #define DEFAULT_RF_BASE_ADDRESS         ((uint64_t)0xA8A8E1FC00ULL)
 #define DEFAULT_RF_CRC_LEN              (2)
 #define DEFAULT_RF_PAYLOAD_LEN          (32)
+#define DEFAULT_BUFFER_SIZE             (0)      // Capture buffer size on sniffer in KiB. 0 = sniffer default.
+#define DEFAULT_SWITCH_BAUDRATE         (0)      // Baudrate to switch to after handshake. 0 = don't switch.
+#define DEFAULT_RECORD_FORMAT           (RECORD_FORMAT_V2)
+#define DEFAULT_FRAMING                 (FRAMING_COBS)
+#define DEFAULT_CRC_CHECK               (CRC_CHECK_OFF)
+#define DEFAULT_SUMMARY_INTERVAL        (0)      // Node statistics summary interval in ms. 0 = capture packets.
+#define DEFAULT_SNAPLEN                 (SNAPLEN_ALL)
+#define DEFAULT_HOP_DWELL_MS            (100)    // Time spent on each channel when hopping, in ms.
+#define MAX_HOP_RANGES                  (8)      // Channel ranges to hop through given on the commandline.
+#define RADIO_ADDRESS_BASE              (~0ULL)  // Address of a further radio that listens on the base address.
+#define DIVERSITY_REPORT_MS             (10000)  // Interval of the per sniffer loss report when combining sniffers.
+#define DISCOVERY_STATS_WAIT_MS         (1500)   // Longer than the interval of the sniffer's channel statistics.
+#define RECOVERY_FIRST_REPORT           (16)     // Frames before the first address recovery report; then at every doubling.
+
+#define CONFIG_TIMEOUT_MS               (2000)   // Time to wait for sniffer to echo a config.
+#define RESTART_TIMEOUT_MS              (10000)  // Time to wait for sniffer to send its config after a reset.
+#define BAUD_CONFIRM_TIMEOUT_MS         (1500)   // Longer than the sniffer waits for our confirmation, so it has fallen back when we do.
 
 static struct {
   uint32_t magic_number;   /* magic number */
@@ -70,7 +96,7 @@ static struct {
   uint32_t sigfigs;        /* accuracy of timestamps */
   uint32_t snaplen;        /* max length of captured packets, in octets */
   uint32_t network;        /* data link type */
-} pcap_hdr = { 0xa1b2c3d4, 2, 4, 0, 0, 65535, 147 /*LINKTYPE_USER0*/ };
+} pcap_hdr = { 0xa1b2c3d4, 2, 4, 0, 0, 65535, LINKTYPE_NRF24 };
 
 typedef struct _pcaprec_hdr {
   uint32_t ts_sec;         /* timestamp seconds */
@@ -79,21 +105,158 @@ typedef struct _pcaprec_hdr {
   uint32_t orig_len;       /* actual length of packet */
 } pcaprec_hdr;
 
-#pragma pack(push)
-#pragma pack(1)
-typedef struct _serialConfig
+static Serial_config_t config = { SNIFF_PROTOCOL_VERSION, DEFAULT_RF_CHANNEL, DEFAULT_RF_DATARATE, DEFAULT_RF_ADDRESS_LEN, DEFAULT_RF_ADDRESS_PROMISC_LEN, DEFAULT_RF_BASE_ADDRESS, DEFAULT_RF_CRC_LEN, DEFAULT_RF_PAYLOAD_LEN, DEFAULT_BUFFER_SIZE, DEFAULT_SWITCH_BAUDRATE, DEFAULT_RECORD_FORMAT, DEFAULT_FRAMING, DEFAULT_CRC_CHECK, CAPTURE_MODE_PACKETS, DEFAULT_SUMMARY_INTERVAL, DEFAULT_SNAPLEN, PIPES_DEFAULT, 0, { 0 } };
+static Filter_rule_t filters[MAX_FILTER_RULES];
+static uint8_t numFilters = 0;
+static uint64_t rxPipeAddresses[RF_MAX_PIPES-1];  // Addresses of RX pipes 1..5
+static uint8_t numRxPipeAddresses = 0;
+static Hop_range_t hopRanges[MAX_HOP_RANGES];
+static uint8_t numHopRanges = 0;
+static Radio_config_t radioConfigs[RF_MAX_RADIOS-1]; // Channel & address of radios 1 and up
+static uint8_t numRadioConfigs = 0;
+static uint8_t surveyRatios[RF_NUM_CHANNELS];      // Hit ratios of the survey blocks received so far
+static int diversityComports[DIVERSITY_MAX_PORTS-1]; // Further sniffers to combine with the first
+static uint8_t numDiversityComports = 0;
+static DiversityCombiner combiner;
+static Discovery discovery;
+static AddressRecovery recovery;
+static_assert(SERIAL_MAXIMUM_PACKET_LENGTH - TIMESTAMP_LENGTH - PACKETS_LOST_LENGTH <= DIVERSITY_MAX_RECORD, "Combiner can't hold a frame");
+
+typedef struct _recordV2State
 {
-  uint8_t channel;
-  uint8_t rate;                        // rf24_datarate_e: 0 = 1Mb/s, 1 = 2Mb/s, 2 = 250Kb/s
-  uint8_t addressLen;                  // Number of bytes used in address, range [2..5]
-  uint8_t addressPromiscLen;           // Number of bytes used in promiscuous address, range [2..5]. E.g. addressLen=5, addressPromiscLen=4 => 1 byte unique identifier.
-  uint64_t address;                    // Base address, LSB first.
-  uint8_t crcLength;                   // Length of active CRC, range [0..2]
-  uint8_t maxPayloadSize;              // Maximum size of payload for nRF (including nRF header), range[4?..32]
-} serialConfig;
+  bool     synced;                     // Absolute timestamp received
+  uint32_t timestamp;                  // Timestamp of previous record
+  uint8_t  rxPipe;                     // RX pipe of the sniffer
+  uint8_t  channel;                    // RF channel of the sniffer
+  uint8_t  radio;                      // Radio of the sniffer
+  uint8_t  addressLen;
+  uint8_t  address[NRF_ADDRESS_LENGTH];
+} recordV2State;
+
+// Expand a RECORD_FORMAT_V2 record into the RECORD_FORMAT_V1 layout.
+// Returns length of the v1 record, or 0 when it can't be expanded.
+static DWORD expandRecordV2( const uint8_t* sp, const DWORD len, uint8_t* out, recordV2State& state )
+{
+  const uint8_t* end = sp + len;
+  const uint8_t flags = *sp++;
+
+  // Unsigned LEB128: 7 bits per byte, LSB first, bit 7 set when more bytes follow.
+  uint32_t ts = 0;
+  int shift = 0;
+  do
+  {
+    if ((sp >= end) || (shift > 28))
+      return 0;
+    ts |= (uint32_t)(*sp & 0x7F) << shift;
+    shift += 7;
+  } while (*sp++ & 0x80);
+
+  if (flags & RECORD_V2_FLAG_ABSTIME)
+  {
+    state.timestamp = ts;
+    state.synced = true;
+  }
+  else
+  {
+    state.timestamp += ts;
+  }
 
-static serialConfig config = { DEFAULT_RF_CHANNEL, DEFAULT_RF_DATARATE, DEFAULT_RF_ADDRESS_LEN, DEFAULT_RF_ADDRESS_PROMISC_LEN, DEFAULT_RF_BASE_ADDRESS, DEFAULT_RF_CRC_LEN, DEFAULT_RF_PAYLOAD_LEN };
-#pragma pack(pop)
+  uint8_t packetsLost = 0;
+  if (flags & RECORD_V2_FLAG_LOST)
+  {
+    if (sp >= end)
+      return 0;
+    packetsLost = *sp++;
+  }
+  if (flags & RECORD_V2_FLAG_PIPE)
+  {
+    if (sp >= end)
+      return 0;
+    state.rxPipe = *sp++;
+  }
+  if (flags & RECORD_V2_FLAG_CHANNEL)
+  {
+    if (sp >= end)
+      return 0;
+    state.channel = *sp++;
+  }
+  if (flags & RECORD_V2_FLAG_RADIO)
+  {
+    if (sp >= end)
+      return 0;
+    state.radio = *sp++;
+  }
+  if (flags & RECORD_V2_FLAG_ADDRESS)
+  {
+    if ((sp >= end) || (*sp > NRF_ADDRESS_LENGTH) || (sp + 1 + *sp > end))
+      return 0;
+    state.addressLen = *sp++;
+    (void)memcpy(state.address, sp, state.addressLen);
+    sp += state.addressLen;
+  }
+  // Records preceding the first resync can't be placed in time.
+  if (!state.synced || (sp >= end))
+    return 0;
+
+  const DWORD frameLen = (DWORD)(end - sp);
+  const DWORD outLen = TIMESTAMP_LENGTH + PACKETS_LOST_LENGTH + state.addressLen + frameLen;
+  if (outLen > SERIAL_MAXIMUM_PACKET_LENGTH)
+    return 0;
+  (void)putU32(out, state.timestamp);
+  out[TIMESTAMP_LENGTH] = packetsLost;
+  (void)memcpy(out + TIMESTAMP_LENGTH + PACKETS_LOST_LENGTH, state.address, state.addressLen);
+  (void)memcpy(out + TIMESTAMP_LENGTH + PACKETS_LOST_LENGTH + state.addressLen, sp, frameLen);
+  return outLen;
+}
+
+// Collects the bytes of a COBS framed stream up to the frame delimiter.
+struct frameState
+{
+  uint8_t frame[MAX_FRAME_SIZE];
+  uint8_t len;                          // Saturates at 0xFF, so an oversized frame fails to decode
+};
+
+// Add a received byte to the frame. Returns length of the unpacked lenAndType & message when the byte
+// completes a valid frame, 0 when the frame isn't complete, or -1 when it completes a corrupt frame.
+static int deframe( frameState& state, const uint8_t c, uint8_t* msg )
+{
+  if (c != FRAME_DELIMITER)
+  {
+    if (state.len < sizeof(state.frame))
+      state.frame[state.len] = c;
+    if (state.len < 0xFF)
+      ++state.len;
+    return 0;
+  }
+  const uint8_t len = state.len;
+  state.len = 0;
+  return len ? decodeFrame(state.frame, len, msg) : 0;
+}
+
+// Serial connection to a sniffer and the state of the stream it sends.
+typedef struct _snifferPort
+{
+  int             comport;
+  HANDLE          hComm;
+  Serial_config_t active;              // Config the sniffer echoed last
+  uint8_t         recordFormat;
+  recordV2State   v2State;
+  bool            framed;
+  frameState      frameRx;
+  uint8_t         buff[1024];
+  DWORD           buffIdx;
+} snifferPort;
+
+// Host time in us, on which the frames of several sniffers are combined.
+static uint64_t hostTime_us()
+{
+  static LARGE_INTEGER freq = { 0 };
+  if (freq.QuadPart == 0)
+    (void)QueryPerformanceFrequency(&freq);
+  LARGE_INTEGER now;
+  (void)QueryPerformanceCounter(&now);
+  return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000ULL + (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000ULL / freq.QuadPart;
+}
 
 static void spin( const bool run )
 {
@@ -111,6 +274,33 @@ static void spin( const bool run )
   }
 }
 
+// One line of the survey waterfall, one glyph per channel from quiet to always busy.
+// A channel ruler is printed above the first line.
+static void printSurvey( const uint8_t* ratios )
+{
+  static const char levels[] = " .:-=+*#%@";
+  static bool rulerPrinted = false;
+  if (!rulerPrinted)
+  {
+    printf("\r        ");
+    for (uint8_t ch = 0; ch < RF_NUM_CHANNELS; ++ch)
+      printf("%c", ch % 10 ? ' ' : '0' + (ch / 10) % 10);
+    printf("\n        ");
+    for (uint8_t ch = 0; ch < RF_NUM_CHANNELS; ++ch)
+      printf("%c", '0' + ch % 10);
+    printf("\n");
+    rulerPrinted = true;
+  }
+  printf("\rSurvey: ");
+  for (uint8_t ch = 0; ch < RF_NUM_CHANNELS; ++ch)
+  {
+    // Anything above zero gets at least the faintest glyph; an occasional burst matters.
+    const uint8_t level = ratios[ch] ? 1 + (ratios[ch] * (sizeof(levels) - 3)) / 255 : 0;
+    printf("%c", levels[level]);
+  }
+  printf("|\n");
+}
+
 static void printHex( uint8_t* p, const int len, const bool newline = true )
 {
   for (int i = 0; i < len; ++i)
@@ -121,82 +311,744 @@ static void printHex( uint8_t* p, const int len, const bool newline = true )
     printf("\n");
 }  
 
-static void printProgress( const uint32_t numCaptured, const uint32_t numLost )
+static void printProgress( const uint32_t numCaptured, const uint32_t numLost, const uint32_t numCorrupt, const Serial_stats_t* stats = NULL, const Filter_hits_t* hits = NULL )
 {
+  static Serial_stats_t lastStats = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  static uint32_t lastFiltered = 0;
+  if (stats)
+    lastStats = *stats;
+  if (hits)
+    lastFiltered = hits->filtered;
   printf("\rCaptured %lu packets, Lost %lu packets", numCaptured, numLost);
+  if (numCorrupt)
+    printf(", Corrupt %lu", numCorrupt);
+  if (lastFiltered)
+    printf(", Filtered %lu", (unsigned long)lastFiltered);
+  if (lastStats.bufferSize)
+  {
+    printf(", Buffer %lu%% (peak %lu%%), %lu B/s %lu rec/s  ",
+           (unsigned long)((100ULL * lastStats.bufferUsed) / lastStats.bufferSize),
+           (unsigned long)((100ULL * lastStats.bufferHighWater) / lastStats.bufferSize),
+           (unsigned long)lastStats.txBytesPerSec, (unsigned long)lastStats.txRecordsPerSec);
+    if (lastStats.txStalls)
+      printf(", TX stalls %lu  ", (unsigned long)lastStats.txStalls);
+    if (lastStats.packetsBadCrc)
+      printf(", Bad CRC %lu  ", (unsigned long)lastStats.packetsBadCrc);
+  }
 }
     
-void printConfig( const serialConfig& config)
+// Loss of every sniffer since the previous report, to tune their placement.
+static void printDiversity( const DiversityStats& stats, const snifferPort* ports, const uint8_t numPorts )
 {
-  printf("Channel:      %d\n", config.channel);
-  printf("Datarate:     %s\n", config.rate == 0 ? "1Mb/s" : config.rate == 1 ? "2Mb/s" : "250Kb/s" );
-  printf("Address:      0x");
-  uint64_t adr = config.address;
+  printf("\rCombined %lu frames, %lu without a valid copy", (unsigned long)stats.frames, (unsigned long)stats.framesBadCrc);
+  if (stats.dropped)
+    printf(", %lu copies dropped", (unsigned long)stats.dropped);
+  printf("                    \n");
+  for (uint8_t i = 0; i < numPorts; ++i)
+  {
+    const DiversityPortStats& port = stats.port[i];
+    printf("  COM%d: %lu heard, %lu CRC ok, missed %lu", ports[i].comport, (unsigned long)port.heard,
+           (unsigned long)port.crcOk, (unsigned long)port.missed);
+    if (stats.frames)
+      printf(" (%.1f%%)", port.missed * 100.0 / stats.frames);
+    printf(", only valid copy of %lu\n", (unsigned long)port.sole);
+  }
+}
+
+// Candidates for the address bytes in front of the configured ones, as the -a & -l to capture with.
+static void printRecovery( const Serial_config_t& config )
+{
+  Recovery_candidate_t results[RECOVERY_MAX_RESULTS];
+  const uint8_t numResults = recovery.run(results);
+  printf("\rAddress recovery over %u frames:                    \n", recovery.numFrames());
+  if (numResults == 0)
+    printf("  No address fits any frame\n");
+  const uint64_t address = config.address & ((1ULL << (8 * config.addressLen)) - 1);
+  for (uint8_t i = 0; i < numResults; ++i)
+  {
+    const Recovery_candidate_t& r = results[i];
+    const uint8_t len = config.addressLen + r.prefixLen;
+    printf("  -a0x%0*llx -l%d: %u frames (%.1f%%)%s\n", 2 * len, ((uint64_t)r.prefix << (8 * config.addressLen)) | address, len,
+           r.frames, r.frames * 100.0 / recovery.numFrames(), r.prefixLen ? "" : ", as configured");
+  }
+  if ((numResults > 1) && (results[0].frames == results[1].frames))
+    printf("  Undecided; more frames or a longer CRC may tell\n");
+}
+
+static const char* rateName( const uint8_t rate )
+{
+  return rate == 0 ? "1Mb/s" : rate == 1 ? "2Mb/s" : "250Kb/s";
+}
+
+static void printAddress( const Serial_config_t& config, const uint64_t adr )
+{
+  printf("0x");
   for (int8_t i = config.addressLen-1; i >= 0; --i)
   {
     if ( i >= config.addressLen - config.addressPromiscLen ) printf("%02x", (uint8_t)(adr >> (8*i)));
     else                                                     printf("**");
   }
   puts("");
+}
+
+void printConfig( const Serial_config_t& config)
+{
+  printf("Channel:      %d\n", config.channel);
+  for (uint8_t i = 0; i < numHopRanges; ++i)
+    printf("Hop:          %d-%d, %d ms each\n", hopRanges[i].firstChannel, hopRanges[i].lastChannel, hopRanges[i].dwellMs);
+  printf("Datarate:     %s\n", rateName(config.rate));
+  printf("Address:      ");
+  printAddress(config, config.address);
+  const uint8_t shift = 8 * (config.addressLen - config.addressPromiscLen);
+  for (uint8_t pipe = 1; pipe < RF_MAX_PIPES; ++pipe)
+  {
+    if (!(config.pipes & (1 << pipe)))
+      continue;
+    uint64_t adr = config.pipeAddress;
+    if (pipe >= 2)
+      adr = (adr & ~((uint64_t)0xFF << shift)) | ((uint64_t)config.pipeLsb[pipe-2] << shift);
+    printf("Pipe %d:       ", pipe);
+    printAddress(config, adr);
+  }
+  for (uint8_t i = 0; i < numRadioConfigs; ++i)
+  {
+    printf("Radio %d:      channel %d, ", i + 1, radioConfigs[i].channel);
+    printAddress(config, radioConfigs[i].address);
+  }
   printf("Max payload:  %d\n", config.maxPayloadSize);
   printf("CRC length:   %d\n", config.crcLength);
+  if (config.bufferSize)
+    printf("Buffer:       %d KiB\n", config.bufferSize);
+  printf("Framing:      %s\n", config.framing == FRAMING_COBS ? "COBS" : "None");
+  if (config.captureMode == CAPTURE_MODE_NODE_STATS)
+    printf("Mode:         Node statistics every %d ms\n", config.summaryInterval);
+  else if (config.captureMode == CAPTURE_MODE_SURVEY)
+    printf("Mode:         Band survey every %d ms\n", config.summaryInterval);
+  if (config.snapLen != SNAPLEN_ALL)
+    printf("Snap length:  %d payload bytes\n", config.snapLen);
+  printf("CRC check:    %s\n", config.crcCheck == CRC_CHECK_DROP ? "Drop" : config.crcCheck == CRC_CHECK_TAG ? "Tag" : "Off");
+}
+
+bool writeSerialConfig( HANDLE hComm, const Serial_config_t& config )
+{
+  DWORD numWritten;
+  uint8_t msg[1 + SERIAL_CONFIG_SIZE];
+  msg[0] = SET_MSG_TYPE( serializeConfig(config, msg + 1), MSG_TYPE_CONFIG );
+  return TRUE == WriteFile(hComm, (LPVOID)msg, sizeof(msg), &numWritten, NULL);
+}
+
+bool writeSerialControl( HANDLE hComm, const uint8_t control )
+{
+  DWORD numWritten;
+  uint8_t msg[] = { SET_MSG_TYPE( sizeof(control), MSG_TYPE_CONTROL ), control };
+  return TRUE == WriteFile(hComm, (LPVOID)msg, sizeof(msg), &numWritten, NULL);
+}
+
+// Parse up to FILTER_DATA_LEN bytes written as pairs of hex digits, e.g. "01ff".
+static uint8_t parseHexBytes( char* s, uint8_t* out, char** end )
+{
+  uint8_t n = 0;
+  while ((n < FILTER_DATA_LEN) && isxdigit((unsigned char)s[0]) && isxdigit((unsigned char)s[1]))
+  {
+    char hex[3] = { s[0], s[1], '\0' };
+    out[n++] = (uint8_t)strtoul(hex, NULL, 16);
+    s += 2;
+  }
+  *end = s;
+  return n;
+}
+
+// Parse a filter rule of comma separated terms, e.g. "node=0x05,len=1-8,pid=2,data@3=01ff/ffff,drop".
+// Terms left out match anything; without "drop" matching packets are captured.
+static bool parseFilterRule( char* s, Filter_rule_t& rule )
+{
+  (void)memset(&rule, 0, sizeof(rule));
+  rule.action = FILTER_ACTION_PASS;
+  rule.maxLen = MAX_MSG_LEN;          // Payload length is a 6-bit field
+  while (*s)
+  {
+    char* end;
+    if (strncmp(s, "node=", 5) == 0)
+    {
+      rule.node = strtoul(s + 5, &end, 0);
+      rule.nodeMask = 0xFFFFFFFFUL;
+      if (*end == '/')
+        rule.nodeMask = strtoul(end + 1, &end, 0);
+    }
+    else if (strncmp(s, "len=", 4) == 0)
+    {
+      rule.minLen = rule.maxLen = (uint8_t)strtoul(s + 4, &end, 10);
+      if (*end == '-')
+        rule.maxLen = (uint8_t)strtoul(end + 1, &end, 10);
+    }
+    else if (strncmp(s, "pid=", 4) == 0)
+    {
+      rule.pid = (uint8_t)strtoul(s + 4, &end, 0);
+      rule.pidMask = 0x03;
+    }
+    else if (strncmp(s, "data@", 5) == 0)
+    {
+      rule.dataOffset = (uint8_t)strtoul(s + 5, &end, 10);
+      if (*end != '=')
+        return false;
+      const uint8_t n = parseHexBytes(end + 1, rule.data, &end);
+      if (n == 0)
+        return false;
+      (void)memset(rule.dataMask, 0xFF, n);
+      if ((*end == '/') && (parseHexBytes(end + 1, rule.dataMask, &end) != n))
+        return false;
+    }
+    else if (strncmp(s, "drop", 4) == 0)
+    {
+      rule.action = FILTER_ACTION_DROP;
+      end = s + 4;
+    }
+    else
+    {
+      return false;
+    }
+    if (*end == ',')
+      ++end;
+    else if (*end)
+      return false;
+    s = end;
+  }
+  return rule.minLen <= rule.maxLen;
 }
 
-bool serialReadConfig( HANDLE hComm, serialConfig& config )
+// Parse a range of channels to hop through, e.g. "2-80:20": channels 2 up to 80, 20 ms each.
+static bool parseHopRange( char* s, Hop_range_t& range )
 {
-    // Use the ClearCommError function to get status info on the Serial port
-    // TODO: Use a timeout and return false when elapsed
+  char* end;
+  range.firstChannel = range.lastChannel = (uint8_t)strtoul(s, &end, 10);
+  if (end == s)
+    return false;
+  if (*end == '-')
+    range.lastChannel = (uint8_t)strtoul(end + 1, &end, 10);
+  range.dwellMs = DEFAULT_HOP_DWELL_MS;
+  if (*end == ':')
+    range.dwellMs = (uint16_t)strtoul(end + 1, &end, 10);
+  return (*end == 0) && (range.firstChannel <= range.lastChannel) && (range.lastChannel < RF_NUM_CHANNELS) && (range.dwellMs > 0);
+}
+
+// Parse the channel & address of a further radio, e.g. "76:0xA8A8E1FC00". Without an address, it gets
+// RADIO_ADDRESS_BASE; the base address may follow on the commandline.
+static bool parseRadioConfig( char* s, Radio_config_t& radio )
+{
+  char* end;
+  radio.channel = (uint8_t)strtoul(s, &end, 10);
+  if (end == s)
+    return false;
+  radio.address = RADIO_ADDRESS_BASE;
+  if (*end == ':')
+  {
+    radio.address = _strtoui64(end + 1, &end, 0);
+    if (radio.address > 0xFFFFFFFFFFULL)
+      return false;
+  }
+  return (*end == 0) && (radio.channel < RF_NUM_CHANNELS);
+}
+
+// Assign the addresses given on the commandline to RX pipes 1..5. The sniffer can only set the LSB
+// of the promiscuous address of pipes 2..5; their other promiscuous bytes must equal those of pipe 1.
+static bool setRxPipes( Serial_config_t& config )
+{
+  config.pipes = PIPES_DEFAULT;
+  if (numRxPipeAddresses == 0)
+    return true;
+  const uint8_t shift = 8 * (config.addressLen - config.addressPromiscLen);
+  config.pipeAddress = rxPipeAddresses[0];
+  config.pipes |= 1 << 1;
+  for (uint8_t i = 1; i < numRxPipeAddresses; ++i)
+  {
+    if ((rxPipeAddresses[i] >> (shift + 8)) != (config.pipeAddress >> (shift + 8)))
+      return false;
+    config.pipeLsb[i-1] = (uint8_t)(rxPipeAddresses[i] >> shift);
+    config.pipes |= 1 << (i + 1);
+  }
+  return true;
+}
+
+// Wait for a message of given type, skipping any other messages and corrupt frames.
+// Returns length of the message, or -1 on timeout.
+int serialReadMessage( HANDLE hComm, const uint8_t type, uint8_t* msg, const DWORD timeoutMs, const bool framed, const bool showProgress = false )
+{
+  const DWORD start = GetTickCount();
+  bool haveHeader = false;
+  uint8_t lenAndType = 0;
+  frameState frameRx = { { 0 }, 0 };
+  while (GetTickCount() - start < timeoutMs)
+  {
+    DWORD errors;
     COMSTAT stat;
-    uint8_t lenAndType;
-    while(1)
+    ClearCommError(hComm, &errors, &stat);
+    const DWORD needed = framed ? 1 : haveHeader ? GET_MSG_LEN(lenAndType) : sizeof(lenAndType);
+    if ((needed > 0) && (stat.cbInQue < needed))
+    {
+      if (showProgress)
+        spin( true );
+      Sleep(showProgress ? 200 : 10 /*ms*/);
+      continue;
+    }
+    DWORD numRead;
+    if (framed)
     {
-      DWORD errors;
-      spin( true );
-      ClearCommError(hComm, &errors, &stat);
-      if (stat.cbInQue >= sizeof(lenAndType) + sizeof(config))
+      uint8_t c;
+      uint8_t unpacked[1 + MAX_MSG_LEN];
+      if (!ReadFile(hComm, (LPVOID)&c, sizeof(c), &numRead, NULL))
         break;
-      Sleep(200 /*ms*/);
+      const int len = numRead ? deframe(frameRx, c, unpacked) : 0;
+      if ((len > 0) && (GET_MSG_TYPE(unpacked[0]) == type))
+      {
+        if (showProgress)
+          spin( false );
+        (void)memcpy(msg, unpacked + 1, len - 1);
+        return len - 1;
+      }
+      continue;
+    }
+    if (!haveHeader)
+    {
+      // Read header, then wait for rest of message
+      if (!ReadFile(hComm, (LPVOID)&lenAndType, sizeof(lenAndType), &numRead, NULL))
+        break;
+      haveHeader = true;
+      continue;
     }
+    if (needed && !ReadFile(hComm, (LPVOID)msg, needed, &numRead, NULL))
+      break;
+    if (GET_MSG_TYPE(lenAndType) == type)
+    {
+      if (showProgress)
+        spin( false );
+      return (int)needed;
+    }
+    haveHeader = false;
+  }
+  if (showProgress)
     spin( false );
+  return -1;
+}
 
-    DWORD numRead;
-    bool ok = true;
-    ok &= TRUE == ReadFile(hComm, (LPVOID)&lenAndType, sizeof(lenAndType), &numRead, NULL);
-    ok &= TRUE == ReadFile(hComm, (LPVOID)&config, sizeof(config), &numRead, NULL);
-    ok &= GET_MSG_TYPE(lenAndType) == MSG_TYPE_CONFIG;
-    ok &= GET_MSG_LEN(lenAndType) == sizeof(config);
-    return ok;
+// Wait for the sniffer to send its config. Returns false on timeout or when the sniffer
+// speaks another protocol version.
+bool serialReadConfig( HANDLE hComm, Serial_config_t& config, const DWORD timeoutMs, const bool framed, const bool showProgress = false )
+{
+  uint8_t msg[MAX_MSG_LEN];
+  const int len = serialReadMessage(hComm, MSG_TYPE_CONFIG, msg, timeoutMs, framed, showProgress);
+  if (len < 0)
+    return false;
+  if (!deserializeConfig(msg, (uint8_t)len, config))
+  {
+    printf("\nSniffer uses protocol version %d, expected %d\n", len > 0 ? msg[0] : 0, SNIFF_PROTOCOL_VERSION);
+    return false;
+  }
+  return true;
+}
+
+// Replace the filter table of the sniffer by ours. Returns false when the sniffer didn't accept all rules.
+static bool writeSerialFilter( HANDLE hComm, const bool framed )
+{
+  if (!writeSerialControl(hComm, CONTROL_FILTER_CLEAR))
+    return false;
+  for (uint8_t i = 0; i < numFilters; ++i)
+  {
+    DWORD numWritten;
+    uint8_t msg[2 + FILTER_RULE_SIZE];
+    msg[0] = SET_MSG_TYPE( 1 + FILTER_RULE_SIZE, MSG_TYPE_CONTROL );
+    msg[1] = CONTROL_FILTER_ADD;
+    (void)serializeFilterRule(filters[i], msg + 2);
+    if (!WriteFile(hComm, (LPVOID)msg, sizeof(msg), &numWritten, NULL))
+      return false;
+  }
+  // Sniffer answers every change with the resulting table size; the last one covers all rules.
+  Filter_hits_t hits = {};
+  for (uint8_t i = 0; i <= numFilters; ++i)
+  {
+    uint8_t msg[MAX_MSG_LEN];
+    const int len = serialReadMessage(hComm, MSG_TYPE_CONTROL, msg, CONFIG_TIMEOUT_MS, framed);
+    if ((len < 1) || (msg[0] != CONTROL_FILTER_HITS) || !deserializeFilterHits(msg + 1, (uint8_t)(len - 1), hits))
+      return false;
+  }
+  return hits.numRules == numFilters;
+}
+
+// Send the channels to hop through. Returns false when the sniffer didn't take all of them.
+static bool writeSerialHops( HANDLE hComm, const Hop_range_t* ranges, const uint8_t numRanges, const bool framed )
+{
+  if (!writeSerialControl(hComm, CONTROL_HOP_CLEAR))
+    return false;
+  uint16_t numChannels = 0;
+  for (uint8_t i = 0; i < numRanges; ++i)
+  {
+    DWORD numWritten;
+    uint8_t msg[2 + HOP_RANGE_SIZE];
+    msg[0] = SET_MSG_TYPE( 1 + HOP_RANGE_SIZE, MSG_TYPE_CONTROL );
+    msg[1] = CONTROL_HOP_ADD;
+    (void)serializeHopRange(ranges[i], msg + 2);
+    if (!WriteFile(hComm, (LPVOID)msg, sizeof(msg), &numWritten, NULL))
+      return false;
+    numChannels += ranges[i].lastChannel - ranges[i].firstChannel + 1;
+  }
+  // Sniffer answers every change with the resulting table size; the last one covers all ranges.
+  uint8_t tableSize = 0;
+  for (uint16_t i = 0; i <= numRanges; ++i)
+  {
+    uint8_t msg[MAX_MSG_LEN];
+    const int len = serialReadMessage(hComm, MSG_TYPE_CONTROL, msg, CONFIG_TIMEOUT_MS, framed);
+    if ((len != 2) || (msg[0] != CONTROL_HOP_TABLE))
+      return false;
+    tableSize = msg[1];
+  }
+  return tableSize == numChannels;
 }
 
-bool writeSerialConfig( HANDLE hComm, const serialConfig& config )
+// Start the further radios. Returns false when the sniffer didn't start all of them.
+static bool writeSerialRadios( HANDLE hComm, const bool framed )
 {
+  if (!writeSerialControl(hComm, CONTROL_RADIO_CLEAR))
+    return false;
+  for (uint8_t i = 0; i < numRadioConfigs; ++i)
+  {
+    DWORD numWritten;
+    uint8_t msg[2 + RADIO_CONFIG_SIZE];
+    msg[0] = SET_MSG_TYPE( 1 + RADIO_CONFIG_SIZE, MSG_TYPE_CONTROL );
+    msg[1] = CONTROL_RADIO_ADD;
+    (void)serializeRadioConfig(radioConfigs[i], msg + 2);
+    if (!WriteFile(hComm, (LPVOID)msg, sizeof(msg), &numWritten, NULL))
+      return false;
+  }
+  // Sniffer answers every change with the radios capturing; the last one covers all radios.
+  uint8_t numActive = 0;
+  uint8_t numFitted = 0;
+  for (uint8_t i = 0; i <= numRadioConfigs; ++i)
+  {
+    uint8_t msg[MAX_MSG_LEN];
+    const int len = serialReadMessage(hComm, MSG_TYPE_CONTROL, msg, CONFIG_TIMEOUT_MS, framed);
+    if ((len != 3) || (msg[0] != CONTROL_RADIO_TABLE))
+      return false;
+    numActive = msg[1];
+    numFitted = msg[2];
+  }
+  if (numRadioConfigs)
+    printf("Radios: %d of %d fitted capturing\n", numActive, numFitted);
+  return numActive == 1 + numRadioConfigs;
+}
+
+static bool setBaudrate( HANDLE hComm, const DWORD baudrate )
+{
+  DCB dcbSerialParams;
+  if (!GetCommState(hComm, &dcbSerialParams))
+    return false;
+  dcbSerialParams.BaudRate = baudrate;
+  return TRUE == SetCommState(hComm, &dcbSerialParams);
+}
+
+// Sniffer echoes the config with the baudrate it accepted and switches over. It then waits for
+// our confirmation at the new baudrate, and falls back to the old one when none arrives.
+static bool switchBaudrate( HANDLE hComm, const DWORD oldBaudrate, const Serial_config_t& echo )
+{
+  const DWORD newBaudrate = echo.baudrate;
+  if (!setBaudrate(hComm, newBaudrate))
+    return false;
+  (void)PurgeComm(hComm, PURGE_RXCLEAR);
+  Serial_config_t ack;
+  if (   writeSerialControl(hComm, CONTROL_BAUD_CONFIRM)
+      && serialReadConfig(hComm, ack, BAUD_CONFIRM_TIMEOUT_MS, echo.framing == FRAMING_COBS))
+  {
+    return true;
+  }
+  (void)setBaudrate(hComm, oldBaudrate);
+  return false;
+}
+
+// Open the serial port of a sniffer and hand it our config, filter, channels & radios.
+// Returns false, having told why, when the sniffer can't be set up.
+static bool openSniffer( snifferPort& port, const DWORD baudrate )
+{
+  char portName[100];
+  _snprintf_s(portName, sizeof(portName), _TRUNCATE, "\\\\.\\COM%d", port.comport);   // See http://support.microsoft.com/default.aspx?scid=kb;EN-US;q115831
+  port.hComm = CreateFile( portName,  
+                           GENERIC_READ | GENERIC_WRITE, 
+                           0, 
+                           0, 
+                           OPEN_EXISTING,
+                           0,
+                           0);
+  HANDLE hComm = port.hComm;
+  if (hComm == INVALID_HANDLE_VALUE)
+  {
+    printf("Error!\n", portName);
+    if(GetLastError() == ERROR_FILE_NOT_FOUND)
+    {
+      printf("Port %s not available.\n", portName);
+    }
+    return false;
+  }
+  // set the comm parameters
+  DCB dcbSerialParams;
+
+  // get the current comm parameters
+  if (!GetCommState(hComm, &dcbSerialParams))
+  {
+    puts("Failed to get current serial parameters!");
+    return false;
+  }
+
+  // Set serial port parameters.
+  dcbSerialParams.BaudRate = baudrate;
+  dcbSerialParams.ByteSize = 8;
+  dcbSerialParams.StopBits = ONESTOPBIT;
+  dcbSerialParams.Parity   = NOPARITY;
+  if(!SetCommState(hComm, &dcbSerialParams))
+  {
+    puts("ALERT: Could not set Serial Port parameters");
+    return false;
+  }
+
+  // Purge serial buffer
+  (void)PurgeComm(hComm, PURGE_RXCLEAR | PURGE_TXCLEAR);
+
+  // Handshake in one round trip: a running sniffer answers our config with its active config.
+  Serial_config_t& active = port.active;
+  // The echo already uses the framing we ask for.
+  const bool echoFramed = config.framing == FRAMING_COBS;
+  if (!(writeSerialConfig( hComm, config ) && serialReadConfig( hComm, active, CONFIG_TIMEOUT_MS, echoFramed )))
+  {
+    // No answer; sniffer might be hanging or still booting. Reset it and wait for
+    // the config it sends on startup, then send our configuration again.
+    if (!(    EscapeCommFunction(hComm,CLRDTR) && EscapeCommFunction(hComm,CLRRTS)
+           && EscapeCommFunction(hComm,SETDTR) && EscapeCommFunction(hComm,SETRTS) ))
+    {
+      puts("\nALERT: Failed to reset sniffer");
+      return false;
+    }
+    (void)PurgeComm(hComm, PURGE_RXCLEAR | PURGE_TXCLEAR);
+
+    printf("Wait for sniffer to restart  ");
+    if (!serialReadConfig( hComm, active, RESTART_TIMEOUT_MS, false, true ))
+    {
+      puts("\nALERT: Failed waiting for sniffer to restart");
+      return false;
+    }
+    puts("Ok");
+    if (!(writeSerialConfig( hComm, config ) && serialReadConfig( hComm, active, CONFIG_TIMEOUT_MS, echoFramed )))
+    {
+      puts("ALERT: Could not send config");
+      return false;
+    }
+  }
+  puts("");
+
+  // When we asked for a different baudrate, follow the sniffer now it has echoed the config.
+  if (config.baudrate && (config.baudrate != baudrate))
+  {
+    printf("Switching to %lu baud... ", (unsigned long)config.baudrate);
+    puts((active.baudrate == config.baudrate) && switchBaudrate(hComm, baudrate, active) ? "Ok" : "Failed, staying at initial baudrate");
+  }
+
+  // Always send the filter, so none is left over from an earlier session.
+  if (!writeSerialFilter(hComm, active.framing == FRAMING_COBS))
+  {
+    puts("ALERT: Sniffer did not accept the filter");
+    return false;
+  }
+  if (numFilters)
+    printf("Filter: %d rule(s) active\n", numFilters);
+  if (!writeSerialHops(hComm, hopRanges, numHopRanges, active.framing == FRAMING_COBS))
+  {
+    puts("ALERT: Sniffer did not accept the channels to hop through");
+    return false;
+  }
+  if (!writeSerialRadios(hComm, active.framing == FRAMING_COBS))
+  {
+    puts("ALERT: Sniffer did not start all radios");
+    return false;
+  }
+
+  // Sniffer echoes the config for every change; record format is updated from it.
+  port.recordFormat = active.recordFormat;
+  (void)memset(&port.v2State, 0, sizeof(port.v2State));
+  port.framed = active.framing == FRAMING_COBS;
+  port.frameRx.len = 0;
+
+  // Flush buffer
+  (void)memset(port.buff, 0, sizeof(port.buff));
+  port.buffIdx = 0;
+  return true;
+}
+
+// Look for the channel, data rate & address length with the highest rate of frames with a valid CRC, among
+// the channels to hop through or all of them, and take those into config; the capture then stays on that
+// channel. Returns false, having told why, when the sniffer can't be set up. When no frame with a valid
+// CRC turned up, config is left as it was.
+static bool discover( snifferPort& port, const DWORD baudrate, const uint16_t dwellMs )
+{
+  // The sniffer counts the frames with a valid CRC per channel when hopping; nothing else is needed.
+  const Serial_config_t user = config;
+  config.captureMode = CAPTURE_MODE_NODE_STATS;
+  config.summaryInterval = 0xFFFF;
+  config.crcCheck = CRC_CHECK_TAG;
+  config.pipes = PIPES_DEFAULT;
+  bool ok = openSniffer(port, baudrate);
+
+  uint8_t channels[RF_NUM_CHANNELS];
+  uint8_t numChannels = 0;
+  for (uint8_t i = 0; i < numHopRanges; ++i)
+  {
+    for (uint16_t ch = hopRanges[i].firstChannel; (ch <= hopRanges[i].lastChannel) && (numChannels < RF_NUM_CHANNELS); ++ch)
+      channels[numChannels++] = (uint8_t)ch;
+  }
+  if (numHopRanges == 0)
+  {
+    for (uint8_t ch = 0; ch < RF_NUM_CHANNELS; ++ch)
+      channels[numChannels++] = ch;
+  }
+  discovery.begin(channels, numChannels, config.addressPromiscLen, dwellMs);
+
+  Discovery_pass_t pass;
+  while (ok && discovery.nextPass(pass))
+  {
+    printf("\rDiscovery round %d: %s, address length %d, %d channel(s) of %d ms          ", discovery.round() + 1,
+           rateName(pass.rate), pass.addressLen, pass.numChannels, pass.dwellMs);
+    // Every run of adjacent channels makes a hop range.
+    Hop_range_t ranges[RF_NUM_CHANNELS];
+    uint8_t numRanges = 0;
+    for (uint8_t i = 0; i < pass.numChannels; ++i)
+    {
+      if (numRanges && (ranges[numRanges-1].lastChannel + 1 == pass.channels[i]))
+      {
+        ranges[numRanges-1].lastChannel = pass.channels[i];
+        continue;
+      }
+      Hop_range_t& range = ranges[numRanges++];
+      range.firstChannel = range.lastChannel = pass.channels[i];
+      range.dwellMs = pass.dwellMs;
+    }
+    config.rate = pass.rate;
+    config.addressLen = pass.addressLen;
+    Serial_config_t echo;
+    ok =    writeSerialConfig(port.hComm, config) && serialReadConfig(port.hComm, echo, CONFIG_TIMEOUT_MS, port.framed)
+         && writeSerialHops(port.hComm, ranges, numRanges, port.framed);
+    if (!ok)
+    {
+      puts("\nALERT: Sniffer did not take the discovery settings");
+      break;
+    }
+    // With the CRC check off, the sniffer counts every frame as valid; noise would score.
+    if (echo.crcCheck == CRC_CHECK_OFF)
+    {
+      ok = false;
+      puts("\nALERT: Sniffer does not check CRCs with these settings; discovery needs it to");
+      break;
+    }
+    // The new hop table starts with its counters reset. Collect its statistics until the sniffer
+    // has been through it at least once.
+    const DWORD passMs = pass.numChannels * pass.dwellMs + DISCOVERY_STATS_WAIT_MS;
+    const DWORD start = GetTickCount();
+    DWORD elapsed;
+    while ((elapsed = GetTickCount() - start) < passMs)
+    {
+      uint8_t msg[MAX_MSG_LEN];
+      const int len = serialReadMessage(port.hComm, MSG_TYPE_CONTROL, msg, passMs - elapsed, port.framed);
+      Channel_stats_t stats;
+      if ((len >= 1) && (msg[0] == CONTROL_CHANNEL_STATS) && deserializeChannelStats(msg + 1, (uint8_t)(len - 1), stats))
+        discovery.add(stats);
+    }
+  }
+  CloseHandle(port.hComm);
+  port.hComm = INVALID_HANDLE_VALUE;
+
+  config = user;
+  Discovery_candidate_t best;
+  if (ok && discovery.best(best))
+  {
+    config.channel = best.channel;
+    config.rate = best.rate;
+    config.addressLen = best.addressLen;
+    numHopRanges = 0;
+    printf("\rDiscovered channel %d, %s, address length %d: %lu of %lu frames with a valid CRC in %lu ms%s\n",
+           best.channel, rateName(best.rate), best.addressLen, (unsigned long)best.packetsCrcOk, (unsigned long)best.packets,
+           (unsigned long)best.listenMs, discovery.decided() ? "" : ", no clear winner");
+    // Pipe addresses depend on the address length.
+    if (!setRxPipes(config))
+    {
+      puts("RX pipe addresses don't suit the address length found; pipe 0 only");
+      config.pipes = PIPES_DEFAULT;
+    }
+  }
+  else if (ok)
+  {
+    puts("\rDiscovery found no frames with a valid CRC; keeping the configured channel, data rate & address length");
+  }
+  return ok;
+}
+
+// Pass a frame to Wireshark: meta is the pseudo header, or NULL when Wireshark expects none. frame holds the
+// address & NRF24 frame of a record; the pcap packet runs a byte past them, so it must hold lenFrame+1 bytes.
+// Returns false when the pipe is gone.
+static bool writePcapPacket( HANDLE hPipe, const uint64_t timestamp_us, const uint8_t* meta, const uint8_t* frame, const DWORD lenFrame, const uint8_t crcLength )
+{
+  uint8_t pcapPacket[PCAP_MAXIMUM_PACKET_LENGTH+1];
+  uint8_t* pp = pcapPacket;
+  DWORD lenMeta = 0;
+  if (meta)
+  {
+    lenMeta = NRF24_META_LENGTH;
+    (void)memcpy(pp, meta, lenMeta);
+    pp += lenMeta;
+  }
+
+  // PCap packet will contain everything from serial packet, except timestamp
+  DWORD lenPCapPacket = PACKETS_LOST_LENGTH + lenFrame;
+
+  // Copy data 1:1 from serial packet, not byte aligned.
+  (void)memcpy(pp, frame, lenPCapPacket);
+  // For last byte only the MSbit has value; rest will be cleared
+  *(pp+lenPCapPacket-1) &= 0x80;
+
+  // Create packet header
+  assert(sizeof(pcaprec_hdr) == 16);
+  // Frame might be truncated by snap length or max payload size; its control field tells the original length.
+  const DWORD payloadLen = pp[NRF_ADDRESS_LENGTH] >> 2;
+  const DWORD origLen = lenMeta + PACKETS_LOST_LENGTH + NRF_ADDRESS_LENGTH
+                        + BITS_TO_BYTES(NRF_CONTROL_LENGTH_BITS + BYTES_TO_BITS(payloadLen + crcLength));
+  lenPCapPacket += lenMeta;
+  pcaprec_hdr hdr = { (uint32_t)(timestamp_us/1000000), (uint32_t)(timestamp_us%1000000), lenPCapPacket, max(origLen, lenPCapPacket) };
+
+  // Write record header & data
   DWORD numWritten;
-  uint8_t lenAndType = SET_MSG_TYPE( sizeof(config), MSG_TYPE_CONFIG );
-  return    WriteFile(hComm, (LPVOID)&lenAndType, sizeof(lenAndType), &numWritten, NULL)
-         && WriteFile(hComm, (LPVOID)&config, sizeof(config), &numWritten, NULL);
+  return    WriteFile(hPipe, &hdr, sizeof(hdr), &numWritten, NULL)
+         && WriteFile(hPipe, &pcapPacket, lenPCapPacket, &numWritten, NULL);
 }
 
 int _tmain(int argc, _TCHAR* argv[])
 {
   const char* pipeName = "\\\\.\\pipe\\wireshark";     // \\.\pipe\wireshark
-  uint8_t buff[1024];
-  DWORD buffIdx;
   uint64_t timestamp_us;
   uint32_t prevSerTimestamp_us;
+  uint64_t combinedStart_us = 0ULL;
   bool firstPacket;
   HANDLE hPipe = INVALID_HANDLE_VALUE;
-  HANDLE hComm = INVALID_HANDLE_VALUE;
+  snifferPort ports[DIVERSITY_MAX_PORTS];
+  uint8_t numPorts = 0;
+  bool discoverFirst = false;
+  uint16_t discoverDwellMs = DISCOVERY_DEFAULT_DWELL_MS;
+  uint16_t recoverFrames = 0;
+  uint16_t recoveryReportAt = 0;
   bool printHelp = false;
   DWORD baudrate = DEFAULT_BAUDRATE;
   int comport = DEFAULT_COMPORT;
   uint32_t numCaptured;
   uint32_t numLost;
+  uint32_t numCorrupt;
   bool verbose = false;
   uint8_t lenAndType;
+  DWORD lastReportMs;
 
   /* Parse commandline arguments */
   int c;
-  while (!printHelp && ((c = getopt(argc, argv, _T("b:P:c:r:l:p:a:C:m:vh"))) != EOF))
+  while (!printHelp && ((c = getopt(argc, argv, _T("b:s:P:D:c:H:X:R:r:l:p:a:A:U:C:m:B:f:F:N:k:t:S:n:vh"))) != EOF))
   {
     switch (c)
     {
@@ -208,6 +1060,15 @@ int _tmain(int argc, _TCHAR* argv[])
           printHelp = (baudrate == 0) || (errno == ERANGE);
         }
         break;
+      case _T('s'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long b = strtol(optarg, NULL, 10);
+          printHelp = (b < 0) || (errno == ERANGE);
+          config.baudrate = (uint32_t)b;
+        }
+        break;
       case _T('P'):
         printHelp = !optarg;
         if (optarg)
@@ -216,6 +1077,15 @@ int _tmain(int argc, _TCHAR* argv[])
           printHelp = ((comport == 0) && (optarg[0] != '0')) || (errno == ERANGE);
         }
         break;
+      case _T('D'):
+        printHelp = !optarg || (numDiversityComports >= DIVERSITY_MAX_PORTS-1);
+        if (!printHelp)
+        {
+          diversityComports[numDiversityComports] = strtol(optarg, NULL, 10);
+          printHelp = ((diversityComports[numDiversityComports] == 0) && (optarg[0] != '0')) || (errno == ERANGE);
+          numDiversityComports++;
+        }
+        break;
       case _T('c'):
         printHelp = !optarg;
         if (optarg)
@@ -225,6 +1095,33 @@ int _tmain(int argc, _TCHAR* argv[])
           config.channel = (uint8_t)ch;
         }
         break;
+      case _T('H'):
+        printHelp = !optarg || (numHopRanges >= MAX_HOP_RANGES);
+        if (!printHelp)
+        {
+          printHelp = !parseHopRange(optarg, hopRanges[numHopRanges]);
+          numHopRanges++;
+        }
+        break;
+      case _T('X'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long d = strtol(optarg, NULL, 10);
+          printHelp = (d < 0) || (d > 65535) || (errno == ERANGE);
+          discoverFirst = true;
+          if (d)
+            discoverDwellMs = (uint16_t)d;
+        }
+        break;
+      case _T('R'):
+        printHelp = !optarg || (numRadioConfigs >= RF_MAX_RADIOS-1);
+        if (!printHelp)
+        {
+          printHelp = !parseRadioConfig(optarg, radioConfigs[numRadioConfigs]);
+          numRadioConfigs++;
+        }
+        break;
       case _T('r'):
         printHelp = !optarg;
         if (optarg)
@@ -260,6 +1157,24 @@ int _tmain(int argc, _TCHAR* argv[])
           printHelp = (config.address < 0) || (config.address > 0xFFFFFFFFFFULL) || (errno == ERANGE);
         }
         break;
+      case _T('A'):
+        printHelp = !optarg || (numRxPipeAddresses >= RF_MAX_PIPES-1);
+        if (!printHelp)
+        {
+          rxPipeAddresses[numRxPipeAddresses] = _strtoui64(optarg, NULL, 0);
+          printHelp = (rxPipeAddresses[numRxPipeAddresses] > 0xFFFFFFFFFFULL) || (errno == ERANGE);
+          numRxPipeAddresses++;
+        }
+        break;
+      case _T('U'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long u = strtol(optarg, NULL, 10);
+          printHelp = (u < 0) || (u > RECOVERY_MAX_FRAMES) || (errno == ERANGE);
+          recoverFrames = u ? (uint16_t)u : RECOVERY_MAX_FRAMES;
+        }
+        break;
       case _T('C'):
         printHelp = !optarg;
         if (optarg)
@@ -278,6 +1193,79 @@ int _tmain(int argc, _TCHAR* argv[])
           config.maxPayloadSize = (uint8_t)s;
         }
         break;
+      case _T('B'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long s = strtol(optarg, NULL, 10);
+          printHelp = (s < 0) || (s > 65535) || (errno == ERANGE);
+          config.bufferSize = (uint16_t)s;
+        }
+        break;
+      case _T('f'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long f = strtol(optarg, NULL, 10);
+          printHelp = (f < RECORD_FORMAT_V1) || (f > RECORD_FORMAT_V2) || (errno == ERANGE);
+          config.recordFormat = (uint8_t)f;
+        }
+        break;
+      case _T('F'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long f = strtol(optarg, NULL, 10);
+          printHelp = (f < FRAMING_NONE) || (f > FRAMING_COBS) || (errno == ERANGE);
+          config.framing = (uint8_t)f;
+        }
+        break;
+      case _T('k'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long k = strtol(optarg, NULL, 10);
+          printHelp = (k < CRC_CHECK_OFF) || (k > CRC_CHECK_DROP) || (errno == ERANGE);
+          config.crcCheck = (uint8_t)k;
+        }
+        break;
+      case _T('t'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long t = strtol(optarg, NULL, 10);
+          printHelp = (t < 0) || (t > 65535) || (errno == ERANGE);
+          config.captureMode = t ? CAPTURE_MODE_NODE_STATS : CAPTURE_MODE_PACKETS;
+          config.summaryInterval = (uint16_t)t;
+        }
+        break;
+      case _T('S'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long t = strtol(optarg, NULL, 10);
+          printHelp = (t < 0) || (t > 65535) || (errno == ERANGE);
+          config.captureMode = CAPTURE_MODE_SURVEY;
+          config.summaryInterval = (uint16_t)t;
+        }
+        break;
+      case _T('n'):
+        printHelp = !optarg;
+        if (optarg)
+        {
+          long n = strtol(optarg, NULL, 10);
+          printHelp = (n < 0) || (n > NRF_MAX_PAYLOAD_LENGTH) || (errno == ERANGE);
+          config.snapLen = (uint8_t)n;
+        }
+        break;
+      case _T('N'):
+        printHelp = !optarg || (numFilters >= MAX_FILTER_RULES);
+        if (!printHelp)
+        {
+          printHelp = !parseFilterRule(optarg, filters[numFilters]);
+          numFilters++;
+        }
+        break;
       case _T('v'):
         verbose = true;
         break;
@@ -289,6 +1277,34 @@ int _tmain(int argc, _TCHAR* argv[])
         break;
     }
   }
+  // Pipe addresses depend on the address lengths, which may follow them on the commandline.
+  if (!printHelp)
+    printHelp = !setRxPipes(config);
+  for (uint8_t i = 0; i < numRadioConfigs; ++i)
+  {
+    if (radioConfigs[i].address == RADIO_ADDRESS_BASE)
+      radioConfigs[i].address = config.address;
+  }
+  // Only v2 records tell which radio heard a frame.
+  if (numRadioConfigs)
+    config.recordFormat = RECORD_FORMAT_V2;
+  // Discovery tells the right settings by their frames with a valid CRC.
+  if (discoverFirst && (config.crcLength == 0))
+    printHelp = true;
+  // Recovery tries the addresses on the CRC of whole frames, including those the configured address fails.
+  if (recoverFrames)
+  {
+    printHelp =    printHelp || (config.captureMode != CAPTURE_MODE_PACKETS) || (config.crcLength == 0)
+                || (config.crcCheck == CRC_CHECK_DROP) || (config.snapLen != SNAPLEN_ALL);
+  }
+  // Combining needs the sniffers to tag the frames they heard corrupted, and to stay on one channel together.
+  if (numDiversityComports)
+  {
+    printHelp = printHelp || numHopRanges || (config.captureMode != CAPTURE_MODE_PACKETS);
+    config.recordFormat = RECORD_FORMAT_V2;
+    if (config.crcCheck == CRC_CHECK_OFF)
+      config.crcCheck = CRC_CHECK_TAG;
+  }
     
   if (printHelp)
   {
@@ -302,29 +1318,70 @@ int _tmain(int argc, _TCHAR* argv[])
     printf("\n");
     printf("Where [OPTION] can be one or more options of:\n");
     printf(" -b    Set baudrate. Default -b%d\n", DEFAULT_BAUDRATE);
+    printf(" -s    Switch to this baudrate after handshake, e.g. 921600, 2000000. Default -s%d (don't switch)\n", DEFAULT_SWITCH_BAUDRATE);
     printf(" -P    Set comport. Default -P%d (for COM%d)\n", DEFAULT_COMPORT, DEFAULT_COMPORT);
+    printf(" -D    Set comport of a further sniffer on the same channel; the frames of all sniffers are combined into one\n");
+    printf("       stream with a valid copy of each when any sniffer heard one. Up to %d. Implies -f2 and -k1 unless -k2.\n", DIVERSITY_MAX_PORTS-1);
+    printf("       Not with -H, -t or -S. Default none, one sniffer\n");
     printf(" -c    RF channel, range [0..127]. Default -c%d\n", DEFAULT_RF_CHANNEL);
+    printf(" -H    Hop through channels <first>[-<last>][:<dwell ms>], range [0..%d]; up to %d ranges, together at most %d channels.\n", RF_NUM_CHANNELS-1, MAX_HOP_RANGES, MAX_HOP_CHANNELS);
+    printf("       E.g. -H0-125:20 sweeps the band. Default dwell %d ms. Default none, stay on -c\n", DEFAULT_HOP_DWELL_MS);
+    printf(" -X    Discover channel, data rate & address length first; listen <n> ms per channel at first, 0 = %d ms.\n", DISCOVERY_DEFAULT_DWELL_MS);
+    printf("       Searches the channels of -H, or all, and captures on the busiest one. Needs the promiscuous bytes of -a\n");
+    printf("       and a CRC (-C1 or -C2). Default off\n");
+    printf(" -R    Capture with a further radio of the sniffer on <channel>[:<address>], address as -a, pipe 0 only;\n");
+    printf("       up to %d. Implies -f2. Default none, first radio only\n", RF_MAX_RADIOS-1);
     printf(" -r    Data rate, range [0..2], where 0=1Mb/s, 1=2Mb/b, 2=250Kb/s. Default -r%d\n", DEFAULT_RF_DATARATE);
     printf(" -l    Address length in bytes, range [3..5]. Default -l%d\n", DEFAULT_RF_ADDRESS_LEN);
     printf(" -p    Promiscuous address length in bytes, range [3..5]. Default -p%d\n", DEFAULT_RF_ADDRESS_PROMISC_LEN);
     printf(" -a    Base address. Default -a0x%05llx\n", DEFAULT_RF_BASE_ADDRESS);
+    printf(" -A    Base address of the next RX pipe [1..%d]; pipes 2 and up may only differ from pipe 1\n", RF_MAX_PIPES-1);
+    printf("       in the lowest byte of the promiscuous address. Default none, pipe 0 only\n");
+    printf(" -U    Recover the address bytes sent in front of the -l bytes of -a from the CRC of <n> frames, range [0..%d],\n", RECOVERY_MAX_FRAMES);
+    printf("       0 = %d. Reports the best fitting addresses along the way. Needs -C1 or -C2; not with -k2, -n, -t or -S.\n", RECOVERY_MAX_FRAMES);
+    printf("       Default off\n");
     printf(" -C    CRC length in bytes, range [0..2]. Default -C%d\n", DEFAULT_RF_CRC_LEN);
     printf(" -m    Maximum payload size in bytes, range [0..32]. Default -m%d\n", DEFAULT_RF_PAYLOAD_LEN);
+    printf(" -B    Capture buffer size on sniffer in KiB, range [0..65535], 0 = sniffer default. Default -B%d\n", DEFAULT_BUFFER_SIZE);
+    printf(" -f    Serial record format, range [1..2], where 2=compact. Default -f%d\n", DEFAULT_RECORD_FORMAT);
+    printf(" -F    Serial framing, range [0..1], where 1=COBS with CRC. Default -F%d\n", DEFAULT_FRAMING);
+    printf(" -k    CRC check on sniffer, range [0..2], where 0=off, 1=tag invalid frames (-f2 only), 2=drop invalid frames. Default -k%d\n", DEFAULT_CRC_CHECK);
+    printf(" -t    Node statistics only, summarized every <n> ms, range [0..65535]; no Wireshark needed. Default -t%d (capture packets)\n", DEFAULT_SUMMARY_INTERVAL);
+    printf(" -S    Band survey only; sweep all channels for received power, one line every <n> ms, range [0..65535],\n");
+    printf("       where 0 = sniffer default. No Wireshark needed. Default off\n");
+    printf(" -n    Snap length; payload bytes captured per packet, range [0..%d], where 0=header only. Default all\n", NRF_MAX_PAYLOAD_LENGTH);
+    printf(" -N    Filter rule on the sniffer; up to %d, first match decides. Comma separated terms of:\n", MAX_FILTER_RULES);
+    printf("       node=<n>[/<mask>], len=<min>[-<max>], pid=<n>, data@<offset>=<hex>[/<hexmask>], drop\n");
+    printf("       E.g. -Nnode=0x05,len=1-8 -Ndata@0=ff,drop. Default none, capture all\n");
     printf(" -v    Enable verbose output\n");
     printf(" -h    Print this helptext\n");
     goto out;
   }
 
 
+  ports[numPorts++].comport = comport;
+  for (uint8_t i = 0; i < numDiversityComports; ++i)
+    ports[numPorts++].comport = diversityComports[i];
+  for (uint8_t i = 0; i < numPorts; ++i)
+    ports[i].hComm = INVALID_HANDLE_VALUE;
+
+  // Discovery runs once, on the first sniffer; every capture uses what it found.
+  if (discoverFirst && !discover(ports[0], baudrate, discoverDwellMs))
+    goto out_comm;
+
   while (1)
   {
     numCaptured = 0;
     numLost = 0;
+    numCorrupt = 0;
 
-    if (INVALID_HANDLE_VALUE != hComm)
+    for (uint8_t i = 0; i < numPorts; ++i)
     {
-      CloseHandle(hComm);
-      hComm = INVALID_HANDLE_VALUE;
+      if (INVALID_HANDLE_VALUE != ports[i].hComm)
+      {
+        CloseHandle(ports[i].hComm);
+        ports[i].hComm = INVALID_HANDLE_VALUE;
+      }
     }
 
     if (INVALID_HANDLE_VALUE != hPipe)
@@ -333,252 +1390,428 @@ int _tmain(int argc, _TCHAR* argv[])
       hPipe = INVALID_HANDLE_VALUE;
     }
 
-    hPipe = CreateNamedPipe(
-                        pipeName,
-                        PIPE_ACCESS_OUTBOUND,
-                        PIPE_TYPE_MESSAGE | PIPE_WAIT,
-                        1, 65536, 65536,
-                        300,
-                        NULL);
-    if (hPipe == INVALID_HANDLE_VALUE)
+    // Node statistics and surveys are shown on the console; Wireshark is only needed for packets.
+    if (config.captureMode == CAPTURE_MODE_PACKETS)
     {
-      printf("Failed to open Wireshark pipe: %d\n", GetLastError());
-      goto out_pipe;
-    }
-
-    printf("\nConnect Wireshark to %s to continue...\n", pipeName);
-    if (!ConnectNamedPipe(hPipe, NULL))
-    {
-      printf("Failed to connect to Wireshark pipe: %d\n", GetLastError());
-      goto out_pipe;
-    }
-
-    assert(sizeof(pcap_hdr) == 24 );
-    DWORD numWritten;
-    (void)WriteFile(hPipe, &pcap_hdr, sizeof(pcap_hdr), &numWritten, NULL);
-
-    char portName[100];
-    _snprintf_s(portName, sizeof(portName), _TRUNCATE, "\\\\.\\COM%d", comport);   // See http://support.microsoft.com/default.aspx?scid=kb;EN-US;q115831
-    hComm = CreateFile( portName,  
-                        GENERIC_READ | GENERIC_WRITE, 
-                        0, 
-                        0, 
-                        OPEN_EXISTING,
-                        0,
-                        0);
-    if (hComm == INVALID_HANDLE_VALUE)
-    {
-      printf("Error!\n", portName);
-      if(GetLastError() == ERROR_FILE_NOT_FOUND)
+      hPipe = CreateNamedPipe(
+                          pipeName,
+                          PIPE_ACCESS_OUTBOUND,
+                          PIPE_TYPE_MESSAGE | PIPE_WAIT,
+                          1, 65536, 65536,
+                          300,
+                          NULL);
+      if (hPipe == INVALID_HANDLE_VALUE)
       {
-        printf("Port %s not available.\n", portName);
+        printf("Failed to open Wireshark pipe: %d\n", GetLastError());
+        goto out_pipe;
       }
-      goto out_comm;
-    }
-    // set the comm parameters
-    DCB dcbSerialParams;
-
-    // get the current comm parameters
-    if (!GetCommState(hComm, &dcbSerialParams))
-    {
-      puts("Failed to get current serial parameters!");
-      goto out_comm;
-    }
-
-    // Set serial port parameters.
-    dcbSerialParams.BaudRate = baudrate;
-    dcbSerialParams.ByteSize = 8;
-    dcbSerialParams.StopBits = ONESTOPBIT;
-    dcbSerialParams.Parity   = NOPARITY;
-    if(!SetCommState(hComm, &dcbSerialParams))
-    {
-      puts("ALERT: Could not set Serial Port parameters");
-      goto out_comm;
-    }
-
-    // Reset the arduino!
-    if (!(    EscapeCommFunction(hComm,CLRDTR) && EscapeCommFunction(hComm,CLRRTS)
-           && EscapeCommFunction(hComm,SETDTR) && EscapeCommFunction(hComm,SETRTS) ))
-    {
-      puts("\nALERT: Failed to reset sniffer");
-      goto out_comm;
-    }
-
-    // Purge serial buffer
-    (void)PurgeComm(hComm, PURGE_RXCLEAR | PURGE_TXCLEAR);
 
-    printf("Wait for sniffer to restart  ");
+      printf("\nConnect Wireshark to %s to continue...\n", pipeName);
+      if (!ConnectNamedPipe(hPipe, NULL))
+      {
+        printf("Failed to connect to Wireshark pipe: %d\n", GetLastError());
+        goto out_pipe;
+      }
 
-    // Sniffer will send configuration on startup. Wait for this packet, then
-    // send our configuration and start listening for packets.
-    serialConfig dummyConfig;
-    if (!serialReadConfig(hComm, dummyConfig ))
-    {
-      puts("\nALERT: Failed waiting for sniffer to restart");
-      goto out_comm;
+      assert(sizeof(pcap_hdr) == 24 );
+      // Frames of several RX pipes or channels are told apart by a pseudo header.
+      pcap_hdr.network = ((config.pipes == PIPES_DEFAULT) && (numHopRanges == 0) && (numRadioConfigs == 0)) ? LINKTYPE_NRF24 : LINKTYPE_NRF24_META;
+      DWORD numWritten;
+      (void)WriteFile(hPipe, &pcap_hdr, sizeof(pcap_hdr), &numWritten, NULL);
     }
 
-    puts("Ok\n");
     printConfig(config);
 
-    if (!writeSerialConfig( hComm, config ))
+    for (uint8_t i = 0; i < numPorts; ++i)
     {
-      puts("ALERT: Could not send config");
-      goto out_comm;
+      if (numPorts > 1)
+        printf("\nSniffer on COM%d\n", ports[i].comport);
+      if (!openSniffer(ports[i], baudrate))
+        goto out_comm;
     }
-    // Sniffer will respond with new config. Safe to ignore here; it will be handled in regular packet handler.
 
     firstPacket = true;
+    combiner.clear(numPorts);
+    // Bytes in front of the address of the first sniffer, up to a full length address.
+    if (recoverFrames)
+    {
+      recovery.begin(ports[0].active.addressLen, ports[0].active.crcLength, NRF_ADDRESS_LENGTH - ports[0].active.addressLen);
+      recoveryReportAt = (uint16_t)min(RECOVERY_FIRST_REPORT, recoverFrames);
+    }
+    lastReportMs = GetTickCount();
 
-    // Flush buffer
-    (void)memset(buff, 0, sizeof(buff));
-    buffIdx = 0;
-
-    printProgress(numCaptured, numLost);
+    printProgress(numCaptured, numLost, numCorrupt);
 
     bool pipeOPen = true;
     while (pipeOPen)
     {
-      if (sizeof(buff)-buffIdx <= 0)
-      {
-        // Buffer completely filled.. Something's terribly wrong --> Flush buffer
-        printf("\nBuffer completely filled.... This is bad news!\n");
-        (void)memset(buff, 0, sizeof(buff));
-        buffIdx = 0;
-      }
-        
-      // Use the ClearCommError function to get status info on the Serial port
-      DWORD errors;
-      COMSTAT stat;
-      ClearCommError(hComm, &errors, &stat);
-      DWORD numToRead = max(1, min(stat.cbInQue, sizeof(buff)-buffIdx));
-        
-      // Blocking read on serial port,reading either 1 byte when nothing is available (block),
-      // the amount of data available on the port or the amount that still fits in the buffer.
-      // This offloads the CPU compared to continuously polling for available data in the port.
-      assert(buffIdx < sizeof(buff));
-      DWORD numRead;
-      if (ReadFile(hComm, (LPVOID)&buff[buffIdx], 1 /* TODO: should be numToRead I think */, &numRead, NULL))
+      bool idle = true;
+      for (uint8_t portIdx = 0; (portIdx < numPorts) && pipeOPen; ++portIdx)
       {
-        buffIdx += numRead;
-      }
-      else
-      {
-        printf("\nError ReadFile %d\n", GetLastError() );
-      }
+        snifferPort& port = ports[portIdx];
 
-      // Loop until there are no complete packets available in the buffer
-      assert(buffIdx <= sizeof(buff));
-      bool consumed = true;
-      while ((buffIdx > 0) && consumed)
-      {
-//        printHex( reinterpret_cast<uint8_t*>(&buff), min(buffIdx,50) );
-        uint8_t* sp = buff;
-        lenAndType = *sp++;
-        DWORD lenSerPacket = GET_MSG_LEN(lenAndType);
-        DWORD lenInBuff = 1 + lenSerPacket;
-        if ((lenSerPacket < SERIAL_MINIMUM_PACKET_LENGTH) || (lenSerPacket > SERIAL_MAXIMUM_PACKET_LENGTH))
+        // When framed, a completed frame adds a whole message at once.
+        if (sizeof(port.buff)-port.buffIdx < (port.framed ? 1 + MAX_MSG_LEN : 1))
+        {
+          // Buffer completely filled.. Something's terribly wrong --> Flush buffer
+          printf("\nBuffer completely filled.... This is bad news!\n");
+          (void)memset(port.buff, 0, sizeof(port.buff));
+          port.buffIdx = 0;
+        }
+          
+        // Use the ClearCommError function to get status info on the Serial port
+        DWORD errors;
+        COMSTAT stat;
+        ClearCommError(port.hComm, &errors, &stat);
+        DWORD numToRead = max(1, min(stat.cbInQue, sizeof(port.buff)-port.buffIdx));
+        // Several sniffers are polled in turn; blocking on one would hold up the others.
+        if ((numPorts > 1) && (stat.cbInQue == 0))
+          continue;
+        idle = false;
+          
+        // Blocking read on serial port,reading either 1 byte when nothing is available (block),
+        // the amount of data available on the port or the amount that still fits in the buffer.
+        // This offloads the CPU compared to continuously polling for available data in the port.
+        assert(port.buffIdx < sizeof(port.buff));
+        DWORD numRead;
+        uint8_t c;
+        if (ReadFile(port.hComm, port.framed ? (LPVOID)&c : (LPVOID)&port.buff[port.buffIdx], 1 /* TODO: should be numToRead I think */, &numRead, NULL))
         {
-          printf("\nIllegal serial packet size %d\n", lenSerPacket);
-          if (verbose)
-            printHex( buff, lenSerPacket );
-          goto out;
+          if (!port.framed)
+          {
+            port.buffIdx += numRead;
+          }
+          else if (numRead)
+          {
+            // Only messages from frames that pass the CRC reach the buffer.
+            const int len = deframe(port.frameRx, c, &port.buff[port.buffIdx]);
+            if (len > 0)
+            {
+              port.buffIdx += len;
+            }
+            else if (len < 0)
+            {
+              numCorrupt++;
+              if (verbose)
+                printf("\nDropped corrupt frame\n");
+              printProgress(numCaptured, numLost, numCorrupt);
+            }
+          }
         }
-        if (buffIdx >= lenInBuff)
+        else
         {
-          // Full packet is available in buffer. Consume it.
-          // Format:
-          // 1 byte                       length & type of serial packet, excluding this byte
-          // MSG_TYPE_PACKET
-          //     TIMESTAMP_LENGTH byte(s)     timestamp of packet, in [us] since start of Arduino (wraps after ca. 70 minutes for 4 bytes)
-          //     PACKETS_LOST_LENGTH byte(s)  Nr of packets lost since last packet, stops counting at 255 (for 1 byte).
-          //     NRF_ADDRESS_LENGTH byte(s)   full target node address
-          //     9bits                        NRF24 control field
-          //     [0..32]*8bits                NRF24 payload, not byte aligned!
-          //     NRF_CRC_LENGTH byte(s)       NRF24 CRC field, not byte aligned!
-          // MSG_TYPE_CONFIG
-          //     <ignored>
+          printf("\nError ReadFile %d\n", GetLastError() );
+        }
 
+        // Loop until there are no complete packets available in the buffer
+        assert(port.buffIdx <= sizeof(port.buff));
+        bool consumed = true;
+        while ((port.buffIdx > 0) && consumed)
+        {
+  //        printHex( reinterpret_cast<uint8_t*>(&port.buff), min(port.buffIdx,50) );
+          uint8_t* sp = port.buff;
+          lenAndType = *sp++;
+          DWORD lenSerPacket = GET_MSG_LEN(lenAndType);
+          DWORD lenInBuff = 1 + lenSerPacket;
+          bool illegalSize;
           switch( GET_MSG_TYPE(lenAndType) )
           {
             case MSG_TYPE_PACKET:
-              {
-                uint8_t pcapPacket[PCAP_MAXIMUM_PACKET_LENGTH+1];
-                uint8_t* pp = pcapPacket;
-
-                // PCap packet will contain everything from serial packet, except timestamp
-                DWORD lenPCapPacket = lenSerPacket - TIMESTAMP_LENGTH;
+              if (port.recordFormat == RECORD_FORMAT_V2)
+                illegalSize = lenSerPacket < RECORD_V2_MINIMUM_LENGTH;
+              else
+                illegalSize =    (lenSerPacket < (port.active.snapLen == SNAPLEN_ALL ? SERIAL_MINIMUM_PACKET_LENGTH : SERIAL_HEADER_ONLY_LENGTH))
+                              || (lenSerPacket > SERIAL_MAXIMUM_PACKET_LENGTH);
+              break;
+            case MSG_TYPE_STATS:  illegalSize = lenSerPacket != SERIAL_STATS_SIZE; break;
+            default:              illegalSize = false; break;
+          }
+          if (illegalSize)
+          {
+            if (verbose)
+            {
+              printf("\nIllegal serial packet size %d\n", lenSerPacket);
+              printHex( port.buff, min(port.buffIdx, lenInBuff) );
+            }
+            numCorrupt++;
+            printProgress(numCaptured, numLost, numCorrupt);
+            // Drop the message when framed. Otherwise the stream is out of sync; skip a single
+            // byte and retry until a sane header shows up.
+            const DWORD skip = port.framed ? lenInBuff : 1;
+            (void)memmove(port.buff, port.buff+skip, port.buffIdx-skip);
+            port.buffIdx -= skip;
+            continue;
+          }
+          if (port.buffIdx >= lenInBuff)
+          {
+            // Full packet is available in buffer. Consume it.
+            // Format:
+            // 1 byte                       length & type of serial packet, excluding this byte
+            // MSG_TYPE_PACKET, RECORD_FORMAT_V2
+            //     1 byte                       flags, RECORD_V2_FLAG_xxx
+            //     1..5 bytes                   timestamp as unsigned LEB128; delta to previous record unless RECORD_V2_FLAG_ABSTIME
+            //     [1 byte]                     Nr of packets lost, when RECORD_V2_FLAG_LOST
+            //     [1 byte]                     RX pipe, when RECORD_V2_FLAG_PIPE
+            //     [1 byte]                     RF channel, when RECORD_V2_FLAG_CHANNEL
+            //     [1 byte]                     Radio, when RECORD_V2_FLAG_RADIO
+            //     [1+n bytes]                  length & address MSB first, when RECORD_V2_FLAG_ADDRESS
+            //     ...                          NRF24 frame, as below
+            // MSG_TYPE_PACKET, RECORD_FORMAT_V1
+            //     TIMESTAMP_LENGTH byte(s)     timestamp of packet, in [us] since start of Arduino (wraps after ca. 70 minutes for 4 bytes)
+            //     PACKETS_LOST_LENGTH byte(s)  Nr of packets lost since last packet, stops counting at 255 (for 1 byte).
+            //     NRF_ADDRESS_LENGTH byte(s)   full target node address
+            //     9bits                        NRF24 control field
+            //     [0..32]*8bits                NRF24 payload, not byte aligned!
+            //     NRF_CRC_LENGTH byte(s)       NRF24 CRC field, not byte aligned!
+            // MSG_TYPE_CONFIG
+            //     Serial_config_t              active sniffer configuration
+            // MSG_TYPE_STATS
+            //     Serial_stats_t               capture buffer fill of the sniffer
+            // MSG_TYPE_CONTROL
+            //     1 byte                       CONTROL_xxx
+            //     Filter_hits_t                when CONTROL_FILTER_HITS
+            //     Node_stats_t                 when CONTROL_NODE_STATS
+            //     Channel_stats_t              when CONTROL_CHANNEL_STATS
+            //     Survey_t                     when CONTROL_SURVEY
 
-                // Read timestamp (passed through pcap header)
-                uint32_t serTimestamp_us = *(reinterpret_cast<uint32_t*>(sp));
-                sp += TIMESTAMP_LENGTH;
-                if (firstPacket)
+            switch( GET_MSG_TYPE(lenAndType) )
+            {
+              case MSG_TYPE_PACKET:
                 {
-                  timestamp_us = 0ULL;
-                  // Previous timestamp not registered yet. Store it now so first packet gets timestamp 0.
-                  prevSerTimestamp_us = serTimestamp_us;
-                }
-                // Increment timestamp with time passed since previous packet.
-                timestamp_us += serTimestamp_us - prevSerTimestamp_us;
-                prevSerTimestamp_us = serTimestamp_us;
+                  // Extra byte, as the copy to the pcap packet below runs one byte past the record.
+                  uint8_t expanded[SERIAL_MAXIMUM_PACKET_LENGTH+1] = { 0 };
+                  bool badCrc = false;
+                  bool noCrc = false;
+                  if (port.recordFormat == RECORD_FORMAT_V2)
+                  {
+                    badCrc = (sp[0] & RECORD_V2_FLAG_BADCRC) != 0;
+                    noCrc = (sp[0] & RECORD_V2_FLAG_NOCRC) != 0;
+                    // Expand into the v1 layout, so the pcap output is the same for both.
+                    lenSerPacket = expandRecordV2(sp, lenSerPacket, expanded, port.v2State);
+                    sp = expanded;
+                    if (lenSerPacket == 0)
+                    {
+                      if (verbose)
+                        printf("\nSkipped record before resync\n");
+                      break;
+                    }
+                  }
+                  // V1 records don't tell the RX pipe, nor the channel when hopping.
+                  const uint8_t rxPipe = port.recordFormat == RECORD_FORMAT_V2 ? port.v2State.rxPipe : NRF24_META_UNKNOWN;
+                  const uint8_t channel = port.recordFormat == RECORD_FORMAT_V2 ? port.v2State.channel : numHopRanges ? NRF24_META_UNKNOWN : port.active.channel;
+                  const uint8_t radio = port.recordFormat == RECORD_FORMAT_V2 ? port.v2State.radio : 0;
+
+                  // Read timestamp (passed through pcap header)
+                  uint32_t serTimestamp_us = getU32(sp);
+                  sp += TIMESTAMP_LENGTH;
+
+                  uint8_t packetsLost = *sp++;
+                  numLost += packetsLost;
+        //          if (packetsLost > 0)
+        //            printf("%d packets lost since last packet\n", packetsLost);
+                  const DWORD lenFrame = lenSerPacket - TIMESTAMP_LENGTH - PACKETS_LOST_LENGTH;
+
+                  if (verbose)
+                  {
+                    if (numPorts > 1)
+                      printf("\nCOM%d%s", port.comport, badCrc ? ", bad CRC: " : noCrc ? ", CRC unchecked: " : ": ");
+                    else
+                      printf(badCrc ? "\nBad CRC: " : noCrc ? "\nCRC unchecked: " : "\n");
+                    printHex( port.buff, lenInBuff );
+                  }
+
+                  // A record pads the address in front to full length; that's where the bytes to recover go.
+                  const uint8_t padLen = NRF_ADDRESS_LENGTH - port.active.addressLen;
+                  if (   recoverFrames && (portIdx == 0) && (recovery.numFrames() < recoverFrames)
+                      && recovery.add(sp + padLen, (uint8_t)(lenFrame - padLen)) && (recovery.numFrames() >= recoveryReportAt))
+                  {
+                    printRecovery(port.active);
+                    recoveryReportAt = (uint16_t)min(2 * recoveryReportAt, recoverFrames);
+                    printProgress(numCaptured, numLost, numCorrupt);
+                  }
 
-                uint8_t packetsLost = *sp++;
-                numLost += packetsLost;
-      //          if (packetsLost > 0)
-      //            printf("%d packets lost since last packet\n", packetsLost);
+                  if (numPorts > 1)
+                  {
+                    // Combined frames are passed on once the other sniffers had time to deliver their copy.
+                    DiversityFrame frame;
+                    frame.crcOk = !badCrc && !noCrc;
+                    frame.crcChecked = !noCrc;
+                    frame.rxPipe = rxPipe;
+                    frame.channel = channel;
+                    frame.radio = radio;
+                    frame.len = (uint8_t)lenFrame;
+                    (void)memcpy(frame.record, sp, lenFrame + 1);
+                    diversityKey(frame, NRF_ADDRESS_LENGTH);
+                    combiner.add(portIdx, serTimestamp_us, hostTime_us(), frame);
+                    break;
+                  }
 
-                // Copy data 1:1 from serial packet, not byte aligned.
-                (void)memcpy(pp, sp, lenPCapPacket);
-                // For last byte only the MSbit has value; rest will be cleared
-                *(pp+lenPCapPacket-1) &= 0x80;
+                  if (firstPacket)
+                  {
+                    timestamp_us = 0ULL;
+                    // Previous timestamp not registered yet. Store it now so first packet gets timestamp 0.
+                    prevSerTimestamp_us = serTimestamp_us;
+                  }
+                  // Increment timestamp with time passed since previous packet.
+                  timestamp_us += serTimestamp_us - prevSerTimestamp_us;
+                  prevSerTimestamp_us = serTimestamp_us;
 
-                // Create packet header
-                assert(sizeof(pcaprec_hdr) == 16);
-                pcaprec_hdr hdr = { (uint32_t)(timestamp_us/1000000), (uint32_t)(timestamp_us%1000000), lenPCapPacket, lenPCapPacket };
+                  const uint8_t metaFlags = (badCrc ? NRF24_META_FLAG_BADCRC : 0) | (noCrc ? NRF24_META_FLAG_NOCRC : 0);
+                  const uint8_t meta[NRF24_META_LENGTH] = { NRF24_META_LENGTH, rxPipe, channel, metaFlags, radio };
+                  if (!writePcapPacket(hPipe, timestamp_us, pcap_hdr.network == LINKTYPE_NRF24_META ? meta : NULL, sp, lenFrame, port.active.crcLength))
+                  {
+                    /* Restarting the pipe */
+                    printf("\nPipe disconnected\n");
+                    pipeOPen = false;
+                  }
+                  firstPacket = false;
+                  numCaptured++;
+                  printProgress(numCaptured, numLost, numCorrupt);
+                }
+                break;
 
-                if (verbose)
+              case MSG_TYPE_CONFIG:
+                if (deserializeConfig(sp, (uint8_t)lenSerPacket, port.active))
                 {
-                  printf("\n");
-                  printHex( buff, lenInBuff );
-      //          printHex( pcapPacket, lenPCapPacket );
+                  port.recordFormat = port.active.recordFormat;
+                  port.framed = port.active.framing == FRAMING_COBS;
+                  // Sniffer resyncs timestamp & address after every config.
+                  (void)memset(&port.v2State, 0, sizeof(port.v2State));
                 }
-                // Write record header & data
-                DWORD numWritten;
-                if (    !WriteFile(hPipe, &hdr, sizeof(hdr), &numWritten, NULL) 
-                     || !WriteFile(hPipe, &pcapPacket, lenPCapPacket, &numWritten, NULL))
+                break;
+
+              case MSG_TYPE_STATS:
                 {
-                  /* Restarting the pipe */
-                  printf("\nPipe disconnected\n");
-                  pipeOPen = false;
+                  Serial_stats_t stats;
+                  if (deserializeStats(sp, (uint8_t)lenSerPacket, stats))
+                    printProgress(numCaptured, numLost, numCorrupt, &stats);
                 }
-              }
-              firstPacket = false;
-              numCaptured++;
-              printProgress(numCaptured, numLost);
-              break;
+                break;
 
-            default:   // Ignore
-              break;
-          } // switch MSG_TYPE
+              case MSG_TYPE_CONTROL:
+                {
+                  Filter_hits_t hits;
+                  if (   (lenSerPacket >= 1) && (sp[0] == CONTROL_FILTER_HITS)
+                      && deserializeFilterHits(sp + 1, (uint8_t)(lenSerPacket - 1), hits))
+                  {
+                    if (verbose)
+                    {
+                      printf("\nFilter hits:");
+                      for (uint8_t i = 0; i < hits.numRules; ++i)
+                        printf(" %lu", (unsigned long)hits.hits[i]);
+                      printf("\n");
+                    }
+                    printProgress(numCaptured, numLost, numCorrupt, NULL, &hits);
+                  }
+                  Node_stats_t node;
+                  if (   (lenSerPacket >= 1) && (sp[0] == CONTROL_NODE_STATS)
+                      && deserializeNodeStats(sp + 1, (uint8_t)(lenSerPacket - 1), node))
+                  {
+                    if (node.node == NODE_STATS_OTHER)
+                      printf("\rOther nodes:");
+                    else if (numRadioConfigs)
+                      printf("\rRadio %lu pipe %lu node 0x%02lx:", (unsigned long)(node.node >> 28), (unsigned long)((node.node >> 24) & 0x0F),
+                             (unsigned long)(node.node & 0xFFFFFFUL));
+                    else if (config.pipes != PIPES_DEFAULT)
+                      printf("\rPipe %lu node 0x%02lx:", (unsigned long)((node.node >> 24) & 0x0F), (unsigned long)(node.node & 0xFFFFFFUL));
+                    else
+                      printf("\rNode 0x%02lx:", (unsigned long)node.node);
+                    printf(" %lu pkts, %lu B, %u retx, %u bad CRC", (unsigned long)node.packets, (unsigned long)node.bytes,
+                           node.retransmits, node.crcFails);
+                    if (node.gapMax)
+                      printf(", gap %.1f/%.1f/%.1f ms", node.gapMin / 1000.0, node.gapMean / 1000.0, node.gapMax / 1000.0);
+                    printf("                    \n");
+                    numCaptured += node.packets;
+                    printProgress(numCaptured, numLost, numCorrupt);
+                  }
+                  Channel_stats_t channel;
+                  if (   (lenSerPacket >= 1) && (sp[0] == CONTROL_CHANNEL_STATS)
+                      && deserializeChannelStats(sp + 1, (uint8_t)(lenSerPacket - 1), channel)
+                      && (channel.packets || verbose))
+                  {
+                    // Packets per second of listening tell how busy the channel is, whatever the dwell time.
+                    printf("\rChannel %3d: %lu pkts, %lu CRC ok, %lu ms", channel.channel, (unsigned long)channel.packets,
+                           (unsigned long)channel.packetsCrcOk, (unsigned long)channel.listenMs);
+                    if (channel.listenMs)
+                      printf(", %.1f pkts/s", channel.packets * 1000.0 / channel.listenMs);
+                    printf("                    \n");
+                    printProgress(numCaptured, numLost, numCorrupt);
+                  }
+                  Survey_t survey;
+                  if (   (lenSerPacket >= 1) && (sp[0] == CONTROL_SURVEY)
+                      && deserializeSurvey(sp + 1, (uint8_t)(lenSerPacket - 1), survey)
+                      && (survey.firstChannel + survey.numChannels <= RF_NUM_CHANNELS))
+                  {
+                    (void)memcpy(surveyRatios + survey.firstChannel, survey.hitRatio, survey.numChannels);
+                    // The sniffer sends the blocks in order; the last one completes the line.
+                    if (survey.firstChannel + survey.numChannels == RF_NUM_CHANNELS)
+                    {
+                      printSurvey(surveyRatios);
+                      printProgress(numCaptured, numLost, numCorrupt);
+                    }
+                  }
+                }
+                break;
+
+              default:   // Ignore
+                break;
+            } // switch MSG_TYPE
 
-          // Remove packet from buffer
-          (void)memmove(buff, buff+lenInBuff, buffIdx-lenInBuff);             // Memmove! Regions overlap.
-          (void)memset(buff+buffIdx, 0, sizeof(buff)-buffIdx);                // Optional: Clear remaining buffer
-          buffIdx -= lenInBuff;
-//          printf("Consumed %d bytes. New idx %d\n", lenInBuff, buffIdx);
+            // Remove packet from buffer
+            (void)memmove(port.buff, port.buff+lenInBuff, port.buffIdx-lenInBuff);        // Memmove! Regions overlap.
+            (void)memset(port.buff+port.buffIdx, 0, sizeof(port.buff)-port.buffIdx);      // Optional: Clear remaining buffer
+            port.buffIdx -= lenInBuff;
+  //          printf("Consumed %d bytes. New idx %d\n", lenInBuff, port.buffIdx);
+          }
+          else
+          {
+            consumed = false;
+          }
         }
-        else
+      }
+
+      if (numPorts > 1)
+      {
+        // Pass on the combined frames that are due, on the host timeline starting at 0 like a single sniffer's.
+        DiversityFrame frame;
+        while (pipeOPen && combiner.pop(hostTime_us(), frame))
+        {
+          if (firstPacket)
+            combinedStart_us = frame.timestamp_us;
+          // Copies of a lagging sniffer may place a frame slightly before the first one.
+          timestamp_us = frame.timestamp_us > combinedStart_us ? frame.timestamp_us - combinedStart_us : 0ULL;
+          const uint8_t metaFlags = frame.crcOk ? 0 : frame.crcChecked ? NRF24_META_FLAG_BADCRC : NRF24_META_FLAG_NOCRC;
+          const uint8_t meta[NRF24_META_LENGTH] = { NRF24_META_LENGTH, frame.rxPipe, frame.channel, metaFlags, frame.radio };
+          if (!writePcapPacket(hPipe, timestamp_us, pcap_hdr.network == LINKTYPE_NRF24_META ? meta : NULL, frame.record, frame.len, ports[0].active.crcLength))
+          {
+            /* Restarting the pipe */
+            printf("\nPipe disconnected\n");
+            pipeOPen = false;
+          }
+          firstPacket = false;
+          numCaptured++;
+          printProgress(numCaptured, numLost, numCorrupt);
+        }
+        if (GetTickCount() - lastReportMs >= DIVERSITY_REPORT_MS)
         {
-          consumed = false;
+          printDiversity(combiner.stats(), ports, numPorts);
+          combiner.clearStats();
+          lastReportMs = GetTickCount();
+          printProgress(numCaptured, numLost, numCorrupt);
         }
+        if (idle)
+          Sleep(1);
       }
     }
   }
 
 out_comm:
-  if ( INVALID_HANDLE_VALUE != hComm )
+  for (uint8_t i = 0; i < numPorts; ++i)
   {
-    CloseHandle(hComm);
+    if ( INVALID_HANDLE_VALUE != ports[i].hComm )
+    {
+      CloseHandle(ports[i].hComm);
+    }
   }
 
 out_pipe:
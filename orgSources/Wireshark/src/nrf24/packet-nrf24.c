@@ -44,6 +44,12 @@
 #define NRF24_CONTROLFIELD_LENGTH_BITS  (NRF24_CONTROLFIELD_PAYLOAD_LENGTH_LENGTH_BITS+NRF24_CONTROLFIELD_PID_LENGTH_LENGTH_BITS+NRF24_CONTROLFIELD_NOACK_LENGTH_LENGTH_BITS)
 #define NRF24_CRC_LENGTH                (2)
 
+#define NRF24_META_LENGTH               (4)     // Header length, RX pipe, RF channel & flags
+#define NRF24_META_UNKNOWN              (0xFF)  // RX pipe or channel not known
+#define NRF24_META_FLAG_BADCRC          (0x01)
+#define NRF24_META_FLAG_NOCRC           (0x02)
+#define NRF24_META_LENGTH_RADIO         (5)     // Header length from which the radio of the sniffer follows the flags
+
 #ifdef BYTE_ALIGN_PCAP
 #define NRF24_CONTROLFIELD_SHIFT (7)
 #else
@@ -109,7 +115,17 @@ static int ett_nrf24_control      = -1;
 static gint proto_nrf24           = -1;
 const guint encoding = ENC_LITTLE_ENDIAN;
 
+static int hf_nrf24meta_length    = -1;
+static int hf_nrf24meta_pipe      = -1;
+static int hf_nrf24meta_channel   = -1;
+static int hf_nrf24meta_badcrc    = -1;
+static int hf_nrf24meta_nocrc     = -1;
+static int hf_nrf24meta_radio     = -1;
+static int ett_nrf24meta          = -1;
+static gint proto_nrf24meta       = -1;
+
 static dissector_handle_t data_handle;
+static dissector_handle_t nrf24_handle;
 
 
 static const value_string noack_types[] = {
@@ -288,6 +304,43 @@ static void dissect_nrf24(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
   }
 }
 
+// Pseudo header Nrf24Sniff puts in front of the frame when listening on several RX pipes, channels or radios.
+// Fields beyond the ones known here are skipped, using the header length.
+static void dissect_nrf24meta(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
+{
+  guint8 hdrLen = tvb_get_guint8(tvb, 0);
+  guint8 pipe, channel, radio;
+
+  if (hdrLen < NRF24_META_LENGTH)
+  {
+    call_dissector(data_handle, tvb, pinfo, tree);
+    return;
+  }
+  pipe = tvb_get_guint8(tvb, 1);
+  channel = tvb_get_guint8(tvb, 2);
+  radio = hdrLen >= NRF24_META_LENGTH_RADIO ? tvb_get_guint8(tvb, 4) : 0;
+  if (tree)
+  {
+    proto_item *ti = proto_tree_add_item(tree, proto_nrf24meta, tvb, 0, hdrLen, ENC_NA);
+    proto_tree *meta_tree = proto_item_add_subtree(ti, ett_nrf24meta);
+
+    proto_tree_add_item(meta_tree, hf_nrf24meta_length,  tvb, 0, 1, ENC_NA);
+    proto_tree_add_item(meta_tree, hf_nrf24meta_pipe,    tvb, 1, 1, ENC_NA);
+    proto_tree_add_item(meta_tree, hf_nrf24meta_channel, tvb, 2, 1, ENC_NA);
+    proto_tree_add_item(meta_tree, hf_nrf24meta_badcrc,  tvb, 3, 1, ENC_NA);
+    proto_tree_add_item(meta_tree, hf_nrf24meta_nocrc,   tvb, 3, 1, ENC_NA);
+    if (hdrLen >= NRF24_META_LENGTH_RADIO)
+      proto_tree_add_item(meta_tree, hf_nrf24meta_radio, tvb, 4, 1, ENC_NA);
+    if (radio != 0)
+      proto_item_append_text(ti, ", Radio: %d", radio);
+    if (pipe != NRF24_META_UNKNOWN)
+      proto_item_append_text(ti, ", Pipe: %d", pipe);
+    if (channel != NRF24_META_UNKNOWN)
+      proto_item_append_text(ti, ", Channel: %d", channel);
+  }
+  call_dissector(nrf24_handle, tvb_new_subset_remaining(tvb, hdrLen), pinfo, tree);
+}
+
 #define PAYLOADLENGTH_MASK  (NRF24_PAYLOADLENGTH_MASK << (16-NRF24_CONTROLFIELD_SHIFT-NRF24_CONTROLFIELD_PAYLOAD_LENGTH_LENGTH_BITS))
 #define PID_MASK            (NRF24_PID_MASK << (16-NRF24_CONTROLFIELD_SHIFT-NRF24_CONTROLFIELD_PAYLOAD_LENGTH_LENGTH_BITS-NRF24_CONTROLFIELD_PID_LENGTH_LENGTH_BITS))
 #define NOACK_MASK          (NRF24_NOACK_MASK <<(16-NRF24_CONTROLFIELD_SHIFT-NRF24_CONTROLFIELD_PAYLOAD_LENGTH_LENGTH_BITS-NRF24_CONTROLFIELD_PID_LENGTH_LENGTH_BITS-NRF24_CONTROLFIELD_NOACK_LENGTH_LENGTH_BITS))
@@ -320,6 +373,17 @@ void proto_register_nrf24(void)
         &ett_nrf24,           // subtree nrf24mysns
         &ett_nrf24_control    // subtree nrf24mysns control field
     };
+    static hf_register_info hf_meta[] = {
+        { &hf_nrf24meta_length,             { "Header length",  "nrf24meta.len",     FT_UINT8,         BASE_DEC,  NULL, 0x0, NULL, HFILL } },
+        { &hf_nrf24meta_pipe,               { "RX pipe",        "nrf24meta.pipe",    FT_UINT8,         BASE_DEC,  NULL, 0x0, "RX pipe of the sniffer, 255 when unknown", HFILL } },
+        { &hf_nrf24meta_channel,            { "Channel",        "nrf24meta.channel", FT_UINT8,         BASE_DEC,  NULL, 0x0, "RF channel of the sniffer, 255 when unknown", HFILL } },
+        { &hf_nrf24meta_badcrc,             { "Bad CRC",        "nrf24meta.badcrc",  FT_BOOLEAN,       8,         NULL, NRF24_META_FLAG_BADCRC, "Sniffer found the CRC invalid", HFILL } },
+        { &hf_nrf24meta_nocrc,              { "CRC unchecked",  "nrf24meta.nocrc",   FT_BOOLEAN,       8,         NULL, NRF24_META_FLAG_NOCRC, "Sniffer captured too little of the frame to check the CRC", HFILL } },
+        { &hf_nrf24meta_radio,              { "Radio",          "nrf24meta.radio",   FT_UINT8,         BASE_DEC,  NULL, 0x0, "Radio of the sniffer that heard the frame", HFILL } },
+      };
+    static int *ett_meta[] = {
+        &ett_nrf24meta        // subtree nrf24meta
+    };
  
     proto_nrf24 = proto_register_protocol (
         "NRF24",        // name
@@ -328,6 +392,16 @@ void proto_register_nrf24(void)
         );
     register_dissector("nrf24", dissect_nrf24, proto_nrf24);
 
+    // Map DLT_USER1 (148) to nrf24meta for captures of several RX pipes, channels or radios.
+    proto_nrf24meta = proto_register_protocol (
+        "NRF24 capture metadata",  // name
+        "nrf24meta",         // short name
+        "nrf24meta"          // abb ref
+        );
+    register_dissector("nrf24meta", dissect_nrf24meta, proto_nrf24meta);
+    proto_register_field_array(proto_nrf24meta, hf_meta, array_length(hf_meta));
+    proto_register_subtree_array(ett_meta, array_length(ett_meta));
+
 
     register_heur_dissector_list("nrf24", &heur_subdissector_list);
 
@@ -338,8 +412,6 @@ void proto_register_nrf24(void)
 /* Register Protocol handler */
 void proto_reg_handoff_nrf24(void)
 {
-  static dissector_handle_t nrf24_handle;
-
   nrf24_handle = create_dissector_handle(dissect_nrf24, proto_nrf24);
   data_handle = find_dissector("data");
 }
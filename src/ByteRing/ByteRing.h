@@ -0,0 +1,251 @@
+/*
+  ByteRing - Lock-free single-producer/single-consumer ring of variable length records.
+
+  Records are stored back to back, each prefixed by a 32-bit length word and padded to
+  a multiple of 4 bytes, so a record can be accessed in place as a struct. A record never
+  wraps around the end of the buffer; when it doesn't fit in the remaining space, the
+  producer leaves a wrap marker and continues at the start of the buffer.
+
+  The producer reserves room for the largest record it might write, fills it in place
+  and then commits only the bytes actually used.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+*/
+
+#ifndef ByteRing_h
+#define ByteRing_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+// Head and tail are placed on separate cache lines, so the producer and consumer
+// core don't invalidate each other's line on every update.
+#ifndef BYTERING_CACHELINE_SIZE
+#if defined(__XTENSA__)
+#define BYTERING_CACHELINE_SIZE (32)
+#else
+#define BYTERING_CACHELINE_SIZE (64)
+#endif
+#endif
+
+class ByteRing
+{
+public:
+  static const uint32_t HEADER_SIZE = sizeof(uint32_t);
+
+  /** Constructor
+   * @param buffer   Preallocated, 4-byte aligned buffer of size bytes.
+   * @param size     Size of the buffer in bytes. Must be a power of two.
+   */
+  ByteRing(uint8_t *buffer, const uint32_t size)
+      : m_size(size), m_buff(buffer)
+  {
+    clear();
+  }
+
+  /** Replace the buffer, e.g. after resizing. Clears the ring.
+   * Not safe against a concurrent producer or consumer; stop both before calling.
+   */
+  void setBuffer(uint8_t *buffer, const uint32_t size)
+  {
+    m_buff = buffer;
+    m_size = size;
+    clear();
+  }
+
+  /** Clear all records and reset the high-water mark.
+   * Not safe against a concurrent producer or consumer; stop both before calling.
+   */
+  void clear(void)
+  {
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+    m_highWater = 0;
+    m_reserveSkip = 0;
+  }
+
+  /** Test if the ring holds no records */
+  inline bool empty(void) const
+  {
+    return bytesUsed() == 0;
+  }
+
+  /** Return the number of bytes occupied by records, including length words & padding */
+  inline uint32_t bytesUsed(void) const
+  {
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+  }
+
+  /** Return the highest number of bytes in use since the last clear() */
+  inline uint32_t highWater(void) const
+  {
+    return m_highWater;
+  }
+
+  /** Return the total size of the ring in bytes */
+  inline uint32_t size(void) const
+  {
+    return m_size;
+  }
+
+  /** Return the buffer holding all records */
+  inline uint8_t *buffer(void) const
+  {
+    return m_buff;
+  }
+
+  /** Reserve contiguous room for a record, for writing. Producer only.
+   * After filling the record, it has to be committed to actually
+   * add it to the ring.
+   * @param maxLen   Largest number of bytes that will be written.
+   * @return Pointer to 4-byte aligned record, or NULL when there's not enough free space.
+   */
+  uint8_t *reserve(const uint32_t maxLen)
+  {
+    const uint32_t need = recordSize(maxLen);
+    const uint32_t head = m_head.load(std::memory_order_relaxed);
+    const uint32_t free = m_size - (head - m_tail.load(std::memory_order_acquire));
+    const uint32_t pos = head & (m_size - 1);
+    const uint32_t contiguous = m_size - pos;
+
+    if (contiguous >= need)
+    {
+      if (free < need)
+        return NULL;
+      m_reserveSkip = 0;
+      return m_buff + pos + HEADER_SIZE;
+    }
+    // Doesn't fit before the end of the buffer; skip to the start.
+    if (free < contiguous + need)
+      return NULL;
+    m_reserveSkip = contiguous;
+    return m_buff + HEADER_SIZE;
+  }
+
+  /** Add the record obtained from reserve() to the ring. Producer only.
+   * @param len      Number of bytes used, at most the maxLen passed to reserve().
+   */
+  void commit(const uint32_t len)
+  {
+    const uint32_t head = m_head.load(std::memory_order_relaxed);
+    const uint32_t pos = head & (m_size - 1);
+    if (m_reserveSkip)
+    {
+      // Tell the consumer to continue at the start of the buffer.
+      *lengthAt(pos) = WRAP_MARKER;
+      *lengthAt(0) = len;
+    }
+    else
+    {
+      *lengthAt(pos) = len;
+    }
+    const uint32_t newHead = head + m_reserveSkip + recordSize(len);
+    // Release: record contents become visible before the new head.
+    m_head.store(newHead, std::memory_order_release);
+
+    const uint32_t used = newHead - m_tail.load(std::memory_order_acquire);
+    if (used > m_highWater)
+      m_highWater = used;
+  }
+
+  /** Aquire record on back of the ring, for reading. Consumer only.
+   * After reading the record, it has to be pop'ed to actually
+   * remove it from the ring.
+   * @param len      Returns number of bytes in the record.
+   * @return Pointer to 4-byte aligned record, or NULL when ring is empty.
+   */
+  uint8_t *front(uint32_t &len)
+  {
+    uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (m_head.load(std::memory_order_acquire) == tail)
+      return NULL;
+    uint32_t pos = tail & (m_size - 1);
+    if (*lengthAt(pos) == WRAP_MARKER)
+    {
+      // Release the unused end of the buffer right away.
+      tail += m_size - pos;
+      m_tail.store(tail, std::memory_order_release);
+      pos = 0;
+    }
+    len = *lengthAt(pos);
+    return m_buff + pos + HEADER_SIZE;
+  }
+
+  /** Remove record from back of the ring. Consumer only.
+   * Must be preceded by a successful front().
+   */
+  void pop(void)
+  {
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    const uint32_t len = *lengthAt(tail & (m_size - 1));
+    // Release: we're done reading the record before the producer may reuse it.
+    m_tail.store(tail + recordSize(len), std::memory_order_release);
+  }
+
+  /** Replace the buffer, e.g. after resizing, keeping the records. Oldest first, they're copied to the
+   * start of the new buffer until one doesn't fit; that one and all after it are removed, so the
+   * records kept stay in order. The old buffer is no longer used afterwards.
+   * Not safe against a concurrent producer or consumer; stop both before calling.
+   * @param buffer   Preallocated, 4-byte aligned buffer of size bytes.
+   * @param size     Size of the buffer in bytes. Must be a power of two, or 0.
+   * @return Number of records removed.
+   */
+  uint32_t moveToBuffer(uint8_t *buffer, const uint32_t size)
+  {
+    uint32_t used = 0;
+    uint32_t dropped = 0;
+    uint32_t len;
+    const uint8_t *p;
+    while ((p = front(len)) != NULL)
+    {
+      const uint32_t need = recordSize(len);
+      if (dropped || (size - used < need))
+      {
+        dropped++;
+      }
+      else
+      {
+        *reinterpret_cast<uint32_t *>(buffer + used) = len;
+        memcpy(buffer + used + HEADER_SIZE, p, len);
+        used += need;
+      }
+      pop();
+    }
+    setBuffer(buffer, size);
+    m_head.store(used, std::memory_order_relaxed);
+    m_highWater = used;
+    return dropped;
+  }
+
+protected:
+  static const uint32_t WRAP_MARKER = 0xFFFFFFFFUL;
+
+  static inline uint32_t recordSize(const uint32_t len)
+  {
+    return (HEADER_SIZE + len + 3) & ~3UL;
+  }
+  inline uint32_t *lengthAt(const uint32_t pos) const
+  {
+    return reinterpret_cast<uint32_t *>(m_buff + pos);
+  }
+
+  uint32_t m_size;         // Total number of bytes in the buffer.
+  uint8_t *m_buff;         // Ptr to buffer holding all records.
+  uint32_t m_highWater;    // Maximum number of bytes used. Written by producer only.
+  uint32_t m_reserveSkip;  // Bytes skipped at end of buffer for the outstanding reservation. Producer only.
+  // Free running byte offsets; only the low bits address the buffer.
+  alignas(BYTERING_CACHELINE_SIZE) std::atomic<uint32_t> m_head; // Offset past the last committed record. Written by producer only.
+  alignas(BYTERING_CACHELINE_SIZE) std::atomic<uint32_t> m_tail; // Offset of the oldest record. Written by consumer only.
+};
+
+#endif // ByteRing_h
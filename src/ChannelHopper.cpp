@@ -0,0 +1,89 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include <stdint.h>
+
+#include "main.h"
+#include "ChannelHopper.h"
+
+ChannelHopper::ChannelHopper()
+{
+    clear();
+}
+
+void ChannelHopper::clear()
+{
+    m_numChannels = 0;
+    m_current = 0;
+    m_tunedMs = 0;
+}
+
+bool ChannelHopper::add(const Hop_range_t &range)
+{
+    if ((range.firstChannel > range.lastChannel) || (range.lastChannel >= RF_NUM_CHANNELS) || (range.dwellMs == 0))
+        return false;
+    if (range.lastChannel - range.firstChannel + 1 > MAX_HOP_CHANNELS - m_numChannels)
+        return false;
+    for (uint16_t ch = range.firstChannel; ch <= range.lastChannel; ++ch)
+    {
+        Entry &e = m_table[m_numChannels++];
+        e.dwellMs = range.dwellMs;
+        e.stats.channel = ch;
+    }
+    return true;
+}
+
+uint8_t ChannelHopper::start(uint32_t nowMs)
+{
+    for (uint8_t i = 0; i < m_numChannels; ++i)
+    {
+        Channel_stats_t &s = m_table[i].stats;
+        s.packets = 0;
+        s.packetsCrcOk = 0;
+        s.listenMs = 0;
+    }
+    m_current = 0;
+    m_tunedMs = nowMs;
+    return channel();
+}
+
+uint8_t ChannelHopper::next(uint32_t nowMs)
+{
+    accountListening(nowMs);
+    if (++m_current >= m_numChannels)
+        m_current = 0;
+    return channel();
+}
+
+void ChannelHopper::accountListening(uint32_t nowMs)
+{
+    m_table[m_current].stats.listenMs += nowMs - m_tunedMs;
+    m_tunedMs = nowMs;
+}
+
+void ChannelHopper::count(bool crcOk)
+{
+    Channel_stats_t &s = m_table[m_current].stats;
+    s.packets++;
+    if (crcOk)
+        s.packetsCrcOk++;
+}
+
+uint8_t ChannelHopper::collect(Channel_stats_t *stats, uint32_t nowMs)
+{
+    if (m_numChannels == 0)
+        return 0;
+    accountListening(nowMs);
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < m_numChannels; ++i)
+    {
+        Channel_stats_t &s = m_table[i].stats;
+        if ((s.listenMs == 0) && (s.packets == 0))
+            continue;
+        stats[n++] = s;
+        s.packets = 0;
+        s.packetsCrcOk = 0;
+        s.listenMs = 0;
+    }
+    return n;
+}
@@ -0,0 +1,56 @@
+#ifndef ChannelHopper_h
+#define ChannelHopper_h
+
+#include <stdint.h>
+
+#include "NRF24_sniff_protocol.h"
+
+// Table of channels to cycle through, as sent by the host, with the occupancy of each channel.
+// The capture task moves to the next channel when the dwell time of the current one has passed
+// and accounts the frames it hears; clear(), add(), start() and collect() must not run concurrently with it.
+class ChannelHopper
+{
+public:
+    ChannelHopper();
+
+    // Remove all channels.
+    void clear();
+
+    // Append the channels of a range. Returns false when the table can't hold them or the range is invalid.
+    bool add(const Hop_range_t &range);
+
+    uint8_t numChannels() const { return m_numChannels; }
+
+    // Restart at the first channel of the table, with all counters reset. Returns that channel.
+    uint8_t start(uint32_t nowMs);
+
+    // Move on to the next channel of the table, wrapping around at the end. Returns that channel.
+    uint8_t next(uint32_t nowMs);
+
+    uint8_t channel() const { return m_table[m_current].stats.channel; }
+
+    uint16_t dwellMs() const { return m_table[m_current].dwellMs; }
+
+    // Account a frame heard on the current channel.
+    void count(bool crcOk);
+
+    // Fetch the counters of the channels listened on since the previous call and reset them.
+    // stats must hold MAX_HOP_CHANNELS entries; returns the number filled in.
+    uint8_t collect(Channel_stats_t *stats, uint32_t nowMs);
+
+private:
+    struct Entry
+    {
+        uint16_t dwellMs;
+        Channel_stats_t stats;
+    };
+
+    Entry m_table[MAX_HOP_CHANNELS];
+    uint8_t m_numChannels;
+    uint8_t m_current;
+    uint32_t m_tunedMs; // millis() from which the listening time of the current channel is yet to be accounted.
+
+    void accountListening(uint32_t nowMs);
+};
+
+#endif // ChannelHopper_h
@@ -0,0 +1,38 @@
+#ifndef EsbCrc_h
+#define EsbCrc_h
+
+#include <stdint.h>
+
+// Outcome of EsbCrc::check()
+#define ESB_CRC_OK          (0)         // CRC of the frame is valid
+#define ESB_CRC_BAD         (1)         // CRC of the frame is invalid
+#define ESB_CRC_UNCHECKED   (2)         // Frame captured up to before the end of its CRC; can't tell
+
+// CRC check of Enhanced ShockBurst frames as captured in promiscuous mode. The nRF24 calculates
+// the CRC over address, 9-bit control field and payload. A captured frame is byte aligned from
+// the start of the address, so all but the last bit are handled a byte at a time by table lookup.
+class EsbCrc
+{
+public:
+    EsbCrc();
+
+    // Prepare for frames received on the given promiscuous address (MSB first), with a CRC of
+    // crcLength bytes. The address part of the CRC is the same for all frames; it's calculated once.
+    void begin(const uint8_t *promiscAddress, uint8_t promiscLen, uint8_t crcLength);
+
+    // Test the CRC of a frame, which starts with the nodeLen address bytes not in the promiscuous
+    // address. Returns one of ESB_CRC_xxx.
+    uint8_t check(const uint8_t *frame, uint8_t nodeLen, uint8_t frameLen) const;
+
+    // CRC-16-CCITT (x^16+x^12+x^5+1) of whole bytes, MSB first.
+    static uint16_t crc16(const uint8_t *data, uint8_t len, uint16_t crc);
+
+    // CRC-8 (x^8+x^2+x+1) of whole bytes, MSB first.
+    static uint8_t crc8(const uint8_t *data, uint8_t len, uint8_t crc);
+
+private:
+    uint8_t m_crcLength;
+    uint16_t m_seed; // CRC over the promiscuous address.
+};
+
+#endif // EsbCrc_h
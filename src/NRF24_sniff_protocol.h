@@ -0,0 +1,641 @@
+/*
+  This file is part of NRF24_Sniff.
+
+  Created by Ivo Pullens, Emmission, 2014 -- www.emmission.nl
+    
+  NRF24_Sniff is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  NRF24_Sniff is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with NRF24_Sniff.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Serial protocol between sniffer and host, shared by the firmware and the
+// SerialToPipe host tool. Structs are never sent as raw memory; they're
+// (de)serialized field by field, little endian, so padding and byte order
+// of either side don't matter.
+
+#ifndef NRF24_sniff_protocol_h
+#define NRF24_sniff_protocol_h
+#include <stdint.h>
+
+#define SNIFF_PROTOCOL_VERSION  (10)    // Bump on any incompatible change of the messages below
+
+// Every message starts with a byte holding message type and length of the message, excluding this byte.
+#define MSG_TYPE_PACKET  (0)
+#define MSG_TYPE_CONFIG  (1)
+#define MSG_TYPE_STATS   (2)
+#define MSG_TYPE_CONTROL (3)            // First byte holds one of CONTROL_xxx
+
+#define SET_MSG_TYPE(var,type)   (((var) & 0x3F) | ((type) << 6))
+#define GET_MSG_TYPE(var)        ((var) >> 6)
+#define GET_MSG_LEN(var)         ((var) & 0x3F)
+#define MAX_MSG_LEN              (0x3F)
+
+#define CONTROL_BAUD_CONFIRM  (0)       // Host to sniffer: host has switched to the new baudrate
+#define CONTROL_FILTER_CLEAR  (1)       // Host to sniffer: remove all filter rules
+#define CONTROL_FILTER_ADD    (2)       // Host to sniffer: append the Filter_rule_t that follows
+#define CONTROL_FILTER_HITS   (3)       // Sniffer to host: Filter_hits_t; answers filter changes and follows the stats
+#define CONTROL_NODE_STATS    (4)       // Sniffer to host: Node_stats_t of one node over the last summary interval
+#define CONTROL_HOP_CLEAR     (5)       // Host to sniffer: empty the hop table, back to the configured channel
+#define CONTROL_HOP_ADD       (6)       // Host to sniffer: append the channels of the Hop_range_t that follows
+#define CONTROL_HOP_TABLE     (7)       // Sniffer to host: 1 byte nr. of channels in the hop table; answers hop table changes
+#define CONTROL_CHANNEL_STATS (8)       // Sniffer to host: Channel_stats_t of one hop table channel; follows the stats
+#define CONTROL_SURVEY        (9)       // Sniffer to host: Survey_t of a block of channels over the last summary interval
+#define CONTROL_RADIO_CLEAR   (10)      // Host to sniffer: stop all radios but radio 0
+#define CONTROL_RADIO_ADD     (11)      // Host to sniffer: start the next fitted radio on the Radio_config_t that follows
+#define CONTROL_RADIO_TABLE   (12)      // Sniffer to host: 1 byte nr. of radios capturing, 1 byte nr. fitted; answers radio changes
+
+// What the sniffer sends of the captured frames
+#define CAPTURE_MODE_PACKETS     (0)    // Every frame as a MSG_TYPE_PACKET record
+#define CAPTURE_MODE_NODE_STATS  (1)    // No frames; CONTROL_NODE_STATS for every node heard, each summary interval
+#define CAPTURE_MODE_SURVEY      (2)    // No frames; sweep all channels sampling RPD, CONTROL_SURVEY each summary interval
+#define NODE_STATS_OTHER         (0xFFFFFFFFUL) // Node of the summary of all nodes that didn't fit in the sniffer's table
+#define SNAPLEN_ALL              (0xFF) // Capture complete frames; otherwise payload bytes kept per frame, 0 = header only
+
+// MSG_TYPE_PACKET record encodings
+#define RECORD_FORMAT_V1      (1)       // Timestamp, packets lost & address, followed by NRF24 frame
+#define RECORD_FORMAT_V2      (2)       // Flags byte, varint timestamp, optional fields as flagged, followed by NRF24 frame
+
+#define RECORD_V2_FLAG_LOST     (0x01)  // packetsLost byte follows timestamp
+#define RECORD_V2_FLAG_ADDRESS  (0x02)  // Length byte & address (MSB first) follow, replacing the previous one
+#define RECORD_V2_FLAG_ABSTIME  (0x04)  // Timestamp is absolute instead of a delta to the previous record
+#define RECORD_V2_FLAG_BADCRC   (0x08)  // Sniffer found the NRF24 CRC of the frame invalid
+#define RECORD_V2_FLAG_PIPE     (0x10)  // RX pipe byte follows packetsLost, replacing the previous one. Always with RECORD_V2_FLAG_ADDRESS.
+#define RECORD_V2_FLAG_CHANNEL  (0x20)  // RF channel byte follows the pipe, replacing the previous one
+#define RECORD_V2_FLAG_RADIO    (0x40)  // Radio byte follows the channel, replacing the previous one. Always with RECORD_V2_FLAG_ADDRESS.
+#define RECORD_V2_FLAG_NOCRC    (0x80)  // Frame was captured up to before the end of its CRC; the sniffer couldn't check it
+
+// CRC check of captured frames by the sniffer
+#define CRC_CHECK_OFF         (0)       // Send all frames, unchecked
+#define CRC_CHECK_TAG         (1)       // Send all frames; flag invalid & unchecked ones in RECORD_FORMAT_V2 records
+#define CRC_CHECK_DROP        (2)       // Drop invalid & unchecked frames before they're buffered
+
+// Framing of the stream from sniffer to host. Host to sniffer is never framed.
+#define FRAMING_NONE          (0)       // Messages back to back
+#define FRAMING_COBS          (1)       // Each message followed by its CRC16, COBS encoded and terminated by a 0 byte
+#define FRAME_DELIMITER       (0x00)
+#define FRAME_CRC_SIZE        (2)
+#define MAX_FRAME_SIZE        (1 + MAX_MSG_LEN + FRAME_CRC_SIZE + 1 + 1) // lenAndType, message, CRC, COBS overhead & delimiter
+
+// Channel hopping: the sniffer cycles through a table of channels, listening on each for its dwell time.
+// An empty table keeps the radio on the configured channel.
+#define RF_NUM_CHANNELS       (126)     // nRF24 channels 0..125, 2400..2525 MHz
+#define MAX_HOP_CHANNELS      (RF_NUM_CHANNELS)
+
+// Packet filter, evaluated by the sniffer before a packet is buffered
+#define MAX_FILTER_RULES      (8)
+#define FILTER_DATA_LEN       (4)       // Consecutive payload bytes a rule can match on
+#define FILTER_ACTION_PASS    (0)       // Capture packets matching the rule
+#define FILTER_ACTION_DROP    (1)       // Drop packets matching the rule
+
+#ifndef RF_MAX_ADDR_WIDTH
+#define RF_MAX_ADDR_WIDTH       (5)     // Maximum nRF24 address width, in bytes
+#endif
+
+// RX pipes of the nRF24. Pipe 0 listens on the base address, pipe 1 on its own address and
+// pipes 2..5 on the address of pipe 1 with a different least significant byte.
+#define RF_MAX_PIPES            (6)
+#define PIPES_DEFAULT           (0x01)  // Pipe 0 only
+
+// Radios of the sniffer, capturing in parallel into one stream in timestamp order. Radio 0 follows
+// Serial_config_t, including pipes, hopping & survey. The others listen on pipe 0 only, on a channel
+// & address of their own and with the other settings of radio 0.
+#define RF_MAX_RADIOS           (4)
+
+typedef struct _Serial_config_t
+{
+  uint8_t version;                     // SNIFF_PROTOCOL_VERSION of the sender
+  uint8_t channel;
+  uint8_t rate;                        // rf24_datarate_e: 0 = 1Mb/s, 1 = 2Mb/s, 2 = 250Kb/s
+  uint8_t addressLen;                  // Number of bytes used in address, range [2..5]
+  uint8_t addressPromiscLen;           // Number of bytes used in promiscuous address, range [2..5]. E.g. addressLen=5, addressPromiscLen=4 => 1 byte unique identifier.
+  uint64_t address;                    // Base address, LSB first.
+  uint8_t crcLength;                   // Length of active CRC, range [0..2]
+  uint8_t maxPayloadSize;              // Maximum size of payload for nRF (including nRF header), range[4?..32]
+  uint16_t bufferSize;                 // Capture buffer size in KiB, shared by the radios, each part rounded down to a power of two. 0 = keep current size.
+  uint32_t baudrate;                   // Serial baudrate to switch to after this config is echoed. 0 = keep current baudrate.
+  uint8_t recordFormat;                // Encoding of MSG_TYPE_PACKET records, one of RECORD_FORMAT_xxx
+  uint8_t framing;                     // Framing of sniffer output, one of FRAMING_xxx. Applies from the echo of this config on.
+  uint8_t crcCheck;                    // One of CRC_CHECK_xxx
+  uint8_t captureMode;                 // One of CAPTURE_MODE_xxx
+  uint16_t summaryInterval;            // Interval of CAPTURE_MODE_NODE_STATS & CAPTURE_MODE_SURVEY summaries, in ms. 0 = sniffer default.
+  uint8_t snapLen;                     // Payload bytes sent per frame, or SNAPLEN_ALL. Address, control field & CRC verdict are always sent.
+  uint8_t pipes;                       // Bitmask of RX pipes listening, bit n = pipe n. Bit 0 = address.
+  uint64_t pipeAddress;                // Address of pipe 1, same layout as address.
+  uint8_t pipeLsb[RF_MAX_PIPES-2];     // Address of pipes 2..5: pipeAddress with this LSB of its promiscuous part.
+} Serial_config_t;
+
+#define SERIAL_CONFIG_SIZE      (1+1+1+1+1+8+1+1+2+4+1+1+1+1+2+1+1+8+(RF_MAX_PIPES-2))
+
+typedef struct _Serial_stats_t
+{
+  uint32_t bufferSize;                 // Capture buffer size, in bytes.
+  uint32_t bufferUsed;                 // Bytes in use in capture buffer when the stats were sent.
+  uint32_t bufferHighWater;            // Maximum bytes in use since the capture buffer was (re)allocated.
+  uint32_t txBytesPerSec;              // Serial throughput over the last stats interval.
+  uint32_t txRecordsPerSec;            // Records sent per second over the last stats interval.
+  uint32_t txStalls;                   // Times serial output was held back because the UART couldn't keep up.
+  uint32_t packetsDropped;             // Packets dropped because the capture buffer was full.
+  uint32_t packetsBadCrc;              // Packets with an invalid CRC, tagged or dropped as per crcCheck.
+} Serial_stats_t;
+
+#define SERIAL_STATS_SIZE       (8*4)
+
+// Rules are evaluated in order and the first matching rule decides. A packet matching no rule
+// is captured, unless the table holds a FILTER_ACTION_PASS rule. An empty table captures all.
+// All criteria of a rule must match; a mask of 0 matches anything.
+typedef struct _Filter_rule_t
+{
+  uint8_t action;                      // One of FILTER_ACTION_xxx
+  uint32_t node;                       // Address bytes not in the promiscuous address, MSB first
+  uint32_t nodeMask;
+  uint8_t minLen;                      // Payload length range, inclusive
+  uint8_t maxLen;
+  uint8_t pid;                         // Packet ID from the ESB control field
+  uint8_t pidMask;
+  uint8_t dataOffset;                  // Offset of data in the payload
+  uint8_t data[FILTER_DATA_LEN];
+  uint8_t dataMask[FILTER_DATA_LEN];
+} Filter_rule_t;
+
+#define FILTER_RULE_SIZE        (1+4+4+1+1+1+1+1+FILTER_DATA_LEN+FILTER_DATA_LEN)
+
+typedef struct _Filter_hits_t
+{
+  uint8_t numRules;                    // Number of rules in the table
+  uint32_t filtered;                   // Packets dropped by the filter
+  uint32_t hits[MAX_FILTER_RULES];     // Packets that matched each rule, passed or dropped
+} Filter_hits_t;
+
+#define FILTER_HITS_SIZE(numRules)  (1+4+4*(numRules))
+
+typedef struct _Node_stats_t
+{
+  uint32_t node;                       // Address bytes not in the promiscuous address, MSB first, with the radio in bits 31..28 & RX pipe in bits 27..24, or NODE_STATS_OTHER
+  uint32_t packets;                    // Packets with a valid CRC, or any packet when CRC check is off. With CRC check on, packets captured up to before the end of their CRC are left out.
+  uint32_t bytes;                      // Payload bytes of those packets
+  uint16_t retransmits;                // Packets with the same PID as the previous packet of the node
+  uint16_t crcFails;                   // Packets with an invalid CRC; requires CRC check
+  uint32_t gapMin;                     // Time between consecutive packets of the node, in [us]. 0 when none.
+  uint32_t gapMax;
+  uint32_t gapMean;
+} Node_stats_t;
+
+#define NODE_STATS_SIZE         (4+4+4+2+2+4+4+4)
+
+typedef struct _Hop_range_t
+{
+  uint8_t firstChannel;                // Channels firstChannel..lastChannel are added to the hop table, in order
+  uint8_t lastChannel;
+  uint16_t dwellMs;                    // Time spent listening on each of them per cycle, in [ms]
+} Hop_range_t;
+
+#define HOP_RANGE_SIZE          (1+1+2)
+
+typedef struct _Channel_stats_t
+{
+  uint8_t channel;
+  uint32_t packets;                    // Frames heard on the channel, before CRC check & filter
+  uint32_t packetsCrcOk;               // Of which with a verified valid CRC; all of them when CRC check is off
+  uint32_t listenMs;                   // Time spent listening on the channel, in [ms]
+} Channel_stats_t;
+
+#define CHANNEL_STATS_SIZE      (1+4+4+4)
+
+typedef struct _Radio_config_t
+{
+  uint8_t channel;
+  uint64_t address;                    // Address of pipe 0, same layout as Serial_config_t address
+} Radio_config_t;
+
+#define RADIO_CONFIG_SIZE       (1+8)
+
+// Received power detector survey: fraction of RPD samples that found a signal => -64dBm on each channel.
+// The channels 0..RF_NUM_CHANNELS-1 are sent in blocks of SURVEY_BLOCK_CHANNELS.
+#define SURVEY_BLOCK_CHANNELS   (RF_NUM_CHANNELS/3)
+
+typedef struct _Survey_t
+{
+  uint8_t firstChannel;
+  uint8_t numChannels;
+  uint16_t samples;                    // RPD samples taken on each channel
+  uint8_t hitRatio[SURVEY_BLOCK_CHANNELS]; // Fraction of samples with a signal, 0..255 = 0..100%
+} Survey_t;
+
+#define SURVEY_SIZE(numChannels)  (1+1+2+(numChannels))
+
+// RECORD_FORMAT_V1 packet header: timestamp (4), packetsLost (1) and promiscuous part of the address, MSB first.
+#define SERIAL_HEADER_V1_SIZE(addrLen)  (4+1+(addrLen))
+
+static_assert(SERIAL_CONFIG_SIZE <= MAX_MSG_LEN, "Config must fit in a single message");
+static_assert(SERIAL_STATS_SIZE <= MAX_MSG_LEN, "Stats must fit in a single message");
+static_assert(1 + FILTER_RULE_SIZE <= MAX_MSG_LEN, "Filter rule must fit in a single control message");
+static_assert(1 + FILTER_HITS_SIZE(MAX_FILTER_RULES) <= MAX_MSG_LEN, "Filter hits must fit in a single control message");
+static_assert(1 + NODE_STATS_SIZE <= MAX_MSG_LEN, "Node stats must fit in a single control message");
+static_assert(1 + HOP_RANGE_SIZE <= MAX_MSG_LEN, "Hop range must fit in a single control message");
+static_assert(1 + CHANNEL_STATS_SIZE <= MAX_MSG_LEN, "Channel stats must fit in a single control message");
+static_assert(1 + SURVEY_SIZE(SURVEY_BLOCK_CHANNELS) <= MAX_MSG_LEN, "Survey block must fit in a single control message");
+static_assert(1 + RADIO_CONFIG_SIZE <= MAX_MSG_LEN, "Radio config must fit in a single control message");
+static_assert(SERIAL_HEADER_V1_SIZE(RF_MAX_ADDR_WIDTH) + 1 + 32 + 2 <= MAX_MSG_LEN, "Largest v1 packet record must fit in a single message");
+
+// Bytes kept of a captured frame of frameLen bytes under Serial_config_t.snapLen: the nodeLen address
+// bytes, the control field & snapLen payload bytes. The 9-bit control field puts the payload 1 bit into
+// the byte following the control byte, so payload byte n ends in frame byte nodeLen + 2 + n.
+static inline uint8_t snapFrameLen(const uint8_t frameLen, const uint8_t nodeLen, const uint8_t snapLen)
+{
+  if ((snapLen == SNAPLEN_ALL) || (frameLen <= nodeLen + 2 + snapLen))
+    return frameLen;
+  return nodeLen + 2 + snapLen;
+}
+
+static inline uint8_t* putU16(uint8_t* p, const uint16_t v)
+{
+  *p++ = (uint8_t)v;
+  *p++ = (uint8_t)(v >> 8);
+  return p;
+}
+
+static inline uint8_t* putU32(uint8_t* p, const uint32_t v)
+{
+  p = putU16(p, (uint16_t)v);
+  return putU16(p, (uint16_t)(v >> 16));
+}
+
+static inline uint8_t* putU64(uint8_t* p, const uint64_t v)
+{
+  p = putU32(p, (uint32_t)v);
+  return putU32(p, (uint32_t)(v >> 32));
+}
+
+static inline uint16_t getU16(const uint8_t* p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t getU32(const uint8_t* p)
+{
+  return getU16(p) | ((uint32_t)getU16(p + 2) << 16);
+}
+
+static inline uint64_t getU64(const uint8_t* p)
+{
+  return getU32(p) | ((uint64_t)getU32(p + 4) << 32);
+}
+
+// Returns number of bytes written, always SERIAL_CONFIG_SIZE.
+static inline uint8_t serializeConfig(const Serial_config_t& c, uint8_t* buf)
+{
+  uint8_t* p = buf;
+  *p++ = c.version;
+  *p++ = c.channel;
+  *p++ = c.rate;
+  *p++ = c.addressLen;
+  *p++ = c.addressPromiscLen;
+  p = putU64(p, c.address);
+  *p++ = c.crcLength;
+  *p++ = c.maxPayloadSize;
+  p = putU16(p, c.bufferSize);
+  p = putU32(p, c.baudrate);
+  *p++ = c.recordFormat;
+  *p++ = c.framing;
+  *p++ = c.crcCheck;
+  *p++ = c.captureMode;
+  p = putU16(p, c.summaryInterval);
+  *p++ = c.snapLen;
+  *p++ = c.pipes;
+  p = putU64(p, c.pipeAddress);
+  for (uint8_t i = 0; i < RF_MAX_PIPES-2; ++i)
+    *p++ = c.pipeLsb[i];
+  return (uint8_t)(p - buf);
+}
+
+// Returns false when the message is not a config of our protocol version; c is left untouched then.
+static inline bool deserializeConfig(const uint8_t* buf, const uint8_t len, Serial_config_t& c)
+{
+  if ((len != SERIAL_CONFIG_SIZE) || (buf[0] != SNIFF_PROTOCOL_VERSION))
+    return false;
+  const uint8_t* p = buf;
+  c.version           = *p++;
+  c.channel           = *p++;
+  c.rate              = *p++;
+  c.addressLen        = *p++;
+  c.addressPromiscLen = *p++;
+  c.address           = getU64(p); p += 8;
+  c.crcLength         = *p++;
+  c.maxPayloadSize    = *p++;
+  c.bufferSize        = getU16(p); p += 2;
+  c.baudrate          = getU32(p); p += 4;
+  c.recordFormat      = *p++;
+  c.framing           = *p++;
+  c.crcCheck          = *p++;
+  c.captureMode       = *p++;
+  c.summaryInterval   = getU16(p); p += 2;
+  c.snapLen           = *p++;
+  c.pipes             = *p++;
+  c.pipeAddress       = getU64(p); p += 8;
+  for (uint8_t i = 0; i < RF_MAX_PIPES-2; ++i)
+    c.pipeLsb[i] = *p++;
+  return true;
+}
+
+// Returns number of bytes written, always SERIAL_STATS_SIZE.
+static inline uint8_t serializeStats(const Serial_stats_t& s, uint8_t* buf)
+{
+  uint8_t* p = buf;
+  p = putU32(p, s.bufferSize);
+  p = putU32(p, s.bufferUsed);
+  p = putU32(p, s.bufferHighWater);
+  p = putU32(p, s.txBytesPerSec);
+  p = putU32(p, s.txRecordsPerSec);
+  p = putU32(p, s.txStalls);
+  p = putU32(p, s.packetsDropped);
+  p = putU32(p, s.packetsBadCrc);
+  return (uint8_t)(p - buf);
+}
+
+static inline bool deserializeStats(const uint8_t* buf, const uint8_t len, Serial_stats_t& s)
+{
+  if (len != SERIAL_STATS_SIZE)
+    return false;
+  s.bufferSize      = getU32(buf);
+  s.bufferUsed      = getU32(buf + 4);
+  s.bufferHighWater = getU32(buf + 8);
+  s.txBytesPerSec   = getU32(buf + 12);
+  s.txRecordsPerSec = getU32(buf + 16);
+  s.txStalls        = getU32(buf + 20);
+  s.packetsDropped  = getU32(buf + 24);
+  s.packetsBadCrc   = getU32(buf + 28);
+  return true;
+}
+
+// Returns number of bytes written, always FILTER_RULE_SIZE.
+static inline uint8_t serializeFilterRule(const Filter_rule_t& r, uint8_t* buf)
+{
+  uint8_t* p = buf;
+  *p++ = r.action;
+  p = putU32(p, r.node);
+  p = putU32(p, r.nodeMask);
+  *p++ = r.minLen;
+  *p++ = r.maxLen;
+  *p++ = r.pid;
+  *p++ = r.pidMask;
+  *p++ = r.dataOffset;
+  for (uint8_t i = 0; i < FILTER_DATA_LEN; ++i)
+    *p++ = r.data[i];
+  for (uint8_t i = 0; i < FILTER_DATA_LEN; ++i)
+    *p++ = r.dataMask[i];
+  return (uint8_t)(p - buf);
+}
+
+static inline bool deserializeFilterRule(const uint8_t* buf, const uint8_t len, Filter_rule_t& r)
+{
+  if (len != FILTER_RULE_SIZE)
+    return false;
+  const uint8_t* p = buf;
+  r.action     = *p++;
+  r.node       = getU32(p); p += 4;
+  r.nodeMask   = getU32(p); p += 4;
+  r.minLen     = *p++;
+  r.maxLen     = *p++;
+  r.pid        = *p++;
+  r.pidMask    = *p++;
+  r.dataOffset = *p++;
+  for (uint8_t i = 0; i < FILTER_DATA_LEN; ++i)
+    r.data[i] = *p++;
+  for (uint8_t i = 0; i < FILTER_DATA_LEN; ++i)
+    r.dataMask[i] = *p++;
+  return true;
+}
+
+// Returns number of bytes written, FILTER_HITS_SIZE(h.numRules).
+static inline uint8_t serializeFilterHits(const Filter_hits_t& h, uint8_t* buf)
+{
+  uint8_t* p = buf;
+  *p++ = h.numRules;
+  p = putU32(p, h.filtered);
+  for (uint8_t i = 0; i < h.numRules; ++i)
+    p = putU32(p, h.hits[i]);
+  return (uint8_t)(p - buf);
+}
+
+static inline bool deserializeFilterHits(const uint8_t* buf, const uint8_t len, Filter_hits_t& h)
+{
+  if ((len < FILTER_HITS_SIZE(0)) || (buf[0] > MAX_FILTER_RULES) || (len != FILTER_HITS_SIZE(buf[0])))
+    return false;
+  h.numRules = buf[0];
+  h.filtered = getU32(buf + 1);
+  for (uint8_t i = 0; i < h.numRules; ++i)
+    h.hits[i] = getU32(buf + FILTER_HITS_SIZE(i));
+  return true;
+}
+
+// Returns number of bytes written, always NODE_STATS_SIZE.
+static inline uint8_t serializeNodeStats(const Node_stats_t& n, uint8_t* buf)
+{
+  uint8_t* p = buf;
+  p = putU32(p, n.node);
+  p = putU32(p, n.packets);
+  p = putU32(p, n.bytes);
+  p = putU16(p, n.retransmits);
+  p = putU16(p, n.crcFails);
+  p = putU32(p, n.gapMin);
+  p = putU32(p, n.gapMax);
+  p = putU32(p, n.gapMean);
+  return (uint8_t)(p - buf);
+}
+
+static inline bool deserializeNodeStats(const uint8_t* buf, const uint8_t len, Node_stats_t& n)
+{
+  if (len != NODE_STATS_SIZE)
+    return false;
+  n.node        = getU32(buf);
+  n.packets     = getU32(buf + 4);
+  n.bytes       = getU32(buf + 8);
+  n.retransmits = getU16(buf + 12);
+  n.crcFails    = getU16(buf + 14);
+  n.gapMin      = getU32(buf + 16);
+  n.gapMax      = getU32(buf + 20);
+  n.gapMean     = getU32(buf + 24);
+  return true;
+}
+
+// Returns number of bytes written, always HOP_RANGE_SIZE.
+static inline uint8_t serializeHopRange(const Hop_range_t& r, uint8_t* buf)
+{
+  uint8_t* p = buf;
+  *p++ = r.firstChannel;
+  *p++ = r.lastChannel;
+  p = putU16(p, r.dwellMs);
+  return (uint8_t)(p - buf);
+}
+
+static inline bool deserializeHopRange(const uint8_t* buf, const uint8_t len, Hop_range_t& r)
+{
+  if (len != HOP_RANGE_SIZE)
+    return false;
+  r.firstChannel = buf[0];
+  r.lastChannel  = buf[1];
+  r.dwellMs      = getU16(buf + 2);
+  return true;
+}
+
+// Returns number of bytes written, always CHANNEL_STATS_SIZE.
+static inline uint8_t serializeChannelStats(const Channel_stats_t& c, uint8_t* buf)
+{
+  uint8_t* p = buf;
+  *p++ = c.channel;
+  p = putU32(p, c.packets);
+  p = putU32(p, c.packetsCrcOk);
+  p = putU32(p, c.listenMs);
+  return (uint8_t)(p - buf);
+}
+
+static inline bool deserializeChannelStats(const uint8_t* buf, const uint8_t len, Channel_stats_t& c)
+{
+  if (len != CHANNEL_STATS_SIZE)
+    return false;
+  c.channel      = buf[0];
+  c.packets      = getU32(buf + 1);
+  c.packetsCrcOk = getU32(buf + 5);
+  c.listenMs     = getU32(buf + 9);
+  return true;
+}
+
+// Returns number of bytes written, always RADIO_CONFIG_SIZE.
+static inline uint8_t serializeRadioConfig(const Radio_config_t& r, uint8_t* buf)
+{
+  uint8_t* p = buf;
+  *p++ = r.channel;
+  p = putU64(p, r.address);
+  return (uint8_t)(p - buf);
+}
+
+static inline bool deserializeRadioConfig(const uint8_t* buf, const uint8_t len, Radio_config_t& r)
+{
+  if (len != RADIO_CONFIG_SIZE)
+    return false;
+  r.channel = buf[0];
+  r.address = getU64(buf + 1);
+  return true;
+}
+
+// Returns number of bytes written, SURVEY_SIZE(s.numChannels).
+static inline uint8_t serializeSurvey(const Survey_t& s, uint8_t* buf)
+{
+  uint8_t* p = buf;
+  *p++ = s.firstChannel;
+  *p++ = s.numChannels;
+  p = putU16(p, s.samples);
+  for (uint8_t i = 0; i < s.numChannels; ++i)
+    *p++ = s.hitRatio[i];
+  return (uint8_t)(p - buf);
+}
+
+static inline bool deserializeSurvey(const uint8_t* buf, const uint8_t len, Survey_t& s)
+{
+  if ((len < SURVEY_SIZE(0)) || (buf[1] > SURVEY_BLOCK_CHANNELS) || (len != SURVEY_SIZE(buf[1])))
+    return false;
+  s.firstChannel = buf[0];
+  s.numChannels  = buf[1];
+  s.samples      = getU16(buf + 2);
+  for (uint8_t i = 0; i < s.numChannels; ++i)
+    s.hitRatio[i] = buf[SURVEY_SIZE(i)];
+  return true;
+}
+
+// Returns number of bytes written, SERIAL_HEADER_V1_SIZE(addrLen).
+static inline uint8_t serializeHeaderV1(const uint32_t timestamp, const uint8_t packetsLost,
+                                        const uint8_t* address, const uint8_t addrLen, uint8_t* buf)
+{
+  uint8_t* p = putU32(buf, timestamp);
+  *p++ = packetsLost;
+  for (uint8_t i = 0; i < addrLen; ++i)
+    *p++ = address[i];
+  return (uint8_t)(p - buf);
+}
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), as used per frame.
+static inline uint16_t crc16Frame(const uint8_t* data, uint8_t len, uint16_t crc = 0xFFFF)
+{
+  while (len--)
+  {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (uint8_t i = 0; i < 8; ++i)
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+// Consistent Overhead Byte Stuffing: removes all 0 bytes, so 0 can delimit frames.
+// out must hold len + len/254 + 1 bytes. Returns number of bytes written, excluding delimiter.
+static inline uint8_t cobsEncode(const uint8_t* in, const uint8_t len, uint8_t* out)
+{
+  uint8_t* code = out;                 // Position of current code byte
+  uint8_t* p = out + 1;
+  uint8_t run = 1;
+  for (uint8_t i = 0; i < len; ++i)
+  {
+    if (in[i] == 0)
+    {
+      *code = run;
+      code = p++;
+      run = 1;
+      continue;
+    }
+    *p++ = in[i];
+    if (++run == 0xFF)
+    {
+      *code = run;
+      code = p++;
+      run = 1;
+    }
+  }
+  *code = run;
+  return (uint8_t)(p - out);
+}
+
+// Decode a COBS frame, excluding delimiter. Returns decoded length, or -1 when malformed.
+static inline int cobsDecode(const uint8_t* in, const uint8_t len, uint8_t* out)
+{
+  const uint8_t* end = in + len;
+  uint8_t* p = out;
+  while (in < end)
+  {
+    const uint8_t code = *in++;
+    if ((code == 0) || (in + code - 1 > end))
+      return -1;
+    for (uint8_t i = 1; i < code; ++i)
+      *p++ = *in++;
+    if ((code != 0xFF) && (in < end))
+      *p++ = 0;
+  }
+  return (int)(p - out);
+}
+
+// Unpack a frame (COBS data, excluding delimiter) into lenAndType & message.
+// Returns length of lenAndType & message, or -1 on a malformed frame or CRC mismatch.
+static inline int decodeFrame(const uint8_t* frame, const uint8_t len, uint8_t* msg)
+{
+  uint8_t decoded[MAX_FRAME_SIZE];
+  if (len > sizeof(decoded))
+    return -1;
+  const int n = cobsDecode(frame, len, decoded);
+  if ((n < 1 + FRAME_CRC_SIZE) || (GET_MSG_LEN(decoded[0]) != n - 1 - FRAME_CRC_SIZE))
+    return -1;
+  const uint8_t msgLen = (uint8_t)(n - FRAME_CRC_SIZE);
+  if (crc16Frame(decoded, msgLen) != getU16(decoded + msgLen))
+    return -1;
+  for (uint8_t i = 0; i < msgLen; ++i)
+    msg[i] = decoded[i];
+  return msgLen;
+}
+
+#endif // NRF24_sniff_protocol_h
@@ -0,0 +1,143 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include <stdint.h>
+
+#include "main.h"
+#include "NodeStats.h"
+
+NodeStats::NodeStats()
+{
+    clear();
+}
+
+void NodeStats::clear()
+{
+    for (uint8_t i = 0; i < NODE_STATS_TABLE_SIZE; ++i)
+        m_table[i].used = false;
+    m_numNodes = 0;
+    resetCounters(m_other, NODE_STATS_OTHER);
+}
+
+uint32_t NodeStats::nodeKey(uint8_t radio, uint8_t pipe, const uint8_t *frame, uint8_t nodeLen)
+{
+    uint32_t node = 0;
+    for (uint8_t n = 0; n < nodeLen; ++n)
+        node = (node << 8) | frame[n];
+    // Radio & pipe go in after the address bytes, which would otherwise shift them out.
+    return ((uint32_t)radio << 28) | ((uint32_t)pipe << 24) | (node & 0x00FFFFFFUL);
+}
+
+void NodeStats::resetCounters(Node_stats_t &stats, uint32_t node)
+{
+    stats.node = node;
+    stats.packets = 0;
+    stats.bytes = 0;
+    stats.retransmits = 0;
+    stats.crcFails = 0;
+    stats.gapMin = 0;
+    stats.gapMax = 0;
+    stats.gapMean = 0;
+}
+
+NodeStats::Entry *NodeStats::find(uint32_t node, bool insert)
+{
+    // Fibonacci hashing; node addresses tend to be small, consecutive numbers.
+    uint8_t i = (uint32_t)(node * 2654435761UL) >> (32 - NODE_STATS_TABLE_BITS);
+    for (;;)
+    {
+        Entry &e = m_table[i];
+        if (!e.used)
+            break;
+        if (e.node == node)
+            return &e;
+        i = (i + 1) & (NODE_STATS_TABLE_SIZE - 1);
+    }
+    if (!insert || (m_numNodes >= NODE_STATS_MAX_NODES))
+        return NULL;
+
+    Entry &e = m_table[i];
+    e.node = node;
+    e.used = true;
+    e.haveLast = false;
+    e.gapSum = 0;
+    e.gaps = 0;
+    resetCounters(e.stats, node);
+    m_numNodes++;
+    return &e;
+}
+
+void NodeStats::add(uint32_t node, uint8_t payloadLen, uint8_t pid, bool crcOk, uint32_t timestamp)
+{
+    Entry *e = find(node, crcOk);
+    if (!e)
+    {
+        if (crcOk)
+        {
+            m_other.packets++;
+            m_other.bytes += payloadLen;
+        }
+        else
+        {
+            m_other.crcFails++;
+        }
+        return;
+    }
+    if (!crcOk)
+    {
+        if (e->stats.crcFails < 0xFFFF)
+            e->stats.crcFails++;
+        return;
+    }
+
+    e->stats.packets++;
+    e->stats.bytes += payloadLen;
+    if (e->haveLast)
+    {
+        // The receiver discards a packet carrying the same PID as the previous one: a retransmit.
+        if ((pid == e->lastPid) && (e->stats.retransmits < 0xFFFF))
+            e->stats.retransmits++;
+        const uint32_t gap = timestamp - e->lastTimestamp;
+        if ((e->gaps == 0) || (gap < e->stats.gapMin))
+            e->stats.gapMin = gap;
+        if (gap > e->stats.gapMax)
+            e->stats.gapMax = gap;
+        e->gapSum += gap;
+        e->gaps++;
+    }
+    e->haveLast = true;
+    e->lastPid = pid;
+    e->lastTimestamp = timestamp;
+}
+
+uint8_t NodeStats::collect(Node_stats_t *stats)
+{
+    Entry active[NODE_STATS_MAX_NODES];
+    uint8_t numActive = 0;
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < NODE_STATS_TABLE_SIZE; ++i)
+    {
+        Entry &e = m_table[i];
+        if (!e.used || ((e.stats.packets == 0) && (e.stats.crcFails == 0)))
+            continue;
+        if (e.gaps)
+            e.stats.gapMean = e.gapSum / e.gaps;
+        stats[n++] = e.stats;
+        // Keep last PID & timestamp, so retransmits & gaps spanning intervals are seen.
+        if (e.stats.packets)
+            active[numActive++] = e;
+    }
+    if (m_other.packets || m_other.crcFails)
+        stats[n++] = m_other;
+
+    // Rebuild the table from the nodes heard this interval.
+    clear();
+    for (uint8_t i = 0; i < numActive; ++i)
+    {
+        Entry *e = find(active[i].node, true);
+        e->haveLast = active[i].haveLast;
+        e->lastPid = active[i].lastPid;
+        e->lastTimestamp = active[i].lastTimestamp;
+    }
+    return n;
+}
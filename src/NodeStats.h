@@ -0,0 +1,56 @@
+#ifndef NodeStats_h
+#define NodeStats_h
+
+#include <stdint.h>
+
+#include "NRF24_sniff_protocol.h"
+
+#define NODE_STATS_TABLE_BITS (5)
+#define NODE_STATS_TABLE_SIZE (1 << NODE_STATS_TABLE_BITS)
+#define NODE_STATS_MAX_NODES (NODE_STATS_TABLE_SIZE * 3 / 4) // Keeps probe sequences short; further nodes count as NODE_STATS_OTHER.
+
+// Per node statistics over a summary interval, kept in an open addressing hash table keyed by node address.
+// add() runs in the capture task; clear() and collect() must not run concurrently with it.
+class NodeStats
+{
+public:
+    NodeStats();
+
+    // Node of a frame as in Node_stats_t: the nodeLen address bytes in front of its control field, with
+    // the radio & RX pipe it was received by.
+    static uint32_t nodeKey(uint8_t radio, uint8_t pipe, const uint8_t *frame, uint8_t nodeLen);
+
+    // Forget all nodes.
+    void clear();
+
+    // Account a frame. Frames failing the CRC only count for nodes seen before, so noise
+    // matching the promiscuous address doesn't fill the table with bogus nodes.
+    void add(uint32_t node, uint8_t payloadLen, uint8_t pid, bool crcOk, uint32_t timestamp);
+
+    // Fetch the statistics of the interval that just ended and start a new one. Nodes that were
+    // silent all interval are dropped from the table. stats must hold NODE_STATS_MAX_NODES + 1
+    // entries; returns the number filled in.
+    uint8_t collect(Node_stats_t *stats);
+
+private:
+    struct Entry
+    {
+        uint32_t node;
+        bool used;
+        bool haveLast; // lastPid & lastTimestamp are valid.
+        uint8_t lastPid;
+        uint32_t lastTimestamp;
+        uint32_t gapSum;
+        uint32_t gaps;
+        Node_stats_t stats;
+    };
+
+    Entry m_table[NODE_STATS_TABLE_SIZE];
+    uint8_t m_numNodes;
+    Node_stats_t m_other; // Nodes that didn't fit in the table.
+
+    Entry *find(uint32_t node, bool insert);
+    static void resetCounters(Node_stats_t &stats, uint32_t node);
+};
+
+#endif // NodeStats_h
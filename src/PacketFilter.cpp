@@ -0,0 +1,97 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include <stdint.h>
+
+#include "main.h"
+#include "PacketFilter.h"
+
+PacketFilter::PacketFilter()
+{
+    clear();
+}
+
+void PacketFilter::clear()
+{
+    m_numRules = 0;
+    m_havePass = false;
+    m_filtered = 0;
+    for (uint8_t i = 0; i < MAX_FILTER_RULES; ++i)
+        m_hits[i] = 0;
+}
+
+bool PacketFilter::add(const Filter_rule_t &rule)
+{
+    if ((m_numRules >= MAX_FILTER_RULES) || (rule.action > FILTER_ACTION_DROP) || (rule.minLen > rule.maxLen))
+        return false;
+    m_rules[m_numRules] = rule;
+    m_hits[m_numRules] = 0;
+    m_numRules++;
+    if (rule.action == FILTER_ACTION_PASS)
+        m_havePass = true;
+    return true;
+}
+
+bool PacketFilter::matchRule(const Filter_rule_t &rule, const uint8_t *frame, uint8_t nodeLen, uint8_t frameLen)
+{
+    if (rule.nodeMask)
+    {
+        uint32_t node = 0;
+        for (uint8_t i = 0; i < nodeLen; ++i)
+            node = (node << 8) | frame[i];
+        if ((node ^ rule.node) & rule.nodeMask)
+            return false;
+    }
+
+    // Control field: 6 bits payload length, 2 bits PID, 1 bit no-ack. The payload that follows
+    // is therefore shifted by one bit with respect to the bytes received.
+    const uint8_t *ctrl = frame + nodeLen;
+    const uint8_t payloadLen = ctrl[0] >> 2;
+    if ((payloadLen < rule.minLen) || (payloadLen > rule.maxLen))
+        return false;
+    if (((ctrl[0] ^ rule.pid) & rule.pidMask & 0x03) != 0)
+        return false;
+
+    for (uint8_t i = 0; i < FILTER_DATA_LEN; ++i)
+    {
+        if (!rule.dataMask[i])
+            continue;
+        const uint8_t pos = rule.dataOffset + i;
+        // Payload byte straddles two received bytes; both must have been captured.
+        if ((pos >= payloadLen) || (nodeLen + 2 + pos >= frameLen))
+            return false;
+        const uint8_t data = (uint8_t)((ctrl[1 + pos] << 1) | (ctrl[2 + pos] >> 7));
+        if ((data ^ rule.data[i]) & rule.dataMask[i])
+            return false;
+    }
+    return true;
+}
+
+bool PacketFilter::match(const uint8_t *frame, uint8_t nodeLen, uint8_t frameLen)
+{
+    for (uint8_t i = 0; i < m_numRules; ++i)
+    {
+        if (matchRule(m_rules[i], frame, nodeLen, frameLen))
+        {
+            m_hits[i] = m_hits[i] + 1;
+            if (m_rules[i].action == FILTER_ACTION_PASS)
+                return true;
+            m_filtered = m_filtered + 1;
+            return false;
+        }
+    }
+    if (m_havePass)
+    {
+        m_filtered = m_filtered + 1;
+        return false;
+    }
+    return true;
+}
+
+void PacketFilter::getHits(Filter_hits_t &hits) const
+{
+    hits.numRules = m_numRules;
+    hits.filtered = m_filtered;
+    for (uint8_t i = 0; i < m_numRules; ++i)
+        hits.hits[i] = m_hits[i];
+}
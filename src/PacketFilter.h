@@ -0,0 +1,39 @@
+#ifndef PacketFilter_h
+#define PacketFilter_h
+
+#include <stdint.h>
+
+#include "NRF24_sniff_protocol.h"
+
+// Table of filter rules, as sent by the host, applied to captured frames before they're buffered.
+// match() runs in the capture task; clear() and add() must not run concurrently with it.
+class PacketFilter
+{
+public:
+    PacketFilter();
+
+    // Remove all rules and reset the counters.
+    void clear();
+
+    // Append a rule. Returns false when the table is full or the rule is invalid.
+    bool add(const Filter_rule_t &rule);
+
+    uint8_t numRules() const { return m_numRules; }
+
+    // Test if a frame is to be captured and count the hit. The frame starts with the nodeLen
+    // address bytes not in the promiscuous address, followed by the ESB control field & payload.
+    bool match(const uint8_t *frame, uint8_t nodeLen, uint8_t frameLen);
+
+    void getHits(Filter_hits_t &hits) const;
+
+private:
+    Filter_rule_t m_rules[MAX_FILTER_RULES];
+    uint8_t m_numRules;
+    bool m_havePass; // Table holds a FILTER_ACTION_PASS rule, so unmatched packets are dropped.
+    volatile uint32_t m_hits[MAX_FILTER_RULES];
+    volatile uint32_t m_filtered;
+
+    static bool matchRule(const Filter_rule_t &rule, const uint8_t *frame, uint8_t nodeLen, uint8_t frameLen);
+};
+
+#endif // PacketFilter_h
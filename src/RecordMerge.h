@@ -0,0 +1,40 @@
+#ifndef RecordMerge_h
+#define RecordMerge_h
+
+#include <stdint.h>
+
+#include <ByteRing/ByteRing.h>
+#include "NRF24_sniff_types.h"
+
+// Radio holding the oldest record of the capture buffers of numRadios radios, with that record, or -1 when
+// there's nothing to send. While another capturing radio's buffer is empty, a record is held back until
+// holdBackUs old at nowUs, as that radio may still be draining an older frame; so the stream goes out in
+// timestamp order. Radio needs a ByteRing packetBuffer of NRF24_packet_t records and a bool active.
+template <typename Radio>
+static int8_t nextRecord(Radio *radios, const uint8_t numRadios, const uint32_t nowUs, const uint32_t holdBackUs,
+                         NRF24_packet_t *&p, uint32_t &recordLen)
+{
+    int8_t oldest = -1;
+    bool anyEmpty = false;
+    for (uint8_t id = 0; id < numRadios; ++id)
+    {
+        uint32_t len;
+        NRF24_packet_t *q = (NRF24_packet_t *)radios[id].packetBuffer.front(len);
+        if (!q)
+        {
+            anyEmpty = anyEmpty || radios[id].active;
+            continue;
+        }
+        if ((oldest < 0) || ((int32_t)(q->timestamp - p->timestamp) < 0))
+        {
+            oldest = id;
+            p = q;
+            recordLen = len;
+        }
+    }
+    if ((oldest >= 0) && anyEmpty && (nowUs - p->timestamp < holdBackUs))
+        return -1;
+    return oldest;
+}
+
+#endif // RecordMerge_h
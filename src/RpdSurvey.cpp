@@ -0,0 +1,50 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include <stdint.h>
+
+#include "main.h"
+#include "RpdSurvey.h"
+
+RpdSurvey::RpdSurvey()
+{
+    clear();
+}
+
+void RpdSurvey::clear()
+{
+    for (uint8_t ch = 0; ch < RF_NUM_CHANNELS; ++ch)
+    {
+        m_hits[ch] = 0;
+        m_samples[ch] = 0;
+    }
+}
+
+void RpdSurvey::add(uint8_t channel, uint8_t hits, uint8_t samples)
+{
+    // Saturate; the ratio is what counts. Stop counting hits too, so it stays correct.
+    if ((channel >= RF_NUM_CHANNELS) || (m_samples[channel] > 0xFFFF - samples))
+        return;
+    m_hits[channel] += hits;
+    m_samples[channel] += samples;
+}
+
+void RpdSurvey::collect(Survey_t *survey)
+{
+    for (uint8_t b = 0; b < RPD_SURVEY_BLOCKS; ++b)
+    {
+        Survey_t &s = survey[b];
+        s.firstChannel = b * SURVEY_BLOCK_CHANNELS;
+        s.numChannels = RF_NUM_CHANNELS - s.firstChannel;
+        if (s.numChannels > SURVEY_BLOCK_CHANNELS)
+            s.numChannels = SURVEY_BLOCK_CHANNELS;
+        s.samples = m_samples[s.firstChannel];
+        for (uint8_t i = 0; i < s.numChannels; ++i)
+        {
+            const uint8_t ch = s.firstChannel + i;
+            // Rounded to the nearest 1/255th.
+            s.hitRatio[i] = m_samples[ch] ? ((uint32_t)m_hits[ch] * 255 + m_samples[ch] / 2) / m_samples[ch] : 0;
+        }
+    }
+    clear();
+}
@@ -0,0 +1,34 @@
+#ifndef RpdSurvey_h
+#define RpdSurvey_h
+
+#include <stdint.h>
+
+#include "NRF24_sniff_protocol.h"
+
+#define RPD_SURVEY_SAMPLES (4) // RPD reads per channel per sweep; the retune & settle time dominates anyway.
+
+// Received power detector hits per channel over a summary interval, for CAPTURE_MODE_SURVEY.
+// add() runs in the capture task; clear() and collect() must not run concurrently with it.
+class RpdSurvey
+{
+public:
+    RpdSurvey();
+
+    // Reset all counters.
+    void clear();
+
+    // Account the samples of one visit to a channel.
+    void add(uint8_t channel, uint8_t hits, uint8_t samples);
+
+    // Fetch the hit ratios of the interval that just ended, in blocks of SURVEY_BLOCK_CHANNELS,
+    // and start a new one. survey must hold RPD_SURVEY_BLOCKS entries.
+    void collect(Survey_t *survey);
+
+private:
+    uint16_t m_hits[RF_NUM_CHANNELS];
+    uint16_t m_samples[RF_NUM_CHANNELS];
+};
+
+#define RPD_SURVEY_BLOCKS ((RF_NUM_CHANNELS + SURVEY_BLOCK_CHANNELS - 1) / SURVEY_BLOCK_CHANNELS)
+
+#endif // RpdSurvey_h
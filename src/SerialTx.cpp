@@ -0,0 +1,177 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include <stdint.h>
+#include <string.h>
+
+#include "main.h"
+#include "SerialTx.h"
+
+// Two hex digits for every byte value; 512 bytes in flash.
+static const char hexTable[256 * 2 + 1] =
+    "000102030405060708090a0b0c0d0e0f"
+    "101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f"
+    "303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f"
+    "505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f"
+    "707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f"
+    "909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+    "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+    "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+SerialTx::SerialTx(HardwareSerial &serial, bool hexOutput)
+    : m_serial(serial), m_hexOutput(hexOutput), m_framed(false), m_recordLen(0), m_head(0), m_tail(0),
+      m_bytesWritten(0), m_recordsFramed(0), m_lastRateMs(0), m_bytesPerSec(0), m_recordsPerSec(0), m_stalls(0),
+      m_blocked(false)
+{
+}
+
+SerialTx::~SerialTx()
+{
+}
+
+void SerialTx::setFraming(bool framed)
+{
+    m_framed = framed && !m_hexOutput;
+    m_recordLen = 0;
+}
+
+bool SerialTx::hasRoom(size_t len) const
+{
+    if (m_hexOutput)
+        len *= 3;
+    else if (m_framed)
+        len += FRAME_CRC_SIZE + 2 + len / 254;
+    return sizeof(m_buff) - (m_tail - m_head) >= len;
+}
+
+void SerialTx::makeRoom(size_t len)
+{
+    if (m_tail + len <= sizeof(m_buff))
+        return;
+    // Move unwritten data to the start of the buffer.
+    memmove(m_buff, m_buff + m_head, m_tail - m_head);
+    m_tail -= m_head;
+    m_head = 0;
+    if (m_tail + len > sizeof(m_buff))
+    {
+        // Caller didn't check for room; block rather than losing data.
+        flushAll();
+    }
+}
+
+void SerialTx::put(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    if (m_framed)
+    {
+        // Collect the whole record; it's encoded when complete.
+        if (len > sizeof(m_record) - FRAME_CRC_SIZE - m_recordLen)
+            len = sizeof(m_record) - FRAME_CRC_SIZE - m_recordLen;
+        memcpy(m_record + m_recordLen, p, len);
+        m_recordLen += len;
+        return;
+    }
+    if (!m_hexOutput)
+    {
+        makeRoom(len);
+        memcpy(m_buff + m_tail, p, len);
+        m_tail += len;
+        return;
+    }
+    makeRoom(2 * len + 1);
+    uint8_t *out = m_buff + m_tail;
+    while (len--)
+    {
+        const char *hex = &hexTable[*p++ * 2];
+        *out++ = hex[0];
+        *out++ = hex[1];
+    }
+    *out++ = ' ';
+    m_tail = out - m_buff;
+}
+
+void SerialTx::putText(const char *text)
+{
+    const size_t len = strlen(text);
+    makeRoom(len);
+    memcpy(m_buff + m_tail, text, len);
+    m_tail += len;
+}
+
+void SerialTx::endRecord()
+{
+    if (m_hexOutput)
+    {
+        putText("\r\n");
+    }
+    else if (m_framed)
+    {
+        putU16(m_record + m_recordLen, crc16Frame(m_record, m_recordLen));
+        makeRoom(MAX_FRAME_SIZE);
+        m_tail += cobsEncode(m_record, m_recordLen + FRAME_CRC_SIZE, m_buff + m_tail);
+        m_buff[m_tail++] = FRAME_DELIMITER;
+        m_recordLen = 0;
+    }
+    ++m_recordsFramed;
+}
+
+size_t SerialTx::flush()
+{
+    size_t len = m_tail - m_head;
+    if (len == 0)
+        return 0;
+    // Free space in UART FIFO & driver TX ring; writing up to this amount never blocks.
+    const int space = m_serial.availableForWrite();
+    if ((size_t)space < len)
+    {
+        // One stall per episode; the flushes until the UART catches up belong to it.
+        if (!m_blocked)
+            ++m_stalls;
+        m_blocked = true;
+        if (space <= 0)
+            return 0;
+        len = space;
+    }
+    else
+    {
+        m_blocked = false;
+    }
+    len = m_serial.write(m_buff + m_head, len);
+    m_head += len;
+    if (m_head == m_tail)
+    {
+        m_head = 0;
+        m_tail = 0;
+    }
+    m_bytesWritten += len;
+    return len;
+}
+
+void SerialTx::flushAll()
+{
+    const size_t len = m_tail - m_head;
+    m_bytesWritten += m_serial.write(m_buff + m_head, len);
+    m_head = 0;
+    m_tail = 0;
+    m_blocked = false;
+}
+
+void SerialTx::updateRates(uint32_t nowMs)
+{
+    const uint32_t elapsed = nowMs - m_lastRateMs;
+    if (elapsed == 0)
+        return;
+    m_bytesPerSec = (uint32_t)(((uint64_t)m_bytesWritten * 1000) / elapsed);
+    m_recordsPerSec = (uint32_t)(((uint64_t)m_recordsFramed * 1000) / elapsed);
+    m_bytesWritten = 0;
+    m_recordsFramed = 0;
+    m_lastRateMs = nowMs;
+}
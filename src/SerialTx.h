@@ -0,0 +1,76 @@
+#ifndef SerialTx_h
+#define SerialTx_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NRF24_sniff_protocol.h"
+
+#define SERIAL_TX_STAGING_SIZE (1024) // Bytes of framed records staged before handing them to the UART.
+
+// Frames records into a staging buffer and hands them to the serial port in large, non-blocking writes.
+// In hex mode each field is written as hex digits followed by a space and records end with a newline,
+// for development on a serial monitor. In framed mode each record is sent as a COBS frame with CRC,
+// so the host can resynchronize after corruption; see FRAMING_COBS.
+class SerialTx
+{
+public:
+    SerialTx(HardwareSerial &serial, bool hexOutput);
+
+    ~SerialTx();
+
+    // Enable or disable COBS framing, from the next record on. Has no effect in hex mode.
+    void setFraming(bool framed);
+
+    // Test if a record of len bytes can be staged without flushing first.
+    bool hasRoom(size_t len) const;
+
+    // Append one field of a record.
+    void put(const void *data, size_t len);
+
+    // Append plain text, e.g. annotations in hex mode.
+    void putText(const char *text);
+
+    // Close the current record.
+    void endRecord();
+
+    // Write as much staged data as the serial port accepts without blocking. Returns nr. of bytes written.
+    size_t flush();
+
+    // Write all staged data, blocking until done.
+    void flushAll();
+
+    // Test if data is staged, but not yet written.
+    bool pending() const { return m_tail != m_head; }
+
+    // Recalculate throughput over the time since the previous call.
+    void updateRates(uint32_t nowMs);
+
+    uint32_t bytesPerSec() const { return m_bytesPerSec; }
+
+    uint32_t recordsPerSec() const { return m_recordsPerSec; }
+
+    // Nr. of times the UART TX ring filled up and flushes started leaving data staged.
+    uint32_t stalls() const { return m_stalls; }
+
+private:
+    HardwareSerial &m_serial;
+    const bool m_hexOutput;
+    bool m_framed;
+    uint8_t m_record[1 + MAX_MSG_LEN + FRAME_CRC_SIZE]; // Record being assembled in framed mode.
+    uint8_t m_recordLen;
+    uint8_t m_buff[SERIAL_TX_STAGING_SIZE];
+    size_t m_head; // Offset of first byte not yet written.
+    size_t m_tail; // Offset past last staged byte.
+    uint32_t m_bytesWritten;
+    uint32_t m_recordsFramed;
+    uint32_t m_lastRateMs;
+    uint32_t m_bytesPerSec;
+    uint32_t m_recordsPerSec;
+    uint32_t m_stalls;
+    bool m_blocked; // Last flush left data staged for lack of space.
+
+    void makeRoom(size_t len);
+};
+
+#endif // SerialTx_h
@@ -13,13 +13,22 @@
 #include "Arduino.h"
 #include <SPI.h>
 #include <SPIFFS.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 
-#include <CircularBuffer/CircularBuffer.h>
+#include <ByteRing/ByteRing.h>
 
 #include "nRF24L01.h"
 #include "RF24.h"
+#include "RF24_spi_esp32.h"
 
 #include "SPI_FS.h"
+#include "SerialTx.h"
+#include "PacketFilter.h"
+#include "EsbCrc.h"
+#include "NodeStats.h"
+#include "ChannelHopper.h"
+#include "RpdSurvey.h"
 
 #include "main.h"
 
@@ -144,19 +153,46 @@ Each channel takes up a bandwidth of less than 1MHz. This gives us 125 possible
 #define RF_CS_PIN (5)
 #define RF_IRQ_PIN (13)
 #define RF_IRQ (RF_IRQ_PIN) //
+#define RF_SCK_PIN (18)
+#define RF_MISO_PIN (19)
+#define RF_MOSI_PIN (23)
+#define RF_SPI_HOST (SPI3_HOST)            // VSPI
+#define RF_SPI_CLOCK_HZ (RF24_SPI_MAX_CLOCK_HZ) // nRF24 maximum of 10MHz
+// Further radios on the same SPI bus, each with CE, CS & IRQ of its own. Radios not fitted are skipped at startup.
+#define RF_NUM_RADIOS (3)
+#define RF1_CE_PIN (14)
+#define RF1_CS_PIN (27)
+#define RF1_IRQ_PIN (26)
+#define RF2_CE_PIN (25)
+#define RF2_CS_PIN (32)
+#define RF2_IRQ_PIN (33)
 
 #else
 #define RF_CE_PIN (9)
 #define RF_CS_PIN (10)
 #define RF_IRQ_PIN (2)
 #define RF_IRQ (RF_IRQ_PIN - 2) // Usually the interrupt = pin -2 (on uno/nano anyway)
+#define RF_NUM_RADIOS (1)
 #endif
 
 #define RF_MAX_ADDR_WIDTH (5) // Maximum address width, in bytes. MySensors use 5 bytes for addressing, where lowest byte is for node addressing.
 #define MAX_RF_PAYLOAD_SIZE (32)
 #define SER_BAUDRATE (115200)
-#define PACKET_BUFFER_SIZE (30) // Maximum number of packets that can be buffered between reception by NRF and transmission over serial port.
-#define PIPE (0)                // Pipe number to use for listening
+#define SER_MAX_BAUDRATE (5000000)       // Highest baudrate the ESP32 UART supports.
+#define SER_BAUD_CONFIRM_TIMEOUT_MS (1000) // Fall back to previous baudrate when host doesn't confirm the switch within this time.
+#define SER_TX_RING_SIZE (16384) // Size of UART driver TX ring; the UART ISR feeds the FIFO from it while loop() carries on.
+#define MIN_PACKET_BUFFER_SIZE (1024) // Smallest capture buffer, in bytes, we fall back to when allocation fails.
+#define STATS_INTERVAL_MS (1000)      // Interval between buffer statistics sent to the host.
+#define DEFAULT_SUMMARY_INTERVAL_MS (1000) // Interval between node summaries in CAPTURE_MODE_NODE_STATS.
+#define MAX_SERIAL_RECORD_SIZE (1 + 0x3F + 16) // Length & type byte, largest message and room for text annotations.
+#define NRF_RX_FIFO_DEPTH (3)   // Number of payloads the nRF24 RX FIFO can hold
+#define MERGE_HOLDBACK_US (4000) // Age at which a record goes out even though another radio may still capture an older frame.
+
+// The capture task drains the nRF FIFO over SPI. It runs on the core opposite to loop() (ARDUINO_RUNNING_CORE),
+// so serial output never delays radio reads.
+#define CAPTURE_TASK_CORE (0)
+#define CAPTURE_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define CAPTURE_TASK_STACK_SIZE (4096)
 
 // Startup defaults until user reconfigures it
 #define DEFAULT_RF_CHANNEL (77)                   // 76 = Default channel for MySensors.
@@ -167,12 +203,14 @@ Each channel takes up a bandwidth of less than 1MHz. This gives us 125 possible
 #define DEFAULT_RADIO_ID ((uint64_t)0xA8A8E1FC00LL)   // 0xA8A8E1FC00LL = MySensors v2 (1.4) default
 #define DEFAULT_RF_CRC_LENGTH (2)                     // Length (in bytes) of NRF24 CRC
 #define DEFAULT_RF_PAYLOAD_SIZE (MAX_RF_PAYLOAD_SIZE) // Define NRF24 payload size to maximum, so we'll slurp as many bytes as possible from the packet.
+#define DEFAULT_BUFFER_SIZE (32)                      // Capture buffer size in KiB; holds a few seconds of traffic at 115200 baud.
 
 // If BINARY_OUTPUT is defined, this sketch will output in hex format to the PC.
 // If undefined it will output text output for development.
 // #define BINARY_OUTPUT
 
 #include "NRF24_sniff_types.h"
+#include "RecordMerge.h"
 
 #ifndef BINARY_OUTPUT
 int my_putc(char c, FILE *t)
@@ -183,128 +221,774 @@ int my_putc(char c, FILE *t)
 
 SPI_FS spi_fs;
 
-// Set up nRF24L01 radio on SPI bus plus CE/CS pins
-RF24 radio(12, 5, 18, 19, 23);
-// static RF24 radio(RF_CE_PIN, RF_CS_PIN); // CE, CS = SS
+#ifdef BINARY_OUTPUT
+static SerialTx serialTx(Serial, false);
+#else
+static SerialTx serialTx(Serial, true);
+#endif
+
+// nRF24L01 radio on the SPI bus plus CE/CS/IRQ pins, with its own capture buffer.
+// Radio 0 follows conf, including pipes, hopping & survey. The others listen on pipe 0 only,
+// on the channel & address the host gave them.
+struct Radio
+{
+    Radio(const uint8_t cePin, const uint8_t csPin, const uint8_t irqPin)
+        : spi(RF_SPI_HOST, RF_SCK_PIN, RF_MISO_PIN, RF_MOSI_PIN, csPin, RF_SPI_CLOCK_HZ), rf(cePin, spi), irqPin(irqPin),
+          fitted(false), active(false), channel(0), address(0), packetBuffer(NULL, 0), irqTimestamp(0), irqPending(false),
+          lostPacketCount(0)
+    {
+    }
 
-static NRF24_packet_t bufferData[PACKET_BUFFER_SIZE];
-static CircularBuffer<NRF24_packet_t> packetBuffer(bufferData, sizeof(bufferData) / sizeof(bufferData[0]));
-static Serial_header_t serialHdr;
-static volatile Serial_config_t conf = {
-    DEFAULT_RF_CHANNEL, DEFAULT_RF_DATARATE, DEFAULT_RF_ADDR_WIDTH,
+    // ESP-IDF SPI master with hardware chip select and DMA for payloads; device config is set up once.
+    RF24_SPI_ESP32 spi;
+    RF24 rf;
+    const uint8_t irqPin;
+    bool fitted;     // Chip answered at startup.
+    bool active;     // Capturing. Changed by loop() only, while holding radioMutex.
+    uint8_t channel; // Channel the radio is tuned to. Changed while holding radioMutex.
+    uint64_t address; // Address of pipe 0 of radios other than radio 0, same layout as conf.address.
+    // Filled by the capture task (producer), drained by loop() (consumer); lock-free.
+    // Each record is a NRF24_packet_t truncated to the bytes of the actual frame.
+    // Buffer is allocated at runtime, its size is part of the configuration.
+    ByteRing packetBuffer;
+    EsbCrc esbCrc[RF_MAX_PIPES];
+    uint8_t serialAddress[RF_MAX_PIPES][RF_MAX_ADDR_WIDTH]; // Address of each pipe, MSB first, as sent in packet records.
+    volatile uint32_t irqTimestamp; // micros() at the falling edge of the nRF IRQ line.
+    volatile bool irqPending;       // IRQ seen since the capture task last drained the radio.
+    uint8_t lostPacketCount;        // Packets dropped since the last one buffered. Capture task only.
+};
+
+static_assert(RF_NUM_RADIOS <= RF_MAX_RADIOS, "Radio id must fit in the protocol");
+
+// Radio objects hold DMA buffers, so they must be globals in internal RAM.
+static Radio radios[RF_NUM_RADIOS] = {
+    {RF_CE_PIN, RF_CS_PIN, RF_IRQ_PIN},
+#if RF_NUM_RADIOS > 1
+    {RF1_CE_PIN, RF1_CS_PIN, RF1_IRQ_PIN},
+#endif
+#if RF_NUM_RADIOS > 2
+    {RF2_CE_PIN, RF2_CS_PIN, RF2_IRQ_PIN},
+#endif
+};
+static PacketFilter packetFilter;
+static NodeStats nodeStats;
+static ChannelHopper channelHopper;
+static RpdSurvey rpdSurvey;
+static TaskHandle_t captureTask = NULL;
+static SemaphoreHandle_t radioMutex = NULL; // Held by whoever talks to the radios or changes the filter: capture task or loop().
+static esp_timer_handle_t hopTimer = NULL;  // Fires when the dwell time on the current hop channel has passed.
+static volatile bool hopDue;                // Set by hopTimer; the capture task retunes radio 0.
+static volatile uint32_t packetsDropped;    // Packets dropped because the capture buffer was full or shrunk. Written by whoever holds radioMutex.
+static volatile uint32_t packetsBadCrc;     // Packets failing the CRC check. Written by capture task only.
+// Only changed by loop() while holding radioMutex.
+static Serial_config_t conf = {
+    SNIFF_PROTOCOL_VERSION, DEFAULT_RF_CHANNEL, DEFAULT_RF_DATARATE, DEFAULT_RF_ADDR_WIDTH,
     DEFAULT_RF_ADDR_PROMISC_WIDTH, DEFAULT_RADIO_ID, DEFAULT_RF_CRC_LENGTH,
-    DEFAULT_RF_PAYLOAD_SIZE};
+    DEFAULT_RF_PAYLOAD_SIZE, DEFAULT_BUFFER_SIZE, SER_BAUDRATE, RECORD_FORMAT_V1, FRAMING_NONE, CRC_CHECK_OFF,
+    CAPTURE_MODE_PACKETS, DEFAULT_SUMMARY_INTERVAL_MS, SNAPLEN_ALL, PIPES_DEFAULT, 0, {0, 0, 0, 0}};
+static bool recordResync;     // Next v2 record carries absolute timestamp & address.
+static uint32_t lastTimestamp; // Timestamp of previous v2 record.
+static uint8_t lastPipe;       // RX pipe of previous v2 record.
+static uint8_t lastChannel;    // RF channel of previous v2 record.
+static uint8_t lastRadio;      // Radio of previous v2 record.
+static uint32_t serBaudrate = SER_BAUDRATE; // Baudrate the UART is running at.
+static uint32_t prevBaudrate;               // Baudrate to fall back to while a switch is unconfirmed.
+static uint32_t baudSwitchMs;               // millis() at last baudrate switch; 0 when confirmed.
 
 #define GET_PAYLOAD_LEN(p) ((p->packet[conf.addressLen - conf.addressPromiscLen] & 0xFC) >> 2) // First 6 bits of nRF header contain length.
 
-inline static void dumpData(uint8_t *p, int len)
+// Calculate length of NRF24 frame in bits, then round up to get full number of bytes.
+#define GET_FRAME_LEN(p) ((((conf.addressLen - conf.addressPromiscLen) << 3) /* NRF24 LSB address byte(s) */ \
+                           + 9                                                /* NRF24 control field */       \
+                           + (GET_PAYLOAD_LEN(p) << 3)                        /* NRF24 payload length */      \
+                           + (conf.crcLength << 3)                            /* NRF24 crc length */          \
+                           + 7                                                /* Round up to full nr. of bytes */ \
+                           ) >>                                                                               \
+                          3) /* Convert from bits to bytes */
+
+static void IRAM_ATTR handleNrfIrq(void *arg)
 {
-#ifndef BINARY_OUTPUT
-    while (len--)
-    {
-        printf("%02x", *p++);
-    }
-    Serial.print(' ');
-#else
-    Serial.write(p, len);
-#endif
+    // Only timestamp the packet & wake the capture task; all SPI traffic happens in task context.
+    Radio *r = (Radio *)arg;
+    r->irqTimestamp = micros();
+    r->irqPending = true;
+    BaseType_t higherPrioWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(captureTask, &higherPrioWoken);
+    if (higherPrioWoken)
+        portYIELD_FROM_ISR();
 }
 
-static void handleNrfIrq()
+static void captureNrf(const uint8_t id)
 {
-    static uint8_t lostPacketCount = 0;
-    // Loop until RX buffer(s) contain no more packets.
-    while (radio.available())
+    static uint8_t burst[NRF_RX_FIFO_DEPTH][MAX_RF_PAYLOAD_SIZE];
+    static uint8_t pipes[NRF_RX_FIFO_DEPTH];
+    Radio &r = radios[id];
+    uint8_t packetLen = r.rf.getPayloadSize();
+    if (packetLen > MAX_RF_PAYLOAD_SIZE)
+        packetLen = MAX_RF_PAYLOAD_SIZE;
+    // Packets from the first burst get the interrupt timestamp, any subsequent ones arrived later.
+    uint32_t timestamp = r.irqTimestamp;
+    uint8_t numRead;
+    do
     {
 #ifdef LED_SUPPORTED
         digitalWrite(LED_PIN_RX, HIGH);
 #endif
-        if (!packetBuffer.full())
+        // Pop all queued payloads back to back. Reading less than a full FIFO means it was seen empty;
+        // anything arriving afterwards raises the IRQ again.
+        numRead = r.rf.readBurst(burst, NRF_RX_FIFO_DEPTH, packetLen, pipes);
+        for (uint8_t i = 0; i < numRead; ++i)
         {
+            NRF24_packet_t *p = (NRF24_packet_t *)r.packetBuffer.reserve(sizeof(NRF24_packet_t));
+            if (p)
+            {
 #ifdef LED_SUPPORTED
-            digitalWrite(LED_PIN_BUFF_FULL, LOW);
+                digitalWrite(LED_PIN_BUFF_FULL, LOW);
 #endif
-            NRF24_packet_t *p = packetBuffer.getFront();
-            p->timestamp = micros(); // Micros does not increase in interrupt, but it can be used.
-            p->packetsLost = lostPacketCount;
-            uint8_t packetLen = radio.getPayloadSize();
-            if (packetLen > MAX_RF_PAYLOAD_SIZE)
-                packetLen = MAX_RF_PAYLOAD_SIZE;
-
-            radio.read(p->packet, packetLen);
-
-            // Determine length of actual payload (in bytes) received from NRF24 packet control field (bits 7..2 of byte with offset 1)
-            // Enhanced shockburst format is assumed!
-            if (GET_PAYLOAD_LEN(p) <= MAX_RF_PAYLOAD_SIZE)
-            {
-                // Seems like a valid packet. Enqueue it.
-                packetBuffer.pushFront(p);
+                p->timestamp = timestamp;
+                p->packetsLost = r.lostPacketCount;
+                p->flags = 0;
+                p->pipe = pipes[i];
+                p->channel = r.channel;
+                p->radio = id;
+                memcpy(p->packet, burst[i], packetLen);
+
+                // Determine length of actual payload (in bytes) received from NRF24 packet control field (bits 7..2 of byte with offset 1)
+                // Enhanced shockburst format is assumed!
+                if ((GET_PAYLOAD_LEN(p) <= MAX_RF_PAYLOAD_SIZE) && (p->pipe < RF_MAX_PIPES))
+                {
+                    // Seems like a valid packet. Enqueue only the bytes of the frame itself,
+                    // unless dropped or filtered out; an uncommitted record is simply reused.
+                    const uint8_t nodeLen = conf.addressLen - conf.addressPromiscLen;
+                    uint8_t frameLen = GET_FRAME_LEN(p);
+                    if (frameLen > packetLen)
+                        frameLen = packetLen;
+                    // Frames cut short before the end of their CRC are neither valid nor invalid; they
+                    // don't count as either and are dropped along with the invalid ones.
+                    const uint8_t crc = (conf.crcCheck == CRC_CHECK_OFF) ? ESB_CRC_OK : r.esbCrc[p->pipe].check(p->packet, nodeLen, frameLen);
+                    const bool crcOk = (crc == ESB_CRC_OK);
+                    if (crc == ESB_CRC_BAD)
+                    {
+                        packetsBadCrc = packetsBadCrc + 1;
+                        p->flags |= PACKET_FLAG_BAD_CRC;
+                    }
+                    else if (crc == ESB_CRC_UNCHECKED)
+                    {
+                        p->flags |= PACKET_FLAG_NO_CRC;
+                    }
+                    if ((id == 0) && channelHopper.numChannels())
+                        channelHopper.count(crcOk);
+                    if (conf.captureMode == CAPTURE_MODE_NODE_STATS)
+                    {
+                        // Only account the frame; nothing is buffered.
+                        if ((crc != ESB_CRC_UNCHECKED) && packetFilter.match(p->packet, nodeLen, frameLen))
+                        {
+                            const uint32_t node = NodeStats::nodeKey(id, p->pipe, p->packet, nodeLen);
+                            nodeStats.add(node, GET_PAYLOAD_LEN(p), p->packet[nodeLen] & 0x03, crcOk, p->timestamp);
+                        }
+                    }
+                    else if ((crcOk || (conf.crcCheck == CRC_CHECK_TAG)) && packetFilter.match(p->packet, nodeLen, frameLen))
+                    {
+                        // Truncate after CRC check & filter have seen the complete frame.
+                        frameLen = snapFrameLen(frameLen, nodeLen, conf.snapLen);
+                        r.packetBuffer.commit(offsetof(NRF24_packet_t, packet) + frameLen);
+                        r.lostPacketCount = 0;
+                    }
+                }
+                else
+                {
+                    // Packet with invalid size received. Could increase some counter...
+                }
             }
             else
             {
-                // Packet with invalid size received. Could increase some counter...
-            }
-            lostPacketCount = 0;
-        }
-        else
-        {
-            // Buffer full. Increase lost packet counter.
+                // Buffer full; payload has been popped from the radio already. Increase lost packet counter.
 #ifdef LED_SUPPORTED
-            digitalWrite(LED_PIN_BUFF_FULL, HIGH);
+                digitalWrite(LED_PIN_BUFF_FULL, HIGH);
 #endif
-            bool tx_ok, tx_fail, rx_ready;
-            if (lostPacketCount < 255)
-                lostPacketCount++;
-            // Call 'whatHappened' to reset interrupt status.
-            radio.whatHappened(tx_ok, tx_fail, rx_ready);
-            // Flush buffer to drop the packet.
-            radio.flush_rx();
+                if (r.lostPacketCount < 255)
+                    r.lostPacketCount++;
+                packetsDropped = packetsDropped + 1;
+            }
         }
+        timestamp = micros();
 #ifdef LED_SUPPORTED
         digitalWrite(LED_PIN_RX, LOW);
 #endif
+    } while (numRead == NRF_RX_FIFO_DEPTH);
+}
+
+// Retune radio 0. Payloads still in the RX FIFO are flushed; drain them first.
+static void tuneChannel(const uint8_t channel)
+{
+    radios[0].rf.stopListening();
+    radios[0].rf.setChannel(channel);
+    radios[0].rf.startListening();
+    radios[0].channel = channel;
+}
+
+// (Re)start the dwell time on the current hop channel. Caller holds radioMutex.
+static void startHopTimer(void)
+{
+    (void)esp_timer_stop(hopTimer);
+    hopDue = false;
+    if (channelHopper.numChannels() && (conf.captureMode != CAPTURE_MODE_SURVEY))
+        (void)esp_timer_start_once(hopTimer, (uint64_t)channelHopper.dwellMs() * 1000);
+}
+
+static void hopTimerExpired(void *arg)
+{
+    (void)arg;
+    // Runs in the esp_timer task; the retune itself is SPI traffic for the capture task.
+    hopDue = true;
+    xTaskNotifyGive(captureTask);
+}
+
+// Sample RPD on every channel once, with radio 0. Caller holds radioMutex.
+static void surveySweep(void)
+{
+    for (uint8_t ch = 0; ch < RF_NUM_CHANNELS; ++ch)
+        rpdSurvey.add(ch, radios[0].rf.sampleRPD(ch, RPD_SURVEY_SAMPLES), RPD_SURVEY_SAMPLES);
+    radios[0].channel = RF_NUM_CHANNELS - 1;
+}
+
+static void captureTaskMain(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        // A survey sweeps back to back; waiting a tick in between lets the idle task & loop() in.
+        ulTaskNotifyTake(pdTRUE, (conf.captureMode == CAPTURE_MODE_SURVEY) ? 1 : portMAX_DELAY);
+        xSemaphoreTake(radioMutex, portMAX_DELAY);
+        if (conf.captureMode == CAPTURE_MODE_SURVEY)
+        {
+            surveySweep();
+        }
+        else
+        {
+            // Frames still queued were heard on the current channel, so capture them before retuning.
+            for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+            {
+                if (radios[id].active && (radios[id].irqPending || ((id == 0) && hopDue)))
+                {
+                    // Cleared first; an IRQ during the drain has the radio looked at again.
+                    radios[id].irqPending = false;
+                    captureNrf(id);
+                }
+            }
+            if (hopDue && channelHopper.numChannels())
+            {
+                tuneChannel(channelHopper.next(millis()));
+                startHopTimer();
+            }
+        }
+        xSemaphoreGive(radioMutex);
     }
 }
 
-static void activateConf(void)
+static uint8_t *allocBuffer(const uint32_t size)
 {
-#ifdef LED_SUPPORTED
-    digitalWrite(LED_PIN_CONFIG, HIGH);
+    void *buff = NULL;
+    // Prefer PSRAM, if present, to keep internal RAM for WiFi & the SPI DMA buffers.
+    if (psramFound())
+        buff = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buff)
+        buff = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    return (uint8_t *)buff;
+}
+
+// (Re)allocate the capture buffers to the size requested in the configuration, shared evenly by the
+// active radios. Radios not capturing get none. Caller holds radioMutex, so the capture task isn't running.
+static void resizePacketBuffers(void)
+{
+    uint32_t total = 0;
+    uint8_t numActive = 0;
+    for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+    {
+        total += radios[id].packetBuffer.size();
+        if (radios[id].active)
+            numActive++;
+    }
+    if (conf.bufferSize == 0)
+        conf.bufferSize = total / 1024;
+    // Round down to a power of two, as required by ByteRing.
+    uint32_t share = (uint32_t)conf.bufferSize * 1024 / numActive;
+    while (share & (share - 1))
+        share &= share - 1;
+
+    // Buffers that shrink go first, so the memory they give back is there for those that grow. Each new
+    // buffer is allocated before the old one is freed, as the records not sent yet move over.
+    for (uint8_t grow = 0; grow < 2; ++grow)
+    {
+        for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+        {
+            ByteRing &packetBuffer = radios[id].packetBuffer;
+            uint32_t size = radios[id].active ? share : 0;
+            if ((size == packetBuffer.size()) || ((size > packetBuffer.size()) != (grow != 0)))
+                continue;
+            uint8_t *buff = size ? allocBuffer(size) : NULL;
+            while (!buff && (size > MIN_PACKET_BUFFER_SIZE) && (!grow || ((size >> 1) > packetBuffer.size())))
+            {
+                // Not enough memory; try a smaller buffer.
+                size >>= 1;
+                buff = allocBuffer(size);
+            }
+            if (size && !buff && packetBuffer.size())
+                continue; // Keep the buffer there is.
+            // Records that don't fit are lost, like on a full buffer.
+            uint8_t *old = packetBuffer.buffer();
+            const uint32_t dropped = packetBuffer.moveToBuffer(buff, buff ? size : 0);
+            heap_caps_free(old);
+            packetsDropped = packetsDropped + dropped;
+            const uint32_t lost = radios[id].lostPacketCount + dropped;
+            radios[id].lostPacketCount = (lost < 255) ? lost : 255;
+        }
+    }
+    total = 0;
+    for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+        total += radios[id].packetBuffer.size();
+    // Report actual buffer size back with the config.
+    conf.bufferSize = total / 1024;
+}
+
+static void framePacketV1(const NRF24_packet_t *p, const uint8_t frameLen)
+{
+    // Promiscuous part of the address; the remaining bytes are part of the frame.
+    const uint8_t addrLen = RF_MAX_ADDR_WIDTH - (conf.addressLen - conf.addressPromiscLen);
+    uint8_t hdr[SERIAL_HEADER_V1_SIZE(RF_MAX_ADDR_WIDTH)];
+    const uint8_t hdrLen = serializeHeaderV1(p->timestamp, p->packetsLost, radios[p->radio].serialAddress[p->pipe], addrLen, hdr);
+
+    // Write record length & message type
+    uint8_t lenAndType = SET_MSG_TYPE(hdrLen + frameLen, MSG_TYPE_PACKET);
+    serialTx.put(&lenAndType, sizeof(lenAndType));
+    // Write serial header
+    serialTx.put(hdr, hdrLen);
+    // Write packet data
+    serialTx.put(p->packet, frameLen);
+}
+
+static void framePacketV2(const NRF24_packet_t *p, const uint8_t frameLen)
+{
+    // Flags, up to 5 bytes varint timestamp, packetsLost, pipe, channel, radio, address length & address
+    uint8_t hdr[1 + 5 + 1 + 1 + 1 + 1 + 1 + RF_MAX_ADDR_WIDTH];
+    uint8_t hdrLen = 1;
+    uint8_t flags = 0;
+
+    uint32_t ts = p->timestamp;
+    if (recordResync)
+        flags |= RECORD_V2_FLAG_ABSTIME | RECORD_V2_FLAG_PIPE | RECORD_V2_FLAG_CHANNEL | RECORD_V2_FLAG_RADIO | RECORD_V2_FLAG_ADDRESS;
+    else
+        ts -= lastTimestamp;
+    lastTimestamp = p->timestamp;
+    // Unsigned LEB128: 7 bits per byte, LSB first, bit 7 set when more bytes follow.
+    do
+    {
+        hdr[hdrLen++] = (ts & 0x7F) | (ts > 0x7F ? 0x80 : 0);
+        ts >>= 7;
+    } while (ts);
+
+    if (p->flags & PACKET_FLAG_BAD_CRC)
+        flags |= RECORD_V2_FLAG_BADCRC;
+    if (p->flags & PACKET_FLAG_NO_CRC)
+        flags |= RECORD_V2_FLAG_NOCRC;
+    // Each pipe has its own address.
+    if (p->pipe != lastPipe)
+        flags |= RECORD_V2_FLAG_PIPE | RECORD_V2_FLAG_ADDRESS;
+    if (p->channel != lastChannel)
+        flags |= RECORD_V2_FLAG_CHANNEL;
+    // As does each radio.
+    if (p->radio != lastRadio)
+        flags |= RECORD_V2_FLAG_RADIO | RECORD_V2_FLAG_ADDRESS;
+    if (p->packetsLost)
+    {
+        flags |= RECORD_V2_FLAG_LOST;
+        hdr[hdrLen++] = p->packetsLost;
+    }
+    if (flags & RECORD_V2_FLAG_PIPE)
+    {
+        hdr[hdrLen++] = p->pipe;
+        lastPipe = p->pipe;
+    }
+    if (flags & RECORD_V2_FLAG_CHANNEL)
+    {
+        hdr[hdrLen++] = p->channel;
+        lastChannel = p->channel;
+    }
+    if (flags & RECORD_V2_FLAG_RADIO)
+    {
+        hdr[hdrLen++] = p->radio;
+        lastRadio = p->radio;
+    }
+    if (flags & RECORD_V2_FLAG_ADDRESS)
+    {
+        // Promiscuous part of the address; the remaining bytes are part of the frame.
+        const uint8_t addrLen = RF_MAX_ADDR_WIDTH - (conf.addressLen - conf.addressPromiscLen);
+        hdr[hdrLen++] = addrLen;
+        memcpy(hdr + hdrLen, radios[p->radio].serialAddress[p->pipe], addrLen);
+        hdrLen += addrLen;
+        recordResync = false;
+    }
+    hdr[0] = flags;
+
+    uint8_t lenAndType = SET_MSG_TYPE(hdrLen + frameLen, MSG_TYPE_PACKET);
+    serialTx.put(&lenAndType, sizeof(lenAndType));
+    serialTx.put(hdr, hdrLen);
+    serialTx.put(p->packet, frameLen);
+}
+
+static void sendStats(void)
+{
+    Serial_stats_t stats = {};
+    for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+    {
+        stats.bufferSize += radios[id].packetBuffer.size();
+        stats.bufferUsed += radios[id].packetBuffer.bytesUsed();
+        stats.bufferHighWater += radios[id].packetBuffer.highWater();
+    }
+    stats.txBytesPerSec = serialTx.bytesPerSec();
+    stats.txRecordsPerSec = serialTx.recordsPerSec();
+    stats.txStalls = serialTx.stalls();
+    stats.packetsDropped = packetsDropped;
+    stats.packetsBadCrc = packetsBadCrc;
+
+    uint8_t msg[SERIAL_STATS_SIZE];
+    uint8_t lenAndType = SET_MSG_TYPE(serializeStats(stats, msg), MSG_TYPE_STATS);
+    serialTx.put(&lenAndType, sizeof(lenAndType));
+    serialTx.put(msg, sizeof(msg));
+    serialTx.endRecord();
+}
+
+static void sendFilterHits(void)
+{
+    Filter_hits_t hits;
+    packetFilter.getHits(hits);
+
+    uint8_t msg[1 + FILTER_HITS_SIZE(MAX_FILTER_RULES)];
+    msg[0] = CONTROL_FILTER_HITS;
+    uint8_t lenAndType = SET_MSG_TYPE(1 + serializeFilterHits(hits, msg + 1), MSG_TYPE_CONTROL);
+    serialTx.put(&lenAndType, sizeof(lenAndType));
+    serialTx.put(msg, GET_MSG_LEN(lenAndType));
+    serialTx.endRecord();
+}
+
+static void sendNodeStats(void)
+{
+    static Node_stats_t nodes[NODE_STATS_MAX_NODES + 1];
+    xSemaphoreTake(radioMutex, portMAX_DELAY);
+    const uint8_t numNodes = nodeStats.collect(nodes);
+    xSemaphoreGive(radioMutex);
+
+    for (uint8_t i = 0; i < numNodes; ++i)
+    {
+        uint8_t msg[1 + NODE_STATS_SIZE];
+        msg[0] = CONTROL_NODE_STATS;
+        uint8_t lenAndType = SET_MSG_TYPE(1 + serializeNodeStats(nodes[i], msg + 1), MSG_TYPE_CONTROL);
+        // A summary can be larger than the staging buffer.
+        if (!serialTx.hasRoom(MAX_SERIAL_RECORD_SIZE))
+            serialTx.flushAll();
+        serialTx.put(&lenAndType, sizeof(lenAndType));
+        serialTx.put(msg, sizeof(msg));
+        serialTx.endRecord();
+    }
+}
+
+static void sendHopTable(void)
+{
+    uint8_t msg[] = {CONTROL_HOP_TABLE, channelHopper.numChannels()};
+    uint8_t lenAndType = SET_MSG_TYPE(sizeof(msg), MSG_TYPE_CONTROL);
+    serialTx.put(&lenAndType, sizeof(lenAndType));
+    serialTx.put(msg, sizeof(msg));
+    serialTx.endRecord();
+}
+
+static void sendChannelStats(void)
+{
+    static Channel_stats_t channels[MAX_HOP_CHANNELS];
+    xSemaphoreTake(radioMutex, portMAX_DELAY);
+    const uint8_t numChannels = channelHopper.collect(channels, millis());
+    xSemaphoreGive(radioMutex);
+
+    for (uint8_t i = 0; i < numChannels; ++i)
+    {
+        uint8_t msg[1 + CHANNEL_STATS_SIZE];
+        msg[0] = CONTROL_CHANNEL_STATS;
+        uint8_t lenAndType = SET_MSG_TYPE(1 + serializeChannelStats(channels[i], msg + 1), MSG_TYPE_CONTROL);
+        // A sweep of the whole band can be larger than the staging buffer.
+        if (!serialTx.hasRoom(MAX_SERIAL_RECORD_SIZE))
+            serialTx.flushAll();
+        serialTx.put(&lenAndType, sizeof(lenAndType));
+        serialTx.put(msg, sizeof(msg));
+        serialTx.endRecord();
+    }
+}
+
+static void sendSurvey(void)
+{
+    Survey_t survey[RPD_SURVEY_BLOCKS];
+    xSemaphoreTake(radioMutex, portMAX_DELAY);
+    rpdSurvey.collect(survey);
+    xSemaphoreGive(radioMutex);
+
+    for (uint8_t b = 0; b < RPD_SURVEY_BLOCKS; ++b)
+    {
+        uint8_t msg[1 + SURVEY_SIZE(SURVEY_BLOCK_CHANNELS)];
+        msg[0] = CONTROL_SURVEY;
+        uint8_t lenAndType = SET_MSG_TYPE(1 + serializeSurvey(survey[b], msg + 1), MSG_TYPE_CONTROL);
+        if (!serialTx.hasRoom(MAX_SERIAL_RECORD_SIZE))
+            serialTx.flushAll();
+        serialTx.put(&lenAndType, sizeof(lenAndType));
+        serialTx.put(msg, GET_MSG_LEN(lenAndType));
+        serialTx.endRecord();
+    }
+}
+
+static void sendConf(void)
+{
+    uint8_t msg[SERIAL_CONFIG_SIZE];
+    // Write record length & message type
+    uint8_t lenAndType = SET_MSG_TYPE(serializeConfig(conf, msg), MSG_TYPE_CONFIG);
+    serialTx.put(&lenAndType, sizeof(lenAndType));
+    // Write config
+    serialTx.put(msg, sizeof(msg));
+    serialTx.endRecord();
+    // Rare event; make sure it goes out ahead of anything else.
+    serialTx.flushAll();
+}
+
+static void setBaudrate(uint32_t baudrate)
+{
+    // Wait for all data to go out at the current baudrate.
+    Serial.flush();
+    Serial.updateBaudRate(baudrate);
+    serBaudrate = baudrate;
+    conf.baudrate = baudrate;
+}
+
+// Full address of an RX pipe of a radio, same layout as conf.address.
+static uint64_t getPipeAddress(const uint8_t id, const uint8_t pipe)
+{
+    if (id != 0)
+        return radios[id].address;
+    if (pipe == 0)
+        return conf.address;
+    if (pipe == 1)
+        return conf.pipeAddress;
+    // Pipes 2..5 share all but the LSB of the promiscuous part with pipe 1.
+    const uint8_t shift = 8 * (conf.addressLen - conf.addressPromiscLen);
+    return (conf.pipeAddress & ~((uint64_t)0xFF << shift)) | ((uint64_t)conf.pipeLsb[pipe - 2] << shift);
+}
+
+// RX pipes a radio listens on, bit n = pipe n.
+static uint8_t getRadioPipes(const uint8_t id)
+{
+    return id == 0 ? conf.pipes : PIPES_DEFAULT;
+}
+
+#ifndef BINARY_OUTPUT
+static void printAddress(const uint64_t adr)
+{
+    Serial.print("0x");
+    for (int8_t i = conf.addressLen - 1; i >= 0; --i)
+    {
+        if (i >= conf.addressLen - conf.addressPromiscLen)
+        {
+            Serial.print((uint8_t)(adr >> (8 * i)), HEX);
+        }
+        else
+        {
+            Serial.print("**");
+        }
+    }
+    Serial.println("");
+}
 #endif
 
-    // Match MySensors' channel & datarate
-    radio.setChannel(conf.channel);
-    radio.setDataRate((rf24_datarate_e)conf.rate);
+// Apply conf to a radio and have it listen on its channel. Caller holds radioMutex.
+static void startRadio(const uint8_t id)
+{
+    Radio &r = radios[id];
+    r.rf.setChannel(r.channel);
+    r.rf.setDataRate((rf24_datarate_e)conf.rate);
 
     // Disable CRC & set fixed payload size to allow all packets captured to be returned by Nrf24.
-    radio.disableCRC();
-    radio.setPayloadSize(conf.maxPayloadSize);
+    r.rf.disableCRC();
+    r.rf.setPayloadSize(conf.maxPayloadSize);
+    // Stop clocking out each payload right after its CRC; short frames then take a fraction of the SPI time.
+    r.rf.enableLengthAwareRead(conf.addressLen - conf.addressPromiscLen, conf.crcLength);
+
+    // Configure listening pipes with their 'promiscuous' address and start listening
+    r.rf.setAddressWidth(conf.addressPromiscLen);
+    const uint8_t pipes = getRadioPipes(id);
+    for (uint8_t pipe = 0; pipe < RF_MAX_PIPES; ++pipe)
+    {
+        if (pipes & (1 << pipe))
+            r.rf.openReadingPipe(pipe, getPipeAddress(id, pipe) >> (8 * (conf.addressLen - conf.addressPromiscLen)));
+        else
+            r.rf.closeReadingPipe(pipe);
+    }
+    r.rf.startListening();
 
-    // Configure listening pipe with the 'promiscuous' address and start listening
-    radio.setAddressWidth(conf.addressPromiscLen);
-    radio.openReadingPipe(PIPE, conf.address >> (8 * (conf.addressLen - conf.addressPromiscLen)));
-    radio.startListening();
+    // Serial address of each pipe: its full address, right aligned. Records send the bytes in front of
+    // the node bytes, i.e. the zero padding & the promiscuous part, which ends in the LSB that tells
+    // pipes 2..5 apart. The node bytes come with the frame; no shifting needed.
+    for (uint8_t pipe = 0; pipe < RF_MAX_PIPES; ++pipe)
+    {
+        uint64_t addr = getPipeAddress(id, pipe);
+        for (int8_t i = RF_MAX_ADDR_WIDTH - 1; i >= 0; --i)
+        {
+            r.serialAddress[pipe][i] = addr;
+            addr >>= 8;
+        }
+    }
+
+    // The CRC covers the full address; the promiscuous part of it is fixed.
+    for (uint8_t pipe = 0; (conf.crcCheck != CRC_CHECK_OFF) && (pipe < RF_MAX_PIPES); ++pipe)
+    {
+        const uint64_t pipeAddress = getPipeAddress(id, pipe);
+        uint8_t promiscAddress[RF_MAX_ADDR_WIDTH];
+        for (uint8_t i = 0; i < conf.addressPromiscLen; ++i)
+            promiscAddress[i] = pipeAddress >> (8 * (conf.addressLen - 1 - i));
+        r.esbCrc[pipe].begin(promiscAddress, conf.addressPromiscLen, conf.crcLength);
+    }
 
     // Attach interrupt handler to NRF IRQ output. Overwrites any earlier handler.
-    attachInterrupt(RF_IRQ, handleNrfIrq, FALLING); // NRF24 Irq pin is active low.
+    // A survey doesn't receive frames; the capture task sweeps without being woken.
+    if (conf.captureMode != CAPTURE_MODE_SURVEY)
+        attachInterruptArg(digitalPinToInterrupt(r.irqPin), handleNrfIrq, &r, FALLING); // NRF24 Irq pin is active low.
+    // IRQ line might already be low, in which case no edge will follow. Have the capture task check once.
+    r.irqTimestamp = micros();
+    r.irqPending = true;
+    xTaskNotifyGive(captureTask);
+}
 
-    // Initialize serial header's address member to promiscuous address.
-    uint64_t addr = conf.address; // TODO: probably add some shifting!
-    for (int8_t i = sizeof(serialHdr.address) - 1; i >= 0; --i)
+// Stop a radio capturing. Its capture buffer, with the records not sent yet, goes with the next
+// resizePacketBuffers(). Caller holds radioMutex.
+static void stopRadio(const uint8_t id)
+{
+    detachInterrupt(digitalPinToInterrupt(radios[id].irqPin));
+    radios[id].rf.stopListening();
+    radios[id].active = false;
+}
+
+// Start the next fitted radio that isn't capturing yet. Returns false when there's none left, the config
+// is invalid or a survey is running. Caller holds radioMutex.
+static bool addRadio(const Radio_config_t &radioConf)
+{
+    if ((radioConf.channel >= RF_NUM_CHANNELS) || (conf.captureMode == CAPTURE_MODE_SURVEY))
+        return false;
+    for (uint8_t id = 1; id < RF_NUM_RADIOS; ++id)
     {
-        serialHdr.address[i] = addr;
-        addr >>= 8;
+        Radio &r = radios[id];
+        if (r.fitted && !r.active)
+        {
+            r.channel = radioConf.channel;
+            r.address = radioConf.address;
+            r.active = true;
+            resizePacketBuffers();
+            startRadio(id);
+            return true;
+        }
     }
+    return false;
+}
 
-    // Send config back. Write record length & message type
-    uint8_t lenAndType = SET_MSG_TYPE(sizeof(conf), MSG_TYPE_CONFIG);
-    dumpData(&lenAndType, sizeof(lenAndType));
-    // Write config
-    dumpData((uint8_t *)&conf, sizeof(conf));
+// Stop all radios but radio 0, which gets the whole capture buffer again. Caller holds radioMutex.
+static void clearRadios(void)
+{
+    for (uint8_t id = 1; id < RF_NUM_RADIOS; ++id)
+    {
+        if (radios[id].active)
+            stopRadio(id);
+    }
+    resizePacketBuffers();
+}
+
+static void sendRadioTable(void)
+{
+    uint8_t msg[] = {CONTROL_RADIO_TABLE, 0, 0};
+    for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+    {
+        if (radios[id].active)
+            msg[1]++;
+        if (radios[id].fitted)
+            msg[2]++;
+    }
+    uint8_t lenAndType = SET_MSG_TYPE(sizeof(msg), MSG_TYPE_CONTROL);
+    serialTx.put(&lenAndType, sizeof(lenAndType));
+    serialTx.put(msg, sizeof(msg));
+    serialTx.endRecord();
+}
+
+static void activateConf(void)
+{
+#ifdef LED_SUPPORTED
+    digitalWrite(LED_PIN_CONFIG, HIGH);
+#endif
+
+    // Settings the radios are set up with go first.
+    conf.pipes &= (1 << RF_MAX_PIPES) - 1;
+    if (conf.pipes == 0)
+        conf.pipes = PIPES_DEFAULT;
+    if ((conf.crcCheck > CRC_CHECK_DROP) || (conf.crcLength == 0) || (conf.crcLength > 2) || (conf.addressLen > RF_MAX_ADDR_WIDTH))
+        conf.crcCheck = CRC_CHECK_OFF;
+    if ((conf.captureMode != CAPTURE_MODE_NODE_STATS) && (conf.captureMode != CAPTURE_MODE_SURVEY))
+        conf.captureMode = CAPTURE_MODE_PACKETS;
+
+    // Radio 0 always captures; a survey sweeps with radio 0 alone.
+    radios[0].active = true;
+    for (uint8_t id = 1; (conf.captureMode == CAPTURE_MODE_SURVEY) && (id < RF_NUM_RADIOS); ++id)
+    {
+        if (radios[id].active)
+            stopRadio(id);
+    }
+    resizePacketBuffers();
+
+    // Match MySensors' channel & datarate. When hopping, start over at the first channel of the table.
+    radios[0].channel = channelHopper.numChannels() ? channelHopper.start(millis()) : conf.channel;
+    for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+    {
+        if (radios[id].active)
+            startRadio(id);
+    }
+    startHopTimer();
+
+    if (conf.recordFormat != RECORD_FORMAT_V2)
+        conf.recordFormat = RECORD_FORMAT_V1;
+    recordResync = true;
+    lastPipe = 0;
+    lastChannel = radios[0].channel;
+    lastRadio = 0;
+
+    if ((conf.snapLen > MAX_RF_PAYLOAD_SIZE) && (conf.snapLen != SNAPLEN_ALL))
+        conf.snapLen = SNAPLEN_ALL;
+    if (conf.summaryInterval == 0)
+        conf.summaryInterval = DEFAULT_SUMMARY_INTERVAL_MS;
+    nodeStats.clear();
+    rpdSurvey.clear();
+
+    // Framing applies from the config echo on.
+#ifdef BINARY_OUTPUT
+    if (conf.framing != FRAMING_COBS)
+#endif
+        conf.framing = FRAMING_NONE;
+    serialTx.setFraming(conf.framing == FRAMING_COBS);
+
+    // Baudrate is switched after the config is echoed at the current one.
+    if ((conf.baudrate < SER_BAUDRATE) || (conf.baudrate > SER_MAX_BAUDRATE))
+        conf.baudrate = serBaudrate;
+
+    // Send config back.
+    sendConf();
 
 #ifndef BINARY_OUTPUT
     Serial.print("Channel:     ");
     Serial.println(conf.channel);
+    if (channelHopper.numChannels())
+    {
+        Serial.print("Hopping:     ");
+        Serial.print(channelHopper.numChannels());
+        Serial.println(" channels");
+    }
     Serial.print("Datarate:    ");
     switch (conf.rate)
     {
@@ -318,24 +1002,41 @@ static void activateConf(void)
         Serial.println("250Kb/s");
         break;
     }
-    Serial.print("Address:     0x");
-    uint64_t adr = conf.address;
-    for (int8_t i = conf.addressLen - 1; i >= 0; --i)
+    Serial.print("Address:     ");
+    printAddress(conf.address);
+    for (uint8_t pipe = 1; pipe < RF_MAX_PIPES; ++pipe)
     {
-        if (i >= conf.addressLen - conf.addressPromiscLen)
+        if (conf.pipes & (1 << pipe))
         {
-            Serial.print((uint8_t)(adr >> (8 * i)), HEX);
+            Serial.print("Pipe ");
+            Serial.print(pipe);
+            Serial.print(":      ");
+            printAddress(getPipeAddress(0, pipe));
         }
-        else
+    }
+    if (!(conf.pipes & 1))
+        Serial.println("Pipe 0:      closed");
+    for (uint8_t id = 1; id < RF_NUM_RADIOS; ++id)
+    {
+        if (radios[id].active)
         {
-            Serial.print("**");
+            Serial.print("Radio ");
+            Serial.print(id);
+            Serial.print(":     channel ");
+            Serial.print(radios[id].channel);
+            Serial.print(", ");
+            printAddress(radios[id].address);
         }
     }
-    Serial.println("");
     Serial.print("Max payload: ");
     Serial.println(conf.maxPayloadSize);
     Serial.print("CRC length:  ");
     Serial.println(conf.crcLength);
+    Serial.print("CRC check:   ");
+    Serial.println(conf.crcCheck == CRC_CHECK_DROP ? "Drop" : conf.crcCheck == CRC_CHECK_TAG ? "Tag" : "Off");
+    Serial.print("Buffer:      ");
+    Serial.print(conf.bufferSize);
+    Serial.println(" KiB");
     Serial.println("");
 
     // hangs on esp or in general on non desktop devices?
@@ -364,6 +1065,8 @@ void setup(void)
     digitalWrite(LED_PIN_BUFF_FULL, LOW);
 #endif
 
+    // Must be set before begin(), which installs the UART driver.
+    Serial.setTxBufferSize(SER_TX_RING_SIZE);
     Serial.begin(SER_BAUDRATE);
 
     spi_fs.init(true);
@@ -374,24 +1077,55 @@ void setup(void)
     Serial.println("-- RF24 Sniff --");
 #endif
 
+#ifndef BINARY_OUTPUT
     Serial.println("-- starting Radio --");
-    radio.begin();
+#endif
+    for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+    {
+        Radio &r = radios[id];
+        r.rf.begin();
 
-    // Disable shockburst
-    radio.setAutoAck(false);
-    radio.setRetries(0, 0);
+        // Disable shockburst
+        r.rf.setAutoAck(false);
+        r.rf.setRetries(0, 0);
 
-    // Configure nRF IRQ input
-    pinMode(RF_IRQ_PIN, INPUT);
+        // Configure nRF IRQ input
+        pinMode(r.irqPin, INPUT);
+        // Radio 0 is assumed present, as it always was; the others only capture when they answer.
+        r.fitted = (id == 0) || r.rf.isChipConnected();
+#ifndef BINARY_OUTPUT
+        if (id && r.fitted)
+        {
+            Serial.print("-- radio ");
+            Serial.print(id);
+            Serial.println(" fitted --");
+        }
+#endif
+    }
+
+    radioMutex = xSemaphoreCreateMutex();
+    esp_timer_create_args_t hopTimerArgs = {};
+    hopTimerArgs.callback = hopTimerExpired;
+    hopTimerArgs.name = "nrfHop";
+    (void)esp_timer_create(&hopTimerArgs, &hopTimer);
+    xTaskCreatePinnedToCore(captureTaskMain, "nrfCapture", CAPTURE_TASK_STACK_SIZE, NULL,
+                            CAPTURE_TASK_PRIORITY, &captureTask, CAPTURE_TASK_CORE);
 
 #ifdef LED_SUPPORTED
     digitalWrite(LED_PIN_LISTEN, HIGH);
 #endif
 
+#ifndef BINARY_OUTPUT
     Serial.println("-- activating config --");
+#endif
+    // The capture task already runs; it may only touch the radios once they are configured.
+    xSemaphoreTake(radioMutex, portMAX_DELAY);
     activateConf();
+    xSemaphoreGive(radioMutex);
 
+#ifndef BINARY_OUTPUT
     Serial.println("entering loop()...\n");
+#endif
 
     pinMode(LED_BUILTIN, OUTPUT);
     digitalWrite(LED_BUILTIN, LOW);
@@ -399,80 +1133,195 @@ void setup(void)
 
 void loop(void)
 {
-    while (!packetBuffer.empty())
+    if (baudSwitchMs && (millis() - baudSwitchMs >= SER_BAUD_CONFIRM_TIMEOUT_MS))
+    {
+        // Host didn't follow the baudrate switch; go back to where it last heard us.
+        baudSwitchMs = 0;
+        setBaudrate(prevBaudrate);
+    }
+    // Output is held back while a baudrate switch is unconfirmed.
+    const bool txEnabled = (baudSwitchMs == 0);
+
+    NRF24_packet_t *p;
+    uint32_t recordLen;
+    int8_t id;
+    // Frame as many records as fit into the staging buffer, then write them out in one go.
+    while (txEnabled && serialTx.hasRoom(MAX_SERIAL_RECORD_SIZE) &&
+           ((id = nextRecord(radios, RF_NUM_RADIOS, micros(), MERGE_HOLDBACK_US, p, recordLen)) >= 0))
     {
         digitalWrite(LED_BUILTIN, HIGH);
 #ifdef LED_SUPPORTED
         digitalWrite(LED_PIN_TX, HIGH);
 #endif
         // One or more records present
-        NRF24_packet_t *p = packetBuffer.getBack();
-        int serialHdrLen = sizeof(serialHdr) - (conf.addressLen - conf.addressPromiscLen);
-        serialHdr.timestamp = p->timestamp;
-        serialHdr.packetsLost = p->packetsLost;
-
-        // Calculate data length in bits, then round up to get full number of bytes.
-        uint8_t dataLen = ((serialHdrLen << 3)                                 /* Serial packet header */
-                           + ((conf.addressLen - conf.addressPromiscLen) << 3) /* NRF24 LSB address byte(s) */
-                           + 9                                                 /* NRF24 control field */
-                           + (GET_PAYLOAD_LEN(p) << 3)                         /* NRF24 payload length */
-                           + (conf.crcLength << 3)                             /* NRF24 crc length */
-                           + 7                                                 /* Round up to full nr. of bytes */
-                           ) >>
-                          3; /* Convert from bits to bytes */
-
-        // Write record length & message type
-        uint8_t lenAndType = SET_MSG_TYPE(dataLen, MSG_TYPE_PACKET);
-        dumpData(&dataLen, sizeof(lenAndType));
-        // Write serial header
-        dumpData((uint8_t *)&serialHdr, serialHdrLen);
-        // Write packet data
-        dumpData(p->packet, dataLen - serialHdrLen);
+        // Record holds exactly the frame bytes, as determined by the capture task.
+        const uint8_t frameLen = recordLen - offsetof(NRF24_packet_t, packet);
+        if (conf.recordFormat == RECORD_FORMAT_V2)
+        {
+            framePacketV2(p, frameLen);
+        }
+        else
+        {
+            framePacketV1(p, frameLen);
+        }
 
 #ifndef BINARY_OUTPUT
         if (p->packetsLost > 0)
         {
-            Serial.print(" Lost: ");
-            Serial.print(p->packetsLost);
+            char lost[16];
+            snprintf(lost, sizeof(lost), " Lost: %u", p->packetsLost);
+            serialTx.putText(lost);
         }
-        Serial.println("");
+        if (p->flags & PACKET_FLAG_BAD_CRC)
+            serialTx.putText(" Bad CRC");
+        if (p->flags & PACKET_FLAG_NO_CRC)
+            serialTx.putText(" CRC unchecked");
 #endif
+        serialTx.endRecord();
         // Remove record as we're done with it.
-        packetBuffer.popBack();
+        radios[id].packetBuffer.pop();
 #ifdef LED_SUPPORTED
         digitalWrite(LED_PIN_TX, LOW);
 #endif
         digitalWrite(LED_BUILTIN, LOW);
     }
+    serialTx.flush();
 
-    // Test if new config comes in
-    uint8_t lenAndType;
-    if (Serial.available() >= sizeof(lenAndType) + sizeof(conf))
+    static uint32_t lastStats = 0;
+    if (txEnabled && (millis() - lastStats >= STATS_INTERVAL_MS) && serialTx.hasRoom(2 * MAX_SERIAL_RECORD_SIZE))
     {
-        lenAndType = Serial.read();
-        if ((GET_MSG_TYPE(lenAndType) == MSG_TYPE_CONFIG) && (GET_MSG_LEN(lenAndType) == sizeof(conf)))
-        {
-            // Disable nRF interrupt while reading & activating new configuration.
-            noInterrupts();
-            // Retrieve the new configuration
-            uint8_t *c = (uint8_t *)(&conf);
-            for (uint8_t i = 0; i < sizeof(conf); ++i)
-            {
-                *c++ = Serial.read();
-            }
-            // Clear any packets in the buffer and flush rx buffer.
-            packetBuffer.clear();
-            radio.flush_rx();
-            // Activate new config & re-enable nRF interrupt.
-            activateConf();
+        lastStats = millis();
+        serialTx.updateRates(lastStats);
+        sendStats();
+        if (packetFilter.numRules())
+            sendFilterHits();
+        if (channelHopper.numChannels())
+            sendChannelStats();
+    }
 
-            interrupts();
-        }
+    static uint32_t lastSummary = 0;
+    if (txEnabled && (conf.captureMode != CAPTURE_MODE_PACKETS) && (millis() - lastSummary >= conf.summaryInterval))
+    {
+        lastSummary = millis();
+        if (conf.captureMode == CAPTURE_MODE_SURVEY)
+            sendSurvey();
         else
+            sendNodeStats();
+    }
+
+    // Test if a message from the host comes in
+    if (Serial.available() > 0)
+    {
+        const uint8_t lenAndType = Serial.peek();
+        const uint8_t len = GET_MSG_LEN(lenAndType);
+        if (Serial.available() >= 1 + len)
         {
+            uint8_t msg[MAX_MSG_LEN];
+            (void)Serial.read();
+            Serial.readBytes(msg, len);
+            Serial_config_t newConf;
+            if (GET_MSG_TYPE(lenAndType) == MSG_TYPE_CONFIG)
+            {
+                if (deserializeConfig(msg, len, newConf))
+                {
+                    // Stop the capture task from touching the radios while activating new configuration.
+                    for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+                        detachInterrupt(digitalPinToInterrupt(radios[id].irqPin));
+                    xSemaphoreTake(radioMutex, portMAX_DELAY);
+                    conf = newConf;
+                    // Clear any packets in the buffers and flush rx buffers.
+                    for (uint8_t id = 0; id < RF_NUM_RADIOS; ++id)
+                    {
+                        radios[id].packetBuffer.clear();
+                        if (radios[id].active)
+                            radios[id].rf.flush_rx();
+                    }
+                    // Activate new config & re-enable nRF interrupts.
+                    activateConf();
+
+                    xSemaphoreGive(radioMutex);
+
+                    if (conf.baudrate != serBaudrate)
+                    {
+                        // Hold back all output until the host confirms it followed.
+                        prevBaudrate = serBaudrate;
+                        setBaudrate(conf.baudrate);
+                        baudSwitchMs = millis() | 1;
+                    }
+                }
+                else
+                {
+                    // Other protocol version; answer with ours, so the host can tell.
+                    sendConf();
+                }
+            }
+            else if ((GET_MSG_TYPE(lenAndType) == MSG_TYPE_CONTROL) && (len >= 1))
+            {
+                if ((msg[0] == CONTROL_BAUD_CONFIRM) && baudSwitchMs)
+                {
+                    // Host is listening at the new baudrate; acknowledge with the config.
+                    baudSwitchMs = 0;
+                    sendConf();
+                }
+                else if ((msg[0] == CONTROL_FILTER_CLEAR) || (msg[0] == CONTROL_FILTER_ADD))
+                {
+                    Filter_rule_t rule;
+                    xSemaphoreTake(radioMutex, portMAX_DELAY);
+                    if (msg[0] == CONTROL_FILTER_CLEAR)
+                        packetFilter.clear();
+                    else if (deserializeFilterRule(msg + 1, len - 1, rule))
+                        (void)packetFilter.add(rule);
+                    xSemaphoreGive(radioMutex);
+                    // Answer with the resulting table size, so the host can tell a rule was rejected.
+                    sendFilterHits();
+                    serialTx.flushAll();
+                }
+                else if ((msg[0] == CONTROL_HOP_CLEAR) || (msg[0] == CONTROL_HOP_ADD))
+                {
+                    Hop_range_t range;
+                    const bool hopping = conf.captureMode != CAPTURE_MODE_SURVEY;
+                    xSemaphoreTake(radioMutex, portMAX_DELAY);
+                    // Frames still queued were heard on the current channel; capture them before the table
+                    // changes & the retune flushes them. A survey sweeps radio 0 itself.
+                    if (hopping)
+                    {
+                        radios[0].irqPending = false;
+                        captureNrf(0);
+                    }
+                    if (msg[0] == CONTROL_HOP_CLEAR)
+                        channelHopper.clear();
+                    else if (deserializeHopRange(msg + 1, len - 1, range))
+                        (void)channelHopper.add(range);
+                    // Start over at the first channel of the table, or go back to the configured one.
+                    if (hopping)
+                        tuneChannel(channelHopper.numChannels() ? channelHopper.start(millis()) : conf.channel);
+                    startHopTimer();
+                    xSemaphoreGive(radioMutex);
+                    // Answer with the resulting table size, so the host can tell a range was rejected.
+                    sendHopTable();
+                    serialTx.flushAll();
+                }
+                else if ((msg[0] == CONTROL_RADIO_CLEAR) || (msg[0] == CONTROL_RADIO_ADD))
+                {
+                    Radio_config_t radioConf;
+                    xSemaphoreTake(radioMutex, portMAX_DELAY);
+                    if (msg[0] == CONTROL_RADIO_CLEAR)
+                        clearRadios();
+                    else if (deserializeRadioConfig(msg + 1, len - 1, radioConf))
+                        (void)addRadio(radioConf);
+                    xSemaphoreGive(radioMutex);
+                    // Answer with the radios capturing, so the host can tell one was rejected.
+                    sendRadioTable();
+                    serialTx.flushAll();
+                }
+            }
+            else
+            {
+                // Unknown message; skipped.
 #ifndef BINARY_OUTPUT
-            Serial.println("Illegal configuration received!");
+                Serial.println("Illegal message received!");
 #endif
+            }
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,189 @@
+/*
+  Host tests of AddressRecovery of Nrf24Sniff on synthetic frames: a node sends with a 5 byte address,
+  the sniffer listens on its last bytes and so captures the frames without the bytes in front.
+
+  Run with: pio test -e native -f test_address_recovery
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "AddressRecovery.cpp"
+
+#define ADDRESS_LEN (5)
+#define MAX_FRAME_LEN (ADDRESS_LEN + 2 + 32 + 2)
+
+static const uint8_t address[ADDRESS_LEN] = { 0xE7, 0x3C, 0xA8, 0x12, 0x99 };
+static AddressRecovery recovery;
+
+void setUp(void)
+{
+  srand(1);
+}
+
+void tearDown(void)
+{
+}
+
+// CRC16 (0x1021) or CRC8 (0x07) of lenBits bits, MSB first, as packet-nrf24.c takes it.
+static uint16_t refCrc(const uint8_t *data, const uint16_t lenBits, const uint8_t crcLength)
+{
+  const uint16_t top = crcLength == 2 ? 0x8000 : 0x80;
+  uint16_t crc = crcLength == 2 ? 0xFFFF : 0xFF;
+  for (uint16_t bitoffs = 0; bitoffs < lenBits; ++bitoffs)
+  {
+    if ((data[bitoffs >> 3] << (bitoffs & 7)) & 0x80)
+      crc ^= top;
+    crc = (crc & top) ? (crc << 1) ^ (crcLength == 2 ? 0x1021 : 0x07) : crc << 1;
+  }
+  return crc & (crcLength == 2 ? 0xFFFF : 0xFF);
+}
+
+// Put the value of numBits bits MSB first into data at bit offset bitOffs.
+static void putBits(uint8_t *data, uint16_t bitOffs, const uint16_t value, uint8_t numBits)
+{
+  while (numBits--)
+  {
+    const uint8_t mask = 0x80 >> (bitOffs & 7);
+    if ((value >> numBits) & 1)
+      data[bitOffs >> 3] |= mask;
+    else
+      data[bitOffs >> 3] &= ~mask;
+    ++bitOffs;
+  }
+}
+
+// A frame on the air with a random payload, and its CRC; a corrupt one gets a wrong CRC. record receives
+// what a sniffer listening on the last bytes of the address captures, without the prefixLen bytes in front.
+// Returns its length.
+static uint8_t makeFrame(uint8_t *record, const uint8_t prefixLen, const uint8_t crcLength, const bool corrupt)
+{
+  uint8_t air[MAX_FRAME_LEN + 1];
+  memset(air, 0, sizeof(air));
+  memcpy(air, address, ADDRESS_LEN);
+  uint16_t bits = 8 * ADDRESS_LEN;
+  const uint8_t payloadLen = rand() % 33;
+  putBits(air, bits, (payloadLen << 3) | (rand() & 7), 9);
+  bits += 9;
+  for (uint8_t i = 0; i < payloadLen; ++i, bits += 8)
+    putBits(air, bits, rand() & 0xFF, 8);
+  const uint16_t crc = refCrc(air, bits, crcLength) ^ (corrupt ? 0x05 : 0);
+  putBits(air, bits, crc, 8 * crcLength);
+  bits += 8 * crcLength;
+
+  const uint8_t len = (bits + 7) / 8 - prefixLen;
+  memcpy(record, air + prefixLen, len);
+  return len;
+}
+
+// Start over for a sniffer that misses prefixLen address bytes and add numFrames frames, numCorrupt of
+// them with a wrong CRC.
+static void capture(const uint8_t prefixLen, const uint8_t crcLength, const uint16_t numFrames, const uint16_t numCorrupt)
+{
+  recovery.begin(ADDRESS_LEN - prefixLen, crcLength, RECOVERY_MAX_PREFIX_LEN);
+  for (uint16_t f = 0; f < numFrames; ++f)
+  {
+    uint8_t record[MAX_FRAME_LEN];
+    const uint8_t len = makeFrame(record, prefixLen, crcLength, f < numCorrupt);
+    TEST_ASSERT_TRUE(recovery.add(record, len));
+  }
+  TEST_ASSERT_EQUAL_UINT16(numFrames, recovery.numFrames());
+}
+
+// The prefixLen address bytes the sniffer missed, first byte in the MSB.
+static uint32_t truePrefix(const uint8_t prefixLen)
+{
+  uint32_t prefix = 0;
+  for (uint8_t i = 0; i < prefixLen; ++i)
+    prefix = (prefix << 8) | address[i];
+  return prefix;
+}
+
+static void test_two_byte_prefix_found(void)
+{
+  capture(2, 2, 200, 20);
+  Recovery_candidate_t results[RECOVERY_MAX_RESULTS];
+  const uint8_t n = recovery.run(results);
+  TEST_ASSERT_TRUE(n >= 1);
+  TEST_ASSERT_EQUAL_UINT8(2, results[0].prefixLen);
+  TEST_ASSERT_EQUAL_HEX32(truePrefix(2), results[0].prefix);
+  TEST_ASSERT_EQUAL_UINT16(180, results[0].frames);
+  // The corrupt frames are all that's left to fit anything else.
+  for (uint8_t i = 1; i < n; ++i)
+    TEST_ASSERT_TRUE(results[i].frames <= 20);
+}
+
+static void test_one_byte_prefix_beats_longer(void)
+{
+  capture(1, 2, 100, 0);
+  Recovery_candidate_t results[RECOVERY_MAX_RESULTS];
+  TEST_ASSERT_TRUE(recovery.run(results) >= 1);
+  TEST_ASSERT_EQUAL_UINT8(1, results[0].prefixLen);
+  TEST_ASSERT_EQUAL_HEX32(truePrefix(1), results[0].prefix);
+  TEST_ASSERT_EQUAL_UINT16(100, results[0].frames);
+}
+
+static void test_no_prefix_when_address_complete(void)
+{
+  capture(0, 2, 50, 0);
+  Recovery_candidate_t results[RECOVERY_MAX_RESULTS];
+  TEST_ASSERT_TRUE(recovery.run(results) >= 1);
+  TEST_ASSERT_EQUAL_UINT8(0, results[0].prefixLen);
+  TEST_ASSERT_EQUAL_UINT16(50, results[0].frames);
+}
+
+static void test_crc8_ties_rank_shortest_first(void)
+{
+  // A CRC8 state is one byte: the right byte fits all frames, and so do some prefixes of 2 bytes.
+  capture(1, 1, 100, 0);
+  Recovery_candidate_t results[RECOVERY_MAX_RESULTS];
+  const uint8_t n = recovery.run(results);
+  TEST_ASSERT_EQUAL_UINT8(RECOVERY_MAX_RESULTS, n);
+  TEST_ASSERT_EQUAL_UINT8(1, results[0].prefixLen);
+  TEST_ASSERT_EQUAL_HEX32(truePrefix(1), results[0].prefix);
+  for (uint8_t i = 1; i < n; ++i)
+  {
+    TEST_ASSERT_EQUAL_UINT16(100, results[i].frames);
+    TEST_ASSERT_EQUAL_UINT8(2, results[i].prefixLen);
+  }
+}
+
+static void test_truncated_frames_rejected(void)
+{
+  recovery.begin(ADDRESS_LEN - 2, 2, RECOVERY_MAX_PREFIX_LEN);
+  uint8_t record[MAX_FRAME_LEN];
+  const uint8_t len = makeFrame(record, 2, 2, false);
+  // The CRC ends a bit into the last byte.
+  for (uint8_t cut = 1; cut < len; ++cut)
+    TEST_ASSERT_FALSE(recovery.add(record, len - cut));
+  TEST_ASSERT_TRUE(recovery.add(record, len));
+  TEST_ASSERT_EQUAL_UINT16(1, recovery.numFrames());
+}
+
+static void test_benchmark_run(void)
+{
+  capture(2, 2, 200, 0);
+  Recovery_candidate_t results[RECOVERY_MAX_RESULTS];
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint8_t r = 0; r < 10; ++r)
+    (void)recovery.run(results);
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 10;
+  char msg[64];
+  snprintf(msg, sizeof(msg), "All prefixes of up to 2 bytes: %.1f ms", 1e3 * seconds);
+  TEST_MESSAGE(msg);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_two_byte_prefix_found);
+  RUN_TEST(test_one_byte_prefix_beats_longer);
+  RUN_TEST(test_no_prefix_when_address_complete);
+  RUN_TEST(test_crc8_ties_rank_shortest_first);
+  RUN_TEST(test_truncated_frames_rejected);
+  RUN_TEST(test_benchmark_run);
+  return UNITY_END();
+}
@@ -0,0 +1,350 @@
+/*
+  Host tests of ByteRing, the lock-free packet ring between the capture task and loop(),
+  plus a throughput comparison against the critical-section CircularBuffer it replaced.
+
+  Run with: pio test -e native -f test_byte_ring
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <ByteRing/ByteRing.h>
+#define MAX_RF_PAYLOAD_SIZE (32) // As in main.cpp
+#include "NRF24_sniff_types.h"
+
+// CircularBuffer guards every access with a critical section: a spinlock shared by both cores on
+// the ESP32. Outside Xtensa it saves & restores SREG around cli(); these emulate the spinlock.
+struct HostMux
+{
+  std::atomic_flag flag;
+  operator uint8_t() const { return 0; }
+  HostMux &operator=(uint8_t)
+  {
+    flag.clear(std::memory_order_release);
+    return *this;
+  }
+};
+static HostMux SREG = { ATOMIC_FLAG_INIT };
+static inline void cli(void)
+{
+  while (SREG.flag.test_and_set(std::memory_order_acquire))
+    std::this_thread::yield();
+}
+#include <CircularBuffer/CircularBuffer.h>
+
+#define RING_SIZE (1024)
+#define NUM_RECORDS (200000UL)
+#define BENCH_RECORDS (2000000UL)
+#define BENCH_FRAME_LEN (11) // Node byte, control field, 2 byte MySensors payload & CRC16
+
+static uint32_t ringBuffer[RING_SIZE / sizeof(uint32_t)];
+static ByteRing ring((uint8_t *)ringBuffer, RING_SIZE);
+
+void setUp(void)
+{
+  ring.setBuffer((uint8_t *)ringBuffer, RING_SIZE);
+}
+
+void tearDown(void)
+{
+}
+
+// Record n holds n in its first 4 bytes, followed by bytes derived from n; its length varies with n.
+static uint32_t recordLen(const uint32_t n)
+{
+  return sizeof(uint32_t) + n % 40;
+}
+
+static void fillRecord(uint8_t *p, const uint32_t n)
+{
+  memcpy(p, &n, sizeof(n));
+  for (uint32_t i = sizeof(n); i < recordLen(n); ++i)
+    p[i] = (uint8_t)(n * 7 + i);
+}
+
+static bool checkRecord(const uint8_t *p, const uint32_t len, const uint32_t n)
+{
+  uint32_t m;
+  memcpy(&m, p, sizeof(m));
+  if ((m != n) || (len != recordLen(n)))
+    return false;
+  for (uint32_t i = sizeof(n); i < len; ++i)
+  {
+    if (p[i] != (uint8_t)(n * 7 + i))
+      return false;
+  }
+  return true;
+}
+
+static void test_empty_ring(void)
+{
+  uint32_t len;
+  TEST_ASSERT_TRUE(ring.empty());
+  TEST_ASSERT_EQUAL_UINT32(0, ring.bytesUsed());
+  TEST_ASSERT_NULL(ring.front(len));
+}
+
+static void test_records_come_out_in_order(void)
+{
+  for (uint32_t n = 0; n < 10; ++n)
+  {
+    uint8_t *p = ring.reserve(64);
+    TEST_ASSERT_NOT_NULL(p);
+    fillRecord(p, n);
+    ring.commit(recordLen(n));
+  }
+  for (uint32_t n = 0; n < 10; ++n)
+  {
+    uint32_t len;
+    const uint8_t *p = ring.front(len);
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_TRUE(checkRecord(p, len, n));
+    ring.pop();
+  }
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+static void test_only_committed_bytes_are_used(void)
+{
+  // A record takes its length word plus the bytes committed, padded to 4 bytes; not the reservation.
+  uint8_t *p = ring.reserve(sizeof(NRF24_packet_t));
+  TEST_ASSERT_NOT_NULL(p);
+  ring.commit(offsetof(NRF24_packet_t, packet) + BENCH_FRAME_LEN);
+  TEST_ASSERT_EQUAL_UINT32((ByteRing::HEADER_SIZE + offsetof(NRF24_packet_t, packet) + BENCH_FRAME_LEN + 3) & ~3UL, ring.bytesUsed());
+}
+
+static void test_record_wraps_to_start(void)
+{
+  // Fill up to 24 bytes before the end, then empty the ring again.
+  const uint32_t len = RING_SIZE - 24 - ByteRing::HEADER_SIZE;
+  TEST_ASSERT_NOT_NULL(ring.reserve(len));
+  ring.commit(len);
+  uint32_t got;
+  TEST_ASSERT_NOT_NULL(ring.front(got));
+  ring.pop();
+
+  // 40 bytes don't fit in the 24 left; the record continues at the start of the buffer.
+  uint8_t *p = ring.reserve(40);
+  TEST_ASSERT_TRUE(p == (uint8_t *)ringBuffer + ByteRing::HEADER_SIZE);
+  fillRecord(p, 36);
+  ring.commit(recordLen(36));
+  TEST_ASSERT_EQUAL_UINT32(24 + ByteRing::HEADER_SIZE + recordLen(36), ring.bytesUsed());
+
+  const uint8_t *q = ring.front(got);
+  TEST_ASSERT_TRUE(q == p);
+  TEST_ASSERT_TRUE(checkRecord(q, got, 36));
+  ring.pop();
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+static void test_full_ring_refuses_reservation(void)
+{
+  uint32_t committed = 0;
+  while (ring.reserve(60))
+  {
+    ring.commit(60);
+    committed++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(RING_SIZE / 64, committed);
+  TEST_ASSERT_EQUAL_UINT32(RING_SIZE, ring.highWater());
+
+  // Freeing one record makes room for exactly one again.
+  uint32_t len;
+  TEST_ASSERT_NOT_NULL(ring.front(len));
+  ring.pop();
+  TEST_ASSERT_NOT_NULL(ring.reserve(60));
+  ring.commit(60);
+  TEST_ASSERT_NULL(ring.reserve(60));
+}
+
+static void test_high_water_survives_draining(void)
+{
+  for (uint32_t n = 0; n < 4; ++n)
+  {
+    TEST_ASSERT_NOT_NULL(ring.reserve(28));
+    ring.commit(28);
+  }
+  uint32_t len;
+  while (ring.front(len))
+    ring.pop();
+  TEST_ASSERT_EQUAL_UINT32(0, ring.bytesUsed());
+  TEST_ASSERT_EQUAL_UINT32(4 * 32, ring.highWater());
+  ring.clear();
+  TEST_ASSERT_EQUAL_UINT32(0, ring.highWater());
+}
+
+static void test_move_to_buffer_keeps_records(void)
+{
+  static uint32_t bigBuffer[2 * RING_SIZE / sizeof(uint32_t)];
+  static uint32_t smallBuffer[256 / sizeof(uint32_t)];
+
+  // Records 0..49 written, 0..29 read: the ones left wrap around the end of the ring.
+  uint32_t len;
+  for (uint32_t n = 0; n < 50; ++n)
+  {
+    if (n >= 20)
+    {
+      TEST_ASSERT_NOT_NULL(ring.front(len));
+      ring.pop();
+    }
+    uint8_t *p = ring.reserve(64);
+    TEST_ASSERT_NOT_NULL(p);
+    fillRecord(p, n);
+    ring.commit(recordLen(n));
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, ring.moveToBuffer((uint8_t *)bigBuffer, sizeof(bigBuffer)));
+  TEST_ASSERT_EQUAL_UINT32(sizeof(bigBuffer), ring.size());
+  for (uint32_t n = 30; n < 35; ++n)
+  {
+    const uint8_t *p = ring.front(len);
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_TRUE(checkRecord(p, len, n));
+    ring.pop();
+  }
+
+  // Into a smaller buffer the oldest go while they fit; the rest are dropped.
+  const uint32_t dropped = ring.moveToBuffer((uint8_t *)smallBuffer, sizeof(smallBuffer));
+  TEST_ASSERT_TRUE(dropped > 0);
+  uint32_t n = 35;
+  const uint8_t *p;
+  while ((p = ring.front(len)) != NULL)
+  {
+    TEST_ASSERT_TRUE(checkRecord(p, len, n++));
+    ring.pop();
+  }
+  TEST_ASSERT_EQUAL_UINT32(50, n + dropped);
+
+  // The producer carries on in the new buffer, wrapping around it.
+  for (n = 0; n < 40; ++n)
+  {
+    uint8_t *q = ring.reserve(64);
+    TEST_ASSERT_NOT_NULL(q);
+    fillRecord(q, n);
+    ring.commit(recordLen(n));
+    p = ring.front(len);
+    TEST_ASSERT_TRUE(checkRecord(p, len, n));
+    ring.pop();
+  }
+
+  // Without a buffer, all records go.
+  TEST_ASSERT_NOT_NULL(ring.reserve(8));
+  ring.commit(8);
+  TEST_ASSERT_EQUAL_UINT32(1, ring.moveToBuffer(NULL, 0));
+  TEST_ASSERT_TRUE(ring.empty());
+  TEST_ASSERT_NULL(ring.reserve(8));
+}
+
+// Producer and consumer on their own threads, as the capture task and loop() run on their own cores.
+static void test_concurrent_producer_and_consumer(void)
+{
+  std::thread producer([]() {
+    for (uint32_t n = 0; n < NUM_RECORDS; ++n)
+    {
+      uint8_t *p;
+      while ((p = ring.reserve(64)) == NULL)
+        std::this_thread::yield();
+      fillRecord(p, n);
+      ring.commit(recordLen(n));
+    }
+  });
+
+  uint32_t bad = 0;
+  for (uint32_t n = 0; n < NUM_RECORDS; ++n)
+  {
+    uint32_t len;
+    const uint8_t *p;
+    while ((p = ring.front(len)) == NULL)
+      std::this_thread::yield();
+    if (!checkRecord(p, len, n))
+      bad++;
+    ring.pop();
+  }
+  producer.join();
+  TEST_ASSERT_EQUAL_UINT32(0, bad);
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+static double opsPerSecond(const std::chrono::steady_clock::time_point start)
+{
+  const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return BENCH_RECORDS / s;
+}
+
+// Frames of a MySensors node through both rings, on the RAM the firmware had for 30 packets.
+static void test_benchmark_against_circular_buffer(void)
+{
+  static NRF24_packet_t slots[30];
+  static CircularBuffer<NRF24_packet_t> circular(slots, sizeof(slots) / sizeof(slots[0]));
+  static uint32_t bytes[4096 / sizeof(uint32_t)]; // sizeof(slots) rounded up to a power of two
+  static ByteRing byteRing((uint8_t *)bytes, sizeof(bytes));
+  char msg[96];
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::thread producer([]() {
+    for (uint32_t n = 0; n < BENCH_RECORDS; ++n)
+    {
+      NRF24_packet_t *p;
+      while ((p = circular.getFront()) == NULL)
+        std::this_thread::yield();
+      p->timestamp = n;
+      (void)circular.pushFront(p);
+    }
+  });
+  uint32_t bad = 0;
+  for (uint32_t n = 0; n < BENCH_RECORDS; ++n)
+  {
+    NRF24_packet_t *p;
+    while ((p = circular.getBack()) == NULL)
+      std::this_thread::yield();
+    bad += p->timestamp != n;
+    (void)circular.popBack();
+  }
+  producer.join();
+  const double circularOps = opsPerSecond(start);
+
+  start = std::chrono::steady_clock::now();
+  std::thread byteProducer([]() {
+    for (uint32_t n = 0; n < BENCH_RECORDS; ++n)
+    {
+      NRF24_packet_t *p;
+      while ((p = (NRF24_packet_t *)byteRing.reserve(sizeof(NRF24_packet_t))) == NULL)
+        std::this_thread::yield();
+      p->timestamp = n;
+      byteRing.commit(offsetof(NRF24_packet_t, packet) + BENCH_FRAME_LEN);
+    }
+  });
+  for (uint32_t n = 0; n < BENCH_RECORDS; ++n)
+  {
+    uint32_t len;
+    NRF24_packet_t *p;
+    while ((p = (NRF24_packet_t *)byteRing.front(len)) == NULL)
+      std::this_thread::yield();
+    bad += p->timestamp != n;
+    byteRing.pop();
+  }
+  byteProducer.join();
+  const double byteRingOps = opsPerSecond(start);
+
+  TEST_ASSERT_EQUAL_UINT32(0, bad);
+  snprintf(msg, sizeof(msg), "CircularBuffer %.2f Mrecords/s, ByteRing %.2f Mrecords/s", circularOps / 1e6, byteRingOps / 1e6);
+  TEST_MESSAGE(msg);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_ring);
+  RUN_TEST(test_records_come_out_in_order);
+  RUN_TEST(test_only_committed_bytes_are_used);
+  RUN_TEST(test_record_wraps_to_start);
+  RUN_TEST(test_full_ring_refuses_reservation);
+  RUN_TEST(test_high_water_survives_draining);
+  RUN_TEST(test_move_to_buffer_keeps_records);
+  RUN_TEST(test_concurrent_producer_and_consumer);
+  RUN_TEST(test_benchmark_against_circular_buffer);
+  return UNITY_END();
+}
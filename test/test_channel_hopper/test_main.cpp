@@ -0,0 +1,142 @@
+/*
+  Host tests of ChannelHopper, the hop table with per channel occupancy, driven the way the capture
+  task does: next() when a dwell time has passed, count() for every frame heard.
+
+  Run with: pio test -e native -f test_channel_hopper
+*/
+
+#include <unity.h>
+
+#include "ChannelHopper.cpp"
+
+static ChannelHopper hopper;
+static Channel_stats_t stats[MAX_HOP_CHANNELS];
+
+void setUp(void)
+{
+  hopper.clear();
+}
+
+void tearDown(void)
+{
+}
+
+static Hop_range_t range(const uint8_t firstChannel, const uint8_t lastChannel, const uint16_t dwellMs)
+{
+  Hop_range_t r;
+  r.firstChannel = firstChannel;
+  r.lastChannel = lastChannel;
+  r.dwellMs = dwellMs;
+  return r;
+}
+
+static void test_ranges_and_dwell(void)
+{
+  TEST_ASSERT_TRUE(hopper.add(range(10, 12, 20)));
+  TEST_ASSERT_TRUE(hopper.add(range(76, 76, 100)));
+  TEST_ASSERT_EQUAL_UINT8(4, hopper.numChannels());
+
+  const uint8_t expected[] = { 10, 11, 12, 76, 10 };
+  const uint16_t dwell[] = { 20, 20, 20, 100, 20 };
+  TEST_ASSERT_EQUAL_UINT8(10, hopper.start(0));
+  uint32_t now = 0;
+  for (uint8_t i = 0; i < sizeof(expected); ++i)
+  {
+    TEST_ASSERT_EQUAL_UINT8(expected[i], hopper.channel());
+    TEST_ASSERT_EQUAL_UINT16(dwell[i], hopper.dwellMs());
+    now += hopper.dwellMs();
+    if (i + 1U < sizeof(expected))
+      TEST_ASSERT_EQUAL_UINT8(expected[i + 1], hopper.next(now));
+  }
+}
+
+static void test_invalid_ranges_rejected(void)
+{
+  TEST_ASSERT_FALSE(hopper.add(range(12, 10, 20)));
+  TEST_ASSERT_FALSE(hopper.add(range(120, RF_NUM_CHANNELS, 20)));
+  TEST_ASSERT_FALSE(hopper.add(range(10, 12, 0)));
+  TEST_ASSERT_EQUAL_UINT8(0, hopper.numChannels());
+
+  // All channels fit once; not one more.
+  TEST_ASSERT_TRUE(hopper.add(range(0, RF_NUM_CHANNELS - 2, 5)));
+  TEST_ASSERT_FALSE(hopper.add(range(0, 1, 5)));
+  TEST_ASSERT_TRUE(hopper.add(range(0, 0, 5)));
+  TEST_ASSERT_EQUAL_UINT8(MAX_HOP_CHANNELS, hopper.numChannels());
+}
+
+static void test_occupancy(void)
+{
+  TEST_ASSERT_TRUE(hopper.add(range(2, 4, 10)));
+  (void)hopper.start(1000);
+  // Channel 2: 3 frames, 2 valid. Channel 3: quiet. Channel 4: 1 valid, listened to until collect().
+  hopper.count(true);
+  hopper.count(false);
+  hopper.count(true);
+  (void)hopper.next(1010);
+  (void)hopper.next(1021);
+  hopper.count(true);
+
+  const uint8_t n = hopper.collect(stats, 1025);
+  TEST_ASSERT_EQUAL_UINT8(3, n);
+  TEST_ASSERT_EQUAL_UINT8(2, stats[0].channel);
+  TEST_ASSERT_EQUAL_UINT32(3, stats[0].packets);
+  TEST_ASSERT_EQUAL_UINT32(2, stats[0].packetsCrcOk);
+  TEST_ASSERT_EQUAL_UINT32(10, stats[0].listenMs);
+  TEST_ASSERT_EQUAL_UINT8(3, stats[1].channel);
+  TEST_ASSERT_EQUAL_UINT32(0, stats[1].packets);
+  TEST_ASSERT_EQUAL_UINT32(11, stats[1].listenMs);
+  TEST_ASSERT_EQUAL_UINT8(4, stats[2].channel);
+  TEST_ASSERT_EQUAL_UINT32(1, stats[2].packetsCrcOk);
+  TEST_ASSERT_EQUAL_UINT32(4, stats[2].listenMs);
+
+  // Collecting resets the counters; the current channel keeps being listened to.
+  TEST_ASSERT_EQUAL_UINT8(1, hopper.collect(stats, 1030));
+  TEST_ASSERT_EQUAL_UINT8(4, stats[0].channel);
+  TEST_ASSERT_EQUAL_UINT32(5, stats[0].listenMs);
+  TEST_ASSERT_EQUAL_UINT32(0, stats[0].packets);
+}
+
+static void test_occupancy_over_cycles(void)
+{
+  // Two channels of 10 ms, a frame on channel 1 every cycle: over 5 cycles 50 ms each.
+  TEST_ASSERT_TRUE(hopper.add(range(0, 1, 10)));
+  uint32_t now = 0;
+  (void)hopper.start(now);
+  for (uint8_t cycle = 0; cycle < 5; ++cycle)
+  {
+    (void)hopper.next(now += 10);
+    hopper.count(true);
+    (void)hopper.next(now += 10);
+  }
+  TEST_ASSERT_EQUAL_UINT8(2, hopper.collect(stats, now));
+  TEST_ASSERT_EQUAL_UINT32(50, stats[0].listenMs);
+  TEST_ASSERT_EQUAL_UINT32(0, stats[0].packets);
+  TEST_ASSERT_EQUAL_UINT32(50, stats[1].listenMs);
+  TEST_ASSERT_EQUAL_UINT32(5, stats[1].packetsCrcOk);
+}
+
+static void test_start_resets(void)
+{
+  TEST_ASSERT_TRUE(hopper.add(range(5, 6, 10)));
+  (void)hopper.start(0);
+  hopper.count(true);
+  (void)hopper.next(10);
+  TEST_ASSERT_EQUAL_UINT8(5, hopper.start(100));
+  TEST_ASSERT_EQUAL_UINT8(1, hopper.collect(stats, 107));
+  TEST_ASSERT_EQUAL_UINT32(0, stats[0].packets);
+  TEST_ASSERT_EQUAL_UINT32(7, stats[0].listenMs);
+
+  hopper.clear();
+  TEST_ASSERT_EQUAL_UINT8(0, hopper.collect(stats, 200));
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_ranges_and_dwell);
+  RUN_TEST(test_invalid_ranges_rejected);
+  RUN_TEST(test_occupancy);
+  RUN_TEST(test_occupancy_over_cycles);
+  RUN_TEST(test_start_resets);
+  return UNITY_END();
+}
@@ -0,0 +1,173 @@
+/*
+  Host tests of Discovery of Nrf24Sniff, fed the channel statistics a sniffer would send for simulated
+  networks: a node sends on one channel, data rate & address length, heard on its neighbouring channels
+  too, with noise on every channel that never passes the CRC check.
+
+  Run with: pio test -e native -f test_discovery
+*/
+
+#include <unity.h>
+
+#include "Discovery.cpp"
+
+#define MAX_NETWORKS (2)
+#define NOISE_PER_SECOND (200)
+
+// A node sending framesPerSecond valid frames; on the channels next to its own, half of them.
+struct Network
+{
+  uint8_t channel;
+  uint8_t rate;
+  uint8_t addressLen;
+  uint32_t framesPerSecond;
+};
+
+static Network networks[MAX_NETWORKS];
+static uint8_t numNetworks;
+static uint8_t channels[RF_NUM_CHANNELS];
+static Discovery discovery;
+
+void setUp(void)
+{
+  numNetworks = 0;
+  for (uint8_t ch = 0; ch < RF_NUM_CHANNELS; ++ch)
+    channels[ch] = ch;
+  discovery.begin(channels, RF_NUM_CHANNELS, DISCOVERY_MIN_ADDRESS_LEN, DISCOVERY_DEFAULT_DWELL_MS);
+}
+
+void tearDown(void)
+{
+}
+
+static void addNetwork(const uint8_t channel, const uint8_t rate, const uint8_t addressLen, const uint32_t framesPerSecond)
+{
+  Network &n = networks[numNetworks++];
+  n.channel = channel;
+  n.rate = rate;
+  n.addressLen = addressLen;
+  n.framesPerSecond = framesPerSecond;
+}
+
+// The statistics the sniffer sends for a channel after listening to it through pass.
+static Channel_stats_t listen(const Discovery_pass_t &pass, const uint8_t channel)
+{
+  Channel_stats_t stats;
+  stats.channel = channel;
+  stats.listenMs = pass.dwellMs;
+  stats.packetsCrcOk = 0;
+  for (uint8_t i = 0; i < numNetworks; ++i)
+  {
+    const Network &n = networks[i];
+    if ((n.rate != pass.rate) || (n.addressLen != pass.addressLen))
+      continue;
+    const uint32_t frames = n.framesPerSecond * pass.dwellMs / 1000;
+    if (n.channel == channel)
+      stats.packetsCrcOk += frames;
+    else if ((n.channel + 1 == channel) || (channel + 1 == n.channel))
+      stats.packetsCrcOk += frames / 2;
+  }
+  // Noise, or frames of any network at the wrong settings: heard, but never with a valid CRC.
+  stats.packets = stats.packetsCrcOk + NOISE_PER_SECOND * pass.dwellMs / 1000;
+  return stats;
+}
+
+// Run the search to its end; returns the number of passes it took.
+static uint16_t run(void)
+{
+  uint16_t numPasses = 0;
+  Discovery_pass_t pass;
+  while (discovery.nextPass(pass))
+  {
+    numPasses++;
+    TEST_ASSERT_TRUE(numPasses < 1000);
+    for (uint8_t i = 0; i < pass.numChannels; ++i)
+      discovery.add(listen(pass, pass.channels[i]));
+  }
+  return numPasses;
+}
+
+static void assertBest(const uint8_t channel, const uint8_t rate, const uint8_t addressLen)
+{
+  Discovery_candidate_t best;
+  TEST_ASSERT_TRUE(discovery.best(best));
+  TEST_ASSERT_EQUAL_UINT8(channel, best.channel);
+  TEST_ASSERT_EQUAL_UINT8(rate, best.rate);
+  TEST_ASSERT_EQUAL_UINT8(addressLen, best.addressLen);
+}
+
+static void test_converges_on_network(void)
+{
+  // 100 frames/s make 2 per channel in the first round, too few to decide; the second round decides.
+  addNetwork(40, 1, 4, 100);
+  const uint16_t numPasses = run();
+  assertBest(40, 1, 4);
+  TEST_ASSERT_TRUE(discovery.decided());
+  TEST_ASSERT_EQUAL_UINT8(1, discovery.round());
+  // The contenders are the winner & its neighbouring channels, so the second round is a single pass.
+  TEST_ASSERT_EQUAL_UINT16(9 + 1, numPasses);
+}
+
+static void test_busy_network_stops_in_first_round(void)
+{
+  addNetwork(2, 0, 3, 1000);
+  TEST_ASSERT_EQUAL_UINT16(1, run());
+  assertBest(2, 0, 3);
+  TEST_ASSERT_TRUE(discovery.decided());
+  TEST_ASSERT_EQUAL_UINT8(0, discovery.round());
+}
+
+static void test_noise_never_scores(void)
+{
+  // Only noise: every round listens to everything again, and nothing is found.
+  const uint16_t numPasses = run();
+  Discovery_candidate_t best;
+  TEST_ASSERT_FALSE(discovery.best(best));
+  TEST_ASSERT_FALSE(discovery.decided());
+  TEST_ASSERT_EQUAL_UINT16(9 * DISCOVERY_MAX_ROUNDS, numPasses);
+}
+
+static void test_unverified_stats_are_ignored(void)
+{
+  // Statistics claiming more valid frames than were heard didn't come from a CRC check.
+  Discovery_pass_t pass;
+  TEST_ASSERT_TRUE(discovery.nextPass(pass));
+  Channel_stats_t stats = listen(pass, 10);
+  stats.packetsCrcOk = stats.packets + 1;
+  discovery.add(stats);
+  Discovery_candidate_t best;
+  TEST_ASSERT_FALSE(discovery.best(best));
+}
+
+static void test_close_rivals_stay_undecided(void)
+{
+  // Two networks within the winning ratio: the search runs all rounds and keeps the busier one.
+  addNetwork(20, 2, 5, 300);
+  addNetwork(70, 1, 3, 200);
+  const uint16_t numPasses = run();
+  assertBest(20, 2, 5);
+  TEST_ASSERT_FALSE(discovery.decided());
+  TEST_ASSERT_EQUAL_UINT8(DISCOVERY_MAX_ROUNDS - 1, discovery.round());
+  // Later rounds only revisit the passes of the contenders.
+  TEST_ASSERT_TRUE(numPasses < 9 * DISCOVERY_MAX_ROUNDS);
+}
+
+static void test_neighbouring_channels_are_no_rivals(void)
+{
+  // A node heard half as well next to its channel, short of the winning ratio, still wins clearly.
+  addNetwork(100, 0, 5, 400);
+  run();
+  assertBest(100, 0, 5);
+  TEST_ASSERT_TRUE(discovery.decided());
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_converges_on_network);
+  RUN_TEST(test_busy_network_stops_in_first_round);
+  RUN_TEST(test_noise_never_scores);
+  RUN_TEST(test_unverified_stats_are_ignored);
+  RUN_TEST(test_close_rivals_stay_undecided);
+  RUN_TEST(test_neighbouring_channels_are_no_rivals);
+  return UNITY_END();
+}
@@ -0,0 +1,227 @@
+/*
+  Replay of synthetic sniffer streams through the DiversityCombiner of Nrf24Sniff: copies of every
+  transmission from several sniffers, each on its own clock, with losses, corrupt copies and
+  retransmissions, arriving at the host with serial latency.
+
+  Run with: pio test -e native -f test_diversity_combiner
+*/
+
+#include <unity.h>
+#include <string.h>
+
+#include "DiversityCombiner.cpp"
+
+#define ADDRESS_LEN (5)
+#define PAYLOAD_LEN (8)
+#define NUM_TX (400)
+#define TX_INTERVAL_US (5000)
+#define MAX_EVENTS (DIVERSITY_MAX_PORTS * NUM_TX * 2)
+
+// A copy as it arrives at the host.
+struct Event
+{
+  uint8_t port;
+  uint32_t snifferTimestamp_us;
+  uint64_t arrival_us;
+  DiversityFrame frame;
+};
+
+static Event events[MAX_EVENTS];
+static uint16_t numEvents;
+static DiversityFrame combined[MAX_EVENTS];
+static uint16_t numCombined;
+static DiversityCombiner combiner;
+
+void setUp(void)
+{
+  numEvents = 0;
+  numCombined = 0;
+}
+
+void tearDown(void)
+{
+}
+
+// Frame of transmission tx: the address, the control field with PID, the payload & CRC bytes.
+static void makeFrame(DiversityFrame &frame, const uint16_t tx, const bool crcOk)
+{
+  memset(&frame, 0, sizeof(frame));
+  const uint8_t address[ADDRESS_LEN] = { 0xA8, 0xA8, 0xE1, 0xFC, (uint8_t)(1 + tx % 3) };
+  memcpy(frame.record, address, ADDRESS_LEN);
+  frame.record[ADDRESS_LEN] = (PAYLOAD_LEN << 2) | (tx & 3);
+  for (uint8_t i = 0; i < PAYLOAD_LEN + 2; ++i)
+    frame.record[ADDRESS_LEN + 1 + i] = (uint8_t)(tx * 13 + i);
+  frame.len = ADDRESS_LEN + 1 + PAYLOAD_LEN + 2 + 1;
+  if (!crcOk)
+    frame.record[ADDRESS_LEN + 2] ^= 0x10;
+  frame.crcOk = crcOk;
+  frame.crcChecked = true;
+  frame.channel = 76;
+  frame.rxPipe = 0;
+  diversityKey(frame, ADDRESS_LEN);
+}
+
+static void addEvent(const uint8_t port, const uint32_t snifferTimestamp_us, const uint64_t arrival_us, const uint16_t tx, const bool crcOk)
+{
+  Event &e = events[numEvents++];
+  e.port = port;
+  e.snifferTimestamp_us = snifferTimestamp_us;
+  e.arrival_us = arrival_us;
+  makeFrame(e.frame, tx, crcOk);
+}
+
+// Feed the copies to the combiner in the order they arrive, collecting what comes out.
+static void replay(const uint8_t numPorts)
+{
+  // Insertion sort on arrival; the copies of each sniffer keep their order.
+  for (uint16_t i = 1; i < numEvents; ++i)
+  {
+    const Event e = events[i];
+    uint16_t j = i;
+    for (; (j > 0) && (events[j - 1].arrival_us > e.arrival_us); --j)
+      events[j] = events[j - 1];
+    events[j] = e;
+  }
+
+  combiner.clear(numPorts);
+  uint64_t now = 0;
+  for (uint16_t i = 0; i < numEvents; ++i)
+  {
+    now = events[i].arrival_us;
+    combiner.add(events[i].port, events[i].snifferTimestamp_us, now, events[i].frame);
+    while (combiner.pop(now, combined[numCombined]))
+      numCombined++;
+  }
+  now += DIVERSITY_HOLD_US;
+  while (combiner.pop(now, combined[numCombined]))
+    numCombined++;
+}
+
+// Sniffer time of transmission tx on a clock starting at start; arrival adds latency & some jitter.
+static uint32_t snifferTime(const uint32_t start, const uint16_t tx)
+{
+  return start + (uint32_t)tx * TX_INTERVAL_US;
+}
+
+static uint64_t arrival(const uint16_t tx, const uint8_t port)
+{
+  return 1000000ULL + (uint64_t)tx * TX_INTERVAL_US + 2000 + port * 700 + (tx * 37 + port * 11) % 400;
+}
+
+static void test_copies_combine_into_one_frame(void)
+{
+  // Sniffer 1 misses every 7th transmission & corrupts every 5th; sniffer 0 corrupts every 3rd.
+  uint16_t missed1 = 0;
+  for (uint16_t tx = 0; tx < NUM_TX; ++tx)
+  {
+    addEvent(0, snifferTime(5000, tx), arrival(tx, 0), tx, tx % 3 != 0);
+    if (tx % 7 == 0)
+      missed1++;
+    else
+      addEvent(1, snifferTime(0x12345678UL, tx), arrival(tx, 1), tx, tx % 5 != 0);
+  }
+  replay(2);
+
+  TEST_ASSERT_EQUAL_UINT32(NUM_TX, numCombined);
+  TEST_ASSERT_EQUAL_UINT32(NUM_TX, combiner.stats().frames);
+  TEST_ASSERT_EQUAL_UINT32(0, combiner.stats().dropped);
+  TEST_ASSERT_EQUAL_UINT32(missed1, combiner.stats().port[1].missed);
+  TEST_ASSERT_EQUAL_UINT32(0, combiner.stats().port[0].missed);
+  for (uint16_t tx = 0; tx < NUM_TX; ++tx)
+  {
+    const DiversityFrame &f = combined[tx];
+    // The valid copy is kept, when any sniffer has one.
+    const bool anyValid = (tx % 3 != 0) || ((tx % 7 != 0) && (tx % 5 != 0));
+    TEST_ASSERT_EQUAL_UINT8(anyValid, f.crcOk);
+    DiversityFrame expected;
+    makeFrame(expected, tx, anyValid);
+    TEST_ASSERT_EQUAL_MEMORY(expected.record, f.record, f.len);
+    if (tx > 0)
+      TEST_ASSERT_TRUE(f.timestamp_us > combined[tx - 1].timestamp_us);
+  }
+}
+
+static void test_retransmissions_stay_apart(void)
+{
+  // A lost ACK makes the node send the same frame again, 1.5 ms later: two transmissions.
+  for (uint16_t tx = 0; tx < NUM_TX; ++tx)
+  {
+    const uint32_t start = (tx / 2) * TX_INTERVAL_US + (tx & 1) * 1500;
+    const uint64_t at = 1000000ULL + start + 2000;
+    addEvent(0, 7000 + start, at, tx / 2, true);
+    addEvent(1, 0x40000000UL + start, at + 300, tx / 2, true);
+  }
+  replay(2);
+  TEST_ASSERT_EQUAL_UINT32(NUM_TX, numCombined);
+  TEST_ASSERT_EQUAL_UINT32(0, combiner.stats().port[0].missed);
+  TEST_ASSERT_EQUAL_UINT32(0, combiner.stats().port[1].missed);
+}
+
+static void test_clock_wrap_around(void)
+{
+  // Both clocks wrap halfway the stream, at different transmissions.
+  const uint32_t start0 = 0xFFFFFFFFUL - (NUM_TX / 2) * TX_INTERVAL_US;
+  const uint32_t start1 = 0xFFFFFFFFUL - (NUM_TX / 3) * TX_INTERVAL_US;
+  for (uint16_t tx = 0; tx < NUM_TX; ++tx)
+  {
+    addEvent(0, snifferTime(start0, tx), arrival(tx, 0), tx, true);
+    addEvent(1, snifferTime(start1, tx), arrival(tx, 1), tx, true);
+  }
+  replay(2);
+  TEST_ASSERT_EQUAL_UINT32(NUM_TX, numCombined);
+  TEST_ASSERT_EQUAL_UINT32(0, combiner.stats().port[1].missed);
+  for (uint16_t tx = 1; tx < NUM_TX; ++tx)
+  {
+    const uint64_t step = combined[tx].timestamp_us - combined[tx - 1].timestamp_us;
+    TEST_ASSERT_EQUAL_UINT32(TX_INTERVAL_US, (uint32_t)step);
+  }
+}
+
+static void test_small_step_back_is_no_wrap(void)
+{
+  // Sniffer 0 sends two frames in reverse order, as when it drains several radios: the timestamp
+  // steps back a little. Its clock must not jump a whole wrap ahead.
+  for (uint16_t tx = 0; tx < NUM_TX; ++tx)
+  {
+    uint64_t at = arrival(tx, 0);
+    if (tx == NUM_TX / 2)
+      at = arrival(tx + 1, 0) + 1;
+    addEvent(0, snifferTime(100000, tx), at, tx, true);
+    addEvent(1, snifferTime(0x0000F000UL, tx), arrival(tx, 1), tx, true);
+  }
+  replay(2);
+  // Once a wrap ahead, the copies of sniffer 0 would no longer match those of sniffer 1.
+  TEST_ASSERT_EQUAL_UINT32(NUM_TX, numCombined);
+  TEST_ASSERT_EQUAL_UINT32(0, combiner.stats().port[0].missed);
+  TEST_ASSERT_EQUAL_UINT32(0, combiner.stats().port[1].missed);
+  const uint64_t span = combined[NUM_TX - 1].timestamp_us - combined[0].timestamp_us;
+  TEST_ASSERT_EQUAL_UINT32((NUM_TX - 1) * TX_INTERVAL_US, (uint32_t)span);
+}
+
+static void test_three_sniffers(void)
+{
+  // Each transmission is heard validly by one sniffer only; the combined stream has every one valid.
+  for (uint16_t tx = 0; tx < NUM_TX; ++tx)
+  {
+    for (uint8_t port = 0; port < 3; ++port)
+      addEvent(port, snifferTime(port * 0x20000000UL, tx), arrival(tx, port), tx, tx % 3 == port);
+  }
+  replay(3);
+  TEST_ASSERT_EQUAL_UINT32(NUM_TX, numCombined);
+  TEST_ASSERT_EQUAL_UINT32(0, combiner.stats().framesBadCrc);
+  for (uint8_t port = 0; port < 3; ++port)
+    TEST_ASSERT_EQUAL_UINT32(NUM_TX / 3 + (port < NUM_TX % 3), combiner.stats().port[port].sole);
+  for (uint16_t tx = 0; tx < NUM_TX; ++tx)
+    TEST_ASSERT_TRUE(combined[tx].crcOk);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_copies_combine_into_one_frame);
+  RUN_TEST(test_retransmissions_stay_apart);
+  RUN_TEST(test_clock_wrap_around);
+  RUN_TEST(test_small_step_back_is_no_wrap);
+  RUN_TEST(test_three_sniffers);
+  return UNITY_END();
+}
@@ -0,0 +1,187 @@
+/*
+  Host tests of EsbCrc, the CRC check of captured frames, against the bit by bit CRC of the Wireshark
+  dissector (orgSources/Wireshark/src/nrf24/packet-nrf24.c).
+
+  Run with: pio test -e native -f test_esb_crc
+*/
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "EsbCrc.cpp"
+
+#define PROMISC_LEN (3)
+#define MAX_FRAME_LEN (5 + 2 + 32 + 2) // Address, control field, payload & CRC16 as the sniffer captures them
+
+static const uint8_t promiscAddress[PROMISC_LEN] = { 0xA8, 0xA8, 0xE1 };
+
+void setUp(void)
+{
+  srand(1);
+}
+
+void tearDown(void)
+{
+}
+
+// crc16() of packet-nrf24.c: MSB first, over any number of bits, on a byte array instead of a tvb.
+static uint16_t refCrc16(const uint8_t *data, const uint16_t lenBits)
+{
+  uint16_t crc = 0xffff;
+  for (uint16_t bitoffs = 0; bitoffs < lenBits; ++bitoffs)
+  {
+    const uint8_t shift = bitoffs & 7;
+    uint16_t bit = ((uint16_t)data[bitoffs >> 3]) << (8 + shift);
+    bit &= 0x8000;
+    crc ^= bit;
+    crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+// The same for the CRC8 (x^8+x^2+x+1), initial value 0xFF.
+static uint8_t refCrc8(const uint8_t *data, const uint16_t lenBits)
+{
+  uint8_t crc = 0xff;
+  for (uint16_t bitoffs = 0; bitoffs < lenBits; ++bitoffs)
+  {
+    crc ^= (data[bitoffs >> 3] << (bitoffs & 7)) & 0x80;
+    crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+// Put the value of numBits bits MSB first into data at bit offset bitOffs.
+static void putBits(uint8_t *data, uint16_t bitOffs, const uint16_t value, uint8_t numBits)
+{
+  while (numBits--)
+  {
+    const uint8_t mask = 0x80 >> (bitOffs & 7);
+    if ((value >> numBits) & 1)
+      data[bitOffs >> 3] |= mask;
+    else
+      data[bitOffs >> 3] &= ~mask;
+    ++bitOffs;
+  }
+}
+
+// Build a frame on the air: the promiscuous address, nodeLen more address bytes, control field with
+// payloadLen, payload and CRC. frame receives what the sniffer captures, from the node bytes on.
+// Returns its length.
+static uint8_t makeFrame(uint8_t *frame, const uint8_t nodeLen, const uint8_t payloadLen, const uint8_t crcLength)
+{
+  uint8_t air[PROMISC_LEN + MAX_FRAME_LEN];
+  memset(air, 0, sizeof(air));
+  memcpy(air, promiscAddress, PROMISC_LEN);
+  uint16_t bits = 8 * PROMISC_LEN;
+  for (uint8_t i = 0; i < nodeLen; ++i, bits += 8)
+    putBits(air, bits, rand() & 0xFF, 8);
+  putBits(air, bits, (payloadLen << 3) | (rand() & 7), 9);
+  bits += 9;
+  for (uint8_t i = 0; i < payloadLen; ++i, bits += 8)
+    putBits(air, bits, rand() & 0xFF, 8);
+  if (crcLength == 2)
+    putBits(air, bits, refCrc16(air, bits), 16);
+  else
+    putBits(air, bits, refCrc8(air, bits), 8);
+  bits += 8 * crcLength;
+
+  const uint8_t len = (bits + 7) / 8 - PROMISC_LEN;
+  memcpy(frame, air + PROMISC_LEN, len);
+  return len;
+}
+
+static void test_table_crc_matches_reference(void)
+{
+  uint8_t data[40];
+  for (uint8_t i = 0; i < sizeof(data); ++i)
+    data[i] = rand() & 0xFF;
+  for (uint8_t len = 0; len <= sizeof(data); ++len)
+  {
+    TEST_ASSERT_EQUAL_HEX16(refCrc16(data, 8 * len), EsbCrc::crc16(data, len, 0xFFFF));
+    TEST_ASSERT_EQUAL_HEX8(refCrc8(data, 8 * len), EsbCrc::crc8(data, len, 0xFF));
+  }
+}
+
+static void test_valid_frames_pass(void)
+{
+  for (uint8_t crcLength = 1; crcLength <= 2; ++crcLength)
+  {
+    for (uint8_t nodeLen = 0; nodeLen <= 2; ++nodeLen)
+    {
+      EsbCrc esbCrc;
+      esbCrc.begin(promiscAddress, PROMISC_LEN, crcLength);
+      for (uint8_t payloadLen = 0; payloadLen <= 32; ++payloadLen)
+      {
+        uint8_t frame[MAX_FRAME_LEN];
+        const uint8_t len = makeFrame(frame, nodeLen, payloadLen, crcLength);
+        TEST_ASSERT_EQUAL_UINT8(ESB_CRC_OK, esbCrc.check(frame, nodeLen, len));
+      }
+    }
+  }
+}
+
+static void test_corrupt_frames_fail(void)
+{
+  for (uint8_t crcLength = 1; crcLength <= 2; ++crcLength)
+  {
+    EsbCrc esbCrc;
+    esbCrc.begin(promiscAddress, PROMISC_LEN, crcLength);
+    uint8_t frame[MAX_FRAME_LEN];
+    const uint8_t len = makeFrame(frame, 2, 8, crcLength);
+    // Every bit of the frame up to the end of its CRC, including the 9th control bit.
+    const uint16_t bits = 8 * 2 + 9 + 8 * 8 + 8 * crcLength;
+    for (uint16_t bit = 0; bit < bits; ++bit)
+    {
+      frame[bit >> 3] ^= 0x80 >> (bit & 7);
+      // A flipped length bit moves where the CRC is looked for, possibly past the captured bytes.
+      TEST_ASSERT_TRUE(esbCrc.check(frame, 2, len) != ESB_CRC_OK);
+      frame[bit >> 3] ^= 0x80 >> (bit & 7);
+    }
+    TEST_ASSERT_EQUAL_UINT8(ESB_CRC_OK, esbCrc.check(frame, 2, len));
+  }
+}
+
+static void test_wrong_promiscuous_address_fails(void)
+{
+  const uint8_t other[PROMISC_LEN] = { 0xA8, 0xA8, 0xE2 };
+  EsbCrc esbCrc;
+  esbCrc.begin(other, PROMISC_LEN, 2);
+  uint8_t frame[MAX_FRAME_LEN];
+  const uint8_t len = makeFrame(frame, 2, 4, 2);
+  TEST_ASSERT_EQUAL_UINT8(ESB_CRC_BAD, esbCrc.check(frame, 2, len));
+}
+
+static void test_truncated_frames_are_unchecked(void)
+{
+  for (uint8_t crcLength = 1; crcLength <= 2; ++crcLength)
+  {
+    EsbCrc esbCrc;
+    esbCrc.begin(promiscAddress, PROMISC_LEN, crcLength);
+    uint8_t frame[MAX_FRAME_LEN];
+    const uint8_t len = makeFrame(frame, 2, 16, crcLength);
+    // Cut anywhere before the end of its CRC, a frame must not pass as valid.
+    TEST_ASSERT_EQUAL_UINT8(ESB_CRC_OK, esbCrc.check(frame, 2, len));
+    for (uint8_t cut = 1; cut < len; ++cut)
+      TEST_ASSERT_EQUAL_UINT8(ESB_CRC_UNCHECKED, esbCrc.check(frame, 2, len - cut));
+  }
+
+  // Without a CRC there's nothing to check.
+  EsbCrc none;
+  none.begin(promiscAddress, PROMISC_LEN, 0);
+  uint8_t frame[MAX_FRAME_LEN];
+  const uint8_t len = makeFrame(frame, 2, 4, 2);
+  TEST_ASSERT_EQUAL_UINT8(ESB_CRC_UNCHECKED, none.check(frame, 2, len));
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_table_crc_matches_reference);
+  RUN_TEST(test_valid_frames_pass);
+  RUN_TEST(test_corrupt_frames_fail);
+  RUN_TEST(test_wrong_promiscuous_address_fails);
+  RUN_TEST(test_truncated_frames_are_unchecked);
+  return UNITY_END();
+}
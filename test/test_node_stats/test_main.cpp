@@ -0,0 +1,158 @@
+/*
+  Host tests of NodeStats, the per node statistics of the node statistics capture mode.
+
+  Run with: pio test -e native -f test_node_stats
+*/
+
+#include <unity.h>
+#include <string.h>
+
+#include "NodeStats.cpp"
+
+static NodeStats nodeStats;
+static Node_stats_t stats[NODE_STATS_MAX_NODES + 1];
+
+void setUp(void)
+{
+  nodeStats.clear();
+}
+
+void tearDown(void)
+{
+}
+
+static const Node_stats_t *findNode(const uint8_t n, const uint32_t node)
+{
+  for (uint8_t i = 0; i < n; ++i)
+  {
+    if (stats[i].node == node)
+      return &stats[i];
+  }
+  return NULL;
+}
+
+static void test_counts_and_gaps(void)
+{
+  nodeStats.add(0x0102, 4, 0, true, 1000);
+  nodeStats.add(0x0102, 8, 1, true, 1500);
+  nodeStats.add(0x0102, 8, 1, true, 3500);  // Same PID: a retransmit
+  nodeStats.add(0x0102, 2, 2, true, 4250);
+  const uint8_t n = nodeStats.collect(stats);
+  TEST_ASSERT_EQUAL_UINT8(1, n);
+  TEST_ASSERT_EQUAL_HEX32(0x0102, stats[0].node);
+  TEST_ASSERT_EQUAL_UINT32(4, stats[0].packets);
+  TEST_ASSERT_EQUAL_UINT32(22, stats[0].bytes);
+  TEST_ASSERT_EQUAL_UINT16(1, stats[0].retransmits);
+  TEST_ASSERT_EQUAL_UINT16(0, stats[0].crcFails);
+  TEST_ASSERT_EQUAL_UINT32(500, stats[0].gapMin);
+  TEST_ASSERT_EQUAL_UINT32(2000, stats[0].gapMax);
+  TEST_ASSERT_EQUAL_UINT32((500 + 2000 + 750) / 3, stats[0].gapMean);
+}
+
+static void test_gap_across_timer_wrap(void)
+{
+  nodeStats.add(7, 1, 0, true, 0xFFFFFF00UL);
+  nodeStats.add(7, 1, 1, true, 0x00000100UL);
+  TEST_ASSERT_EQUAL_UINT8(1, nodeStats.collect(stats));
+  TEST_ASSERT_EQUAL_UINT32(0x200, stats[0].gapMin);
+  TEST_ASSERT_EQUAL_UINT32(0x200, stats[0].gapMax);
+}
+
+static void test_crc_fails_only_for_known_nodes(void)
+{
+  // Noise doesn't create nodes; it counts in the summary of the others.
+  nodeStats.add(0x0A, 4, 0, false, 100);
+  nodeStats.add(0x0B, 4, 0, true, 200);
+  nodeStats.add(0x0B, 4, 1, false, 300);
+  const uint8_t n = nodeStats.collect(stats);
+  TEST_ASSERT_EQUAL_UINT8(2, n);
+  TEST_ASSERT_NULL(findNode(n, 0x0A));
+  const Node_stats_t *b = findNode(n, 0x0B);
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_EQUAL_UINT32(1, b->packets);
+  TEST_ASSERT_EQUAL_UINT16(1, b->crcFails);
+  const Node_stats_t *other = findNode(n, NODE_STATS_OTHER);
+  TEST_ASSERT_NOT_NULL(other);
+  TEST_ASSERT_EQUAL_UINT32(0, other->packets);
+  TEST_ASSERT_EQUAL_UINT16(1, other->crcFails);
+}
+
+static void test_overflow_into_other(void)
+{
+  // Consecutive node numbers, as most networks hand them out.
+  for (uint32_t node = 1; node <= NODE_STATS_MAX_NODES + 5; ++node)
+  {
+    nodeStats.add(node, 3, 0, true, node * 10);
+    nodeStats.add(node, 3, 1, true, node * 10 + 5);
+  }
+  const uint8_t n = nodeStats.collect(stats);
+  TEST_ASSERT_EQUAL_UINT8(NODE_STATS_MAX_NODES + 1, n);
+  uint32_t packets = 0;
+  for (uint8_t i = 0; i < n; ++i)
+  {
+    packets += stats[i].packets;
+    if (stats[i].node != NODE_STATS_OTHER)
+      TEST_ASSERT_EQUAL_UINT32(2, stats[i].packets);
+  }
+  TEST_ASSERT_EQUAL_UINT32(2 * (NODE_STATS_MAX_NODES + 5), packets);
+  const Node_stats_t *other = findNode(n, NODE_STATS_OTHER);
+  TEST_ASSERT_NOT_NULL(other);
+  TEST_ASSERT_EQUAL_UINT32(2 * 5, other->packets);
+  TEST_ASSERT_EQUAL_UINT32(2 * 5 * 3, other->bytes);
+}
+
+static void test_intervals(void)
+{
+  nodeStats.add(1, 1, 0, true, 1000);
+  nodeStats.add(2, 1, 0, true, 1000);
+  TEST_ASSERT_EQUAL_UINT8(2, nodeStats.collect(stats));
+
+  // The gap & retransmit spanning the intervals count; node 2 is silent and not reported.
+  nodeStats.add(1, 1, 0, true, 4000);
+  uint8_t n = nodeStats.collect(stats);
+  TEST_ASSERT_EQUAL_UINT8(1, n);
+  TEST_ASSERT_EQUAL_UINT32(1, stats[0].node);
+  TEST_ASSERT_EQUAL_UINT32(1, stats[0].packets);
+  TEST_ASSERT_EQUAL_UINT16(1, stats[0].retransmits);
+  TEST_ASSERT_EQUAL_UINT32(3000, stats[0].gapMin);
+
+  // Node 2 was dropped from the table: no gap from its last frame of two intervals ago.
+  nodeStats.add(2, 1, 1, true, 9000);
+  n = nodeStats.collect(stats);
+  TEST_ASSERT_EQUAL_UINT8(1, n);
+  TEST_ASSERT_EQUAL_UINT32(2, stats[0].node);
+  TEST_ASSERT_EQUAL_UINT32(0, stats[0].gapMax);
+
+  // Nothing heard, nothing reported.
+  TEST_ASSERT_EQUAL_UINT8(0, nodeStats.collect(stats));
+}
+
+static void test_node_key(void)
+{
+  const uint8_t frame[] = { 0xAB, 0xCD, 0xEF, 0x20 };
+  TEST_ASSERT_EQUAL_HEX32(0x25ABCDEF, NodeStats::nodeKey(2, 5, frame, 3));
+  TEST_ASSERT_EQUAL_HEX32(0x010000AB, NodeStats::nodeKey(0, 1, frame, 1));
+  TEST_ASSERT_EQUAL_HEX32(0x00000000, NodeStats::nodeKey(0, 0, frame, 0));
+
+  // The same node heard on two pipes & by two radios makes three nodes.
+  nodeStats.add(NodeStats::nodeKey(0, 1, frame, 2), 4, 0, true, 100);
+  nodeStats.add(NodeStats::nodeKey(0, 2, frame, 2), 4, 0, true, 100);
+  nodeStats.add(NodeStats::nodeKey(1, 1, frame, 2), 4, 0, true, 100);
+  const uint8_t n = nodeStats.collect(stats);
+  TEST_ASSERT_EQUAL_UINT8(3, n);
+  TEST_ASSERT_NOT_NULL(findNode(n, 0x0100ABCD));
+  TEST_ASSERT_NOT_NULL(findNode(n, 0x0200ABCD));
+  TEST_ASSERT_NOT_NULL(findNode(n, 0x1100ABCD));
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_counts_and_gaps);
+  RUN_TEST(test_gap_across_timer_wrap);
+  RUN_TEST(test_crc_fails_only_for_known_nodes);
+  RUN_TEST(test_overflow_into_other);
+  RUN_TEST(test_intervals);
+  RUN_TEST(test_node_key);
+  return UNITY_END();
+}
@@ -0,0 +1,205 @@
+/*
+  Host tests of PacketFilter, the rule table the sniffer applies to captured frames, on frames built
+  the way the radio captures them: node address bytes, 9 bit control field and the payload behind it,
+  shifted by one bit.
+
+  Run with: pio test -e native -f test_packet_filter
+*/
+
+#include <unity.h>
+#include <string.h>
+
+#include "PacketFilter.cpp"
+
+#define NODE_LEN (2)
+#define MAX_FRAME_LEN (NODE_LEN + 2 + 32 + 2)
+
+static PacketFilter filter;
+static uint8_t frame[MAX_FRAME_LEN];
+
+void setUp(void)
+{
+  filter.clear();
+}
+
+void tearDown(void)
+{
+}
+
+// Put the value of numBits bits MSB first into data at bit offset bitOffs.
+static void putBits(uint8_t *data, uint16_t bitOffs, const uint16_t value, uint8_t numBits)
+{
+  while (numBits--)
+  {
+    const uint8_t mask = 0x80 >> (bitOffs & 7);
+    if ((value >> numBits) & 1)
+      data[bitOffs >> 3] |= mask;
+    else
+      data[bitOffs >> 3] &= ~mask;
+    ++bitOffs;
+  }
+}
+
+// Build a frame of node, PID & payload, with the no-ack bit set so the payload shift shows.
+// Returns its length, including the 2 CRC bytes.
+static uint8_t makeFrame(const uint16_t node, const uint8_t pid, const uint8_t *payload, const uint8_t payloadLen)
+{
+  memset(frame, 0xA5, sizeof(frame));
+  putBits(frame, 0, node, 16);
+  putBits(frame, 16, (payloadLen << 3) | (pid << 1) | 1, 9);
+  for (uint8_t i = 0; i < payloadLen; ++i)
+    putBits(frame, 25 + 8 * i, payload[i], 8);
+  return (25 + 8 * payloadLen + 16 + 7) / 8;
+}
+
+// A rule that matches anything.
+static Filter_rule_t anyRule(const uint8_t action)
+{
+  Filter_rule_t rule;
+  memset(&rule, 0, sizeof(rule));
+  rule.action = action;
+  rule.maxLen = 32;
+  return rule;
+}
+
+static bool matchFrame(const uint16_t node, const uint8_t pid, const uint8_t *payload, const uint8_t payloadLen)
+{
+  const uint8_t len = makeFrame(node, pid, payload, payloadLen);
+  return filter.match(frame, NODE_LEN, len);
+}
+
+static const uint8_t payload[8] = { 0x01, 0x3C, 0x82, 0x05, 0x00, 0xFF, 0x11, 0x80 };
+
+static void test_empty_table_passes_all(void)
+{
+  TEST_ASSERT_TRUE(matchFrame(0x0102, 0, payload, sizeof(payload)));
+  TEST_ASSERT_TRUE(matchFrame(0xFFFF, 3, payload, 0));
+  Filter_hits_t hits;
+  filter.getHits(hits);
+  TEST_ASSERT_EQUAL_UINT8(0, hits.numRules);
+  TEST_ASSERT_EQUAL_UINT32(0, hits.filtered);
+}
+
+static void test_node_mask(void)
+{
+  Filter_rule_t rule = anyRule(FILTER_ACTION_DROP);
+  rule.node = 0x0100;
+  rule.nodeMask = 0xFF00;
+  TEST_ASSERT_TRUE(filter.add(rule));
+  TEST_ASSERT_FALSE(matchFrame(0x0102, 0, payload, sizeof(payload)));
+  TEST_ASSERT_FALSE(matchFrame(0x01FF, 0, payload, sizeof(payload)));
+  TEST_ASSERT_TRUE(matchFrame(0x0202, 0, payload, sizeof(payload)));
+  Filter_hits_t hits;
+  filter.getHits(hits);
+  TEST_ASSERT_EQUAL_UINT8(1, hits.numRules);
+  TEST_ASSERT_EQUAL_UINT32(2, hits.hits[0]);
+  TEST_ASSERT_EQUAL_UINT32(2, hits.filtered);
+}
+
+static void test_pass_rule_on_length_and_pid(void)
+{
+  // With a pass rule in the table, frames no rule matches are dropped.
+  Filter_rule_t rule = anyRule(FILTER_ACTION_PASS);
+  rule.minLen = 2;
+  rule.maxLen = 4;
+  rule.pid = 2;
+  rule.pidMask = 0x03;
+  TEST_ASSERT_TRUE(filter.add(rule));
+  TEST_ASSERT_FALSE(matchFrame(0x0102, 2, payload, 1));
+  TEST_ASSERT_TRUE(matchFrame(0x0102, 2, payload, 2));
+  TEST_ASSERT_TRUE(matchFrame(0x0102, 2, payload, 4));
+  TEST_ASSERT_FALSE(matchFrame(0x0102, 2, payload, 5));
+  TEST_ASSERT_FALSE(matchFrame(0x0102, 3, payload, 3));
+  Filter_hits_t hits;
+  filter.getHits(hits);
+  TEST_ASSERT_EQUAL_UINT32(2, hits.hits[0]);
+  TEST_ASSERT_EQUAL_UINT32(3, hits.filtered);
+}
+
+static void test_data_on_shifted_payload(void)
+{
+  // Payload bytes 5..6 are 0xFF 0x11; only the low nibble of the second is compared.
+  Filter_rule_t rule = anyRule(FILTER_ACTION_DROP);
+  rule.dataOffset = 5;
+  rule.data[0] = 0xFF;
+  rule.data[1] = 0x01;
+  rule.dataMask[0] = 0xFF;
+  rule.dataMask[1] = 0x0F;
+  TEST_ASSERT_TRUE(filter.add(rule));
+  TEST_ASSERT_FALSE(matchFrame(0x0102, 0, payload, sizeof(payload)));
+
+  uint8_t other[sizeof(payload)];
+  memcpy(other, payload, sizeof(other));
+  other[6] = 0x21;
+  TEST_ASSERT_FALSE(matchFrame(0x0102, 0, other, sizeof(other)));
+  other[6] = 0x12;
+  TEST_ASSERT_TRUE(matchFrame(0x0102, 0, other, sizeof(other)));
+  other[6] = 0x11;
+  other[5] = 0x7F;
+  TEST_ASSERT_TRUE(matchFrame(0x0102, 0, other, sizeof(other)));
+}
+
+static void test_data_beyond_frame_never_matches(void)
+{
+  Filter_rule_t rule = anyRule(FILTER_ACTION_DROP);
+  rule.dataOffset = 7;
+  rule.dataMask[0] = 0x00;
+  rule.dataMask[1] = 0x01; // Payload byte 8: past the end of an 8 byte payload, so the frame passes.
+  TEST_ASSERT_TRUE(filter.add(rule));
+  TEST_ASSERT_TRUE(matchFrame(0x0102, 0, payload, sizeof(payload)));
+
+  // Payload byte 7 straddles frame bytes 10 & 11: the drop rule only matches with both captured.
+  filter.clear();
+  rule.dataMask[0] = 0xFF;
+  rule.dataMask[1] = 0x00;
+  rule.data[0] = payload[7];
+  TEST_ASSERT_TRUE(filter.add(rule));
+  const uint8_t len = makeFrame(0x0102, 0, payload, sizeof(payload));
+  TEST_ASSERT_FALSE(filter.match(frame, NODE_LEN, len));
+  TEST_ASSERT_TRUE(filter.match(frame, NODE_LEN, NODE_LEN + 2 + 7));
+  TEST_ASSERT_FALSE(filter.match(frame, NODE_LEN, NODE_LEN + 2 + 8));
+}
+
+static void test_first_matching_rule_wins(void)
+{
+  Filter_rule_t drop = anyRule(FILTER_ACTION_DROP);
+  drop.node = 0x0102;
+  drop.nodeMask = 0xFFFF;
+  TEST_ASSERT_TRUE(filter.add(drop));
+  TEST_ASSERT_TRUE(filter.add(anyRule(FILTER_ACTION_PASS)));
+  TEST_ASSERT_FALSE(matchFrame(0x0102, 0, payload, sizeof(payload)));
+  TEST_ASSERT_TRUE(matchFrame(0x0103, 0, payload, sizeof(payload)));
+  Filter_hits_t hits;
+  filter.getHits(hits);
+  TEST_ASSERT_EQUAL_UINT8(2, hits.numRules);
+  TEST_ASSERT_EQUAL_UINT32(1, hits.hits[0]);
+  TEST_ASSERT_EQUAL_UINT32(1, hits.hits[1]);
+  TEST_ASSERT_EQUAL_UINT32(1, hits.filtered);
+}
+
+static void test_invalid_rules_rejected(void)
+{
+  Filter_rule_t rule = anyRule(FILTER_ACTION_DROP + 1);
+  TEST_ASSERT_FALSE(filter.add(rule));
+  rule = anyRule(FILTER_ACTION_PASS);
+  rule.minLen = 5;
+  rule.maxLen = 4;
+  TEST_ASSERT_FALSE(filter.add(rule));
+  for (uint8_t i = 0; i < MAX_FILTER_RULES; ++i)
+    TEST_ASSERT_TRUE(filter.add(anyRule(FILTER_ACTION_PASS)));
+  TEST_ASSERT_FALSE(filter.add(anyRule(FILTER_ACTION_PASS)));
+  TEST_ASSERT_EQUAL_UINT8(MAX_FILTER_RULES, filter.numRules());
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_table_passes_all);
+  RUN_TEST(test_node_mask);
+  RUN_TEST(test_pass_rule_on_length_and_pid);
+  RUN_TEST(test_data_on_shifted_payload);
+  RUN_TEST(test_data_beyond_frame_never_matches);
+  RUN_TEST(test_first_matching_rule_wins);
+  RUN_TEST(test_invalid_rules_rejected);
+  return UNITY_END();
+}
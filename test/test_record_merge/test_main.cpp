@@ -0,0 +1,146 @@
+/*
+  Host tests of nextRecord(), which merges the capture buffers of several radios into one stream in
+  timestamp order, holding records back while a radio may still deliver an older one.
+
+  Run with: pio test -e native -f test_record_merge
+*/
+
+#include <unity.h>
+#include <string.h>
+
+#define MAX_RF_PAYLOAD_SIZE (32) // As in main.cpp
+#include "RecordMerge.h"
+
+#define NUM_RADIOS (3)
+#define RING_SIZE (1024)
+#define HOLDBACK_US (4000)
+
+// The members of main.cpp's Radio that nextRecord() looks at.
+struct TestRadio
+{
+  TestRadio() : packetBuffer(NULL, 0), active(false) {}
+  ByteRing packetBuffer;
+  bool active;
+};
+
+static TestRadio radios[NUM_RADIOS];
+static uint32_t ringBuffers[NUM_RADIOS][RING_SIZE / sizeof(uint32_t)];
+
+void setUp(void)
+{
+  for (uint8_t id = 0; id < NUM_RADIOS; ++id)
+  {
+    radios[id].packetBuffer.setBuffer((uint8_t *)ringBuffers[id], RING_SIZE);
+    radios[id].active = false;
+  }
+}
+
+void tearDown(void)
+{
+}
+
+// Capture a frame on a radio at timestamp.
+static void capture(const uint8_t id, const uint32_t timestamp)
+{
+  NRF24_packet_t *p = (NRF24_packet_t *)radios[id].packetBuffer.reserve(sizeof(NRF24_packet_t));
+  TEST_ASSERT_NOT_NULL(p);
+  memset(p, 0, sizeof(*p));
+  p->timestamp = timestamp;
+  p->radio = id;
+  radios[id].packetBuffer.commit(offsetof(NRF24_packet_t, packet) + 4);
+}
+
+// Send the next record at nowUs; returns its timestamp, or 0 when nothing went out.
+static uint32_t send(const uint32_t nowUs)
+{
+  NRF24_packet_t *p = NULL;
+  uint32_t len = 0;
+  const int8_t id = nextRecord(radios, NUM_RADIOS, nowUs, HOLDBACK_US, p, len);
+  if (id < 0)
+    return 0;
+  TEST_ASSERT_EQUAL_UINT8(p->radio, id);
+  TEST_ASSERT_EQUAL_UINT32(offsetof(NRF24_packet_t, packet) + 4, len);
+  const uint32_t timestamp = p->timestamp;
+  radios[id].packetBuffer.pop();
+  return timestamp;
+}
+
+static void test_nothing_to_send(void)
+{
+  radios[0].active = true;
+  radios[1].active = true;
+  TEST_ASSERT_EQUAL_UINT32(0, send(100000));
+}
+
+static void test_streams_merge_in_timestamp_order(void)
+{
+  radios[0].active = true;
+  radios[1].active = true;
+  radios[2].active = true;
+  const uint32_t t0[] = { 1000, 1300, 1600, 2500 };
+  const uint32_t t1[] = { 1100, 1200, 2000 };
+  const uint32_t t2[] = { 1400, 2400, 2600 };
+  for (uint8_t i = 0; i < 4; ++i)
+    capture(0, t0[i]);
+  for (uint8_t i = 0; i < 3; ++i)
+  {
+    capture(1, t1[i]);
+    capture(2, t2[i]);
+  }
+  // Long after: nothing is held back, every record comes out in order.
+  const uint32_t expected[] = { 1000, 1100, 1200, 1300, 1400, 1600, 2000, 2400, 2500, 2600 };
+  for (uint8_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i)
+    TEST_ASSERT_EQUAL_UINT32(expected[i], send(100000));
+  TEST_ASSERT_EQUAL_UINT32(0, send(100000));
+}
+
+static void test_held_back_while_a_radio_is_empty(void)
+{
+  radios[0].active = true;
+  radios[1].active = true;
+  capture(0, 10000);
+  TEST_ASSERT_EQUAL_UINT32(0, send(10000));
+  TEST_ASSERT_EQUAL_UINT32(0, send(10000 + HOLDBACK_US - 1));
+
+  // Radio 1 delivers an older frame late: it goes out first, right away, as both have a record.
+  capture(1, 9000);
+  TEST_ASSERT_EQUAL_UINT32(9000, send(10500));
+  // Radio 1 is empty again, so the record of radio 0 waits until it's old enough.
+  TEST_ASSERT_EQUAL_UINT32(0, send(10500));
+  TEST_ASSERT_EQUAL_UINT32(10000, send(10000 + HOLDBACK_US));
+}
+
+static void test_idle_radios_hold_nothing_back(void)
+{
+  // Radios not capturing have no buffer to wait for.
+  radios[0].active = true;
+  capture(0, 5000);
+  TEST_ASSERT_EQUAL_UINT32(5000, send(5000));
+
+  // A radio stopped with records left still has them sent; held back, as radio 0 is empty.
+  capture(2, 6000);
+  TEST_ASSERT_EQUAL_UINT32(0, send(6000));
+  TEST_ASSERT_EQUAL_UINT32(6000, send(6000 + HOLDBACK_US));
+}
+
+static void test_timestamps_wrap(void)
+{
+  radios[0].active = true;
+  radios[1].active = true;
+  capture(0, 0x00000100UL);
+  capture(1, 0xFFFFFF00UL);
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFF00UL, send(0x00000200UL));
+  TEST_ASSERT_EQUAL_UINT32(0, send(0x00000200UL));
+  TEST_ASSERT_EQUAL_UINT32(0x00000100UL, send(0x00000100UL + HOLDBACK_US));
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_nothing_to_send);
+  RUN_TEST(test_streams_merge_in_timestamp_order);
+  RUN_TEST(test_held_back_while_a_radio_is_empty);
+  RUN_TEST(test_idle_radios_hold_nothing_back);
+  RUN_TEST(test_timestamps_wrap);
+  return UNITY_END();
+}
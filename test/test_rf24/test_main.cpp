@@ -0,0 +1,248 @@
+/*
+  Host tests of the vendored RF24 library, driven through RF24_SPI_Mock instead of a radio.
+
+  Run with: pio test -e native -f test_rf24
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "RF24.cpp"
+#include "RF24_spi_mock.h"
+
+#define CE_PIN (22)
+
+static RF24_SPI_Mock spi;
+static RF24 rf(CE_PIN, spi);
+
+void setUp(void)
+{
+  spi.reset();
+  rf.begin();
+  rf.disableLengthAwareRead();
+  spi.resetCounters();
+}
+
+void tearDown(void)
+{
+}
+
+static void test_begin_configures_radio(void)
+{
+  TEST_ASSERT_TRUE(rf.isChipConnected());
+  TEST_ASSERT_EQUAL_UINT8(76, spi.reg(RF_CH));
+  TEST_ASSERT_EQUAL_HEX8(_BV(EN_CRC) | _BV(CRCO) | _BV(PWR_UP), spi.reg(CONFIG));
+  TEST_ASSERT_EQUAL_UINT8(0, spi.rxCount());
+}
+
+static void test_start_listening_enters_rx(void)
+{
+  rf.startListening();
+  TEST_ASSERT_TRUE(spi.reg(CONFIG) & _BV(PRIM_RX));
+  rf.stopListening();
+  TEST_ASSERT_FALSE(spi.reg(CONFIG) & _BV(PRIM_RX));
+}
+
+static void test_read_returns_received_payload(void)
+{
+  uint8_t sent[32];
+  for (uint8_t i = 0; i < sizeof(sent); ++i)
+    sent[i] = i * 3 + 1;
+  TEST_ASSERT_FALSE(rf.available());
+  TEST_ASSERT_TRUE(spi.receive(2, sent, sizeof(sent)));
+
+  uint8_t pipe = 0xFF;
+  TEST_ASSERT_TRUE(rf.available(&pipe));
+  TEST_ASSERT_EQUAL_UINT8(2, pipe);
+
+  uint8_t got[32];
+  rf.read(got, sizeof(got));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(sent, got, sizeof(sent));
+  TEST_ASSERT_FALSE(rf.available());
+}
+
+static void test_payloads_come_out_in_order(void)
+{
+  for (uint8_t n = 0; n < 3; ++n)
+  {
+    uint8_t payload[32] = { n };
+    TEST_ASSERT_TRUE(spi.receive(n, payload, sizeof(payload)));
+  }
+  // The FIFO holds 3 payloads.
+  const uint8_t extra[32] = { 0 };
+  TEST_ASSERT_FALSE(spi.receive(0, extra, sizeof(extra)));
+
+  for (uint8_t n = 0; n < 3; ++n)
+  {
+    uint8_t pipe;
+    uint8_t got[32];
+    TEST_ASSERT_TRUE(rf.available(&pipe));
+    TEST_ASSERT_EQUAL_UINT8(n, pipe);
+    rf.read(got, sizeof(got));
+    TEST_ASSERT_EQUAL_UINT8(n, got[0]);
+  }
+  TEST_ASSERT_FALSE(rf.available());
+}
+
+static void test_flush_rx_empties_fifo(void)
+{
+  const uint8_t payload[32] = { 0 };
+  (void)spi.receive(0, payload, sizeof(payload));
+  (void)spi.receive(1, payload, sizeof(payload));
+  (void)rf.flush_rx();
+  TEST_ASSERT_EQUAL_UINT8(0, spi.rxCount());
+  TEST_ASSERT_FALSE(rf.available());
+}
+
+// Queue num payloads whose first byte is their number.
+static void receivePayloads(const uint8_t num)
+{
+  for (uint8_t n = 0; n < num; ++n)
+  {
+    uint8_t payload[32] = { n };
+    (void)spi.receive(n, payload, sizeof(payload));
+  }
+}
+
+// SPI transactions to drain num payloads the way the capture did before readBurst(): poll with
+// available(), then read() each payload, which also clears the interrupt flags.
+static uint32_t transactionsPolling(const uint8_t num)
+{
+  uint8_t got[32];
+  receivePayloads(num);
+  spi.resetCounters();
+  uint8_t count = 0;
+  while (rf.available())
+  {
+    rf.read(got, sizeof(got));
+    TEST_ASSERT_EQUAL_UINT8(count++, got[0]);
+  }
+  TEST_ASSERT_EQUAL_UINT8(num, count);
+  return spi.transactions;
+}
+
+// Same with a single readBurst() of up to the 3 payloads the RX FIFO holds.
+static uint32_t transactionsBurst(const uint8_t num)
+{
+  uint8_t got[3][32];
+  uint8_t pipes[3];
+  receivePayloads(num);
+  spi.resetCounters();
+  TEST_ASSERT_EQUAL_UINT8(num, rf.readBurst(got, 3, sizeof(got[0]), pipes));
+  for (uint8_t n = 0; n < num; ++n)
+  {
+    TEST_ASSERT_EQUAL_UINT8(n, got[n][0]);
+    TEST_ASSERT_EQUAL_UINT8(n, pipes[n]);
+  }
+  TEST_ASSERT_EQUAL_UINT8(0, spi.rxCount());
+  return spi.transactions;
+}
+
+static void test_transactions_per_packet(void)
+{
+  // Polling takes a FIFO_STATUS read, the payload & a STATUS write per payload, plus the read that
+  // finds the FIFO empty. A burst clears RX_DR once, then takes the payload & a NOP per payload;
+  // with a full FIFO the last NOP is skipped.
+  TEST_ASSERT_EQUAL_UINT32(4, transactionsPolling(1));
+  TEST_ASSERT_EQUAL_UINT32(10, transactionsPolling(3));
+  TEST_ASSERT_EQUAL_UINT32(3, transactionsBurst(1));
+  TEST_ASSERT_EQUAL_UINT32(6, transactionsBurst(3));
+
+  char msg[80];
+  snprintf(msg, sizeof(msg), "Transactions per packet, full FIFO: polling %.2f, readBurst %.2f",
+           transactionsPolling(3) / 3.0, transactionsBurst(3) / 3.0);
+  TEST_MESSAGE(msg);
+}
+
+static void test_burst_stops_at_max_packets(void)
+{
+  uint8_t got[2][32];
+  receivePayloads(3);
+  TEST_ASSERT_EQUAL_UINT8(2, rf.readBurst(got, 2, sizeof(got[0])));
+  TEST_ASSERT_EQUAL_UINT8(1, got[1][0]);
+  TEST_ASSERT_EQUAL_UINT8(1, spi.rxCount());
+  TEST_ASSERT_EQUAL_UINT8(1, rf.readBurst(got, 2, sizeof(got[0])));
+  TEST_ASSERT_EQUAL_UINT8(2, got[0][0]);
+  TEST_ASSERT_EQUAL_UINT8(0, rf.readBurst(got, 2, sizeof(got[0])));
+}
+
+// Bytes clocked by read() of a frame with a payload of payloadLen bytes, captured with 2 address bytes
+// in front of the control field and a CRC16.
+static uint32_t bytesPerRead(const uint8_t payloadLen)
+{
+  uint8_t frame[32];
+  uint8_t got[32];
+  memset(frame, 0x5A, sizeof(frame));
+  frame[2] = payloadLen << 2;
+  TEST_ASSERT_TRUE(spi.receive(0, frame, sizeof(frame)));
+  memset(got, 0, sizeof(got));
+  spi.resetCounters();
+  rf.read(got, sizeof(got));
+  TEST_ASSERT_EQUAL_UINT8(0, spi.rxCount());
+  TEST_ASSERT_EQUAL_UINT8(frame[2], got[2]);
+  return spi.bytes;
+}
+
+static void test_length_aware_read_stops_after_crc(void)
+{
+  // Every read() ends with a STATUS write of 2 bytes. Without length awareness, the command and all
+  // 32 payload bytes are clocked.
+  TEST_ASSERT_EQUAL_UINT32(1 + 32 + 2, bytesPerRead(2));
+
+  // A 2 byte payload: 2 address bytes, 9 control bits, 16 payload & 16 CRC bits make 8 bytes.
+  rf.enableLengthAwareRead(2, 2);
+  TEST_ASSERT_EQUAL_UINT32(11, bytesPerRead(2));
+  TEST_ASSERT_EQUAL_UINT32(1 + 6 + 2, bytesPerRead(0));
+  TEST_ASSERT_EQUAL_UINT32(1 + 32 + 2, bytesPerRead(32));
+  // An invalid length only gets the header, i.e. the byte after the control field too.
+  TEST_ASSERT_EQUAL_UINT32(1 + 4 + 2, bytesPerRead(40));
+}
+
+static void test_length_aware_read_leaves_rest_of_buffer(void)
+{
+  uint8_t frame[32];
+  uint8_t got[32];
+  for (uint8_t i = 0; i < sizeof(frame); ++i)
+    frame[i] = i + 1;
+  frame[2] = 2 << 2;
+  rf.enableLengthAwareRead(2, 2);
+  TEST_ASSERT_TRUE(spi.receive(0, frame, sizeof(frame)));
+  memset(got, 0xEE, sizeof(got));
+  rf.read(got, sizeof(got));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(frame, got, 8);
+  for (uint8_t i = 8; i < sizeof(got); ++i)
+    TEST_ASSERT_EQUAL_HEX8(0xEE, got[i]);
+}
+
+static void test_length_aware_read_of_head_only_ends_transaction(void)
+{
+  // With a payload size of just the head, the address bytes & control field byte, nothing follows
+  // the command; chip select must still go high, popping the payload off the FIFO.
+  rf.enableLengthAwareRead(2, 2);
+  rf.setPayloadSize(3);
+  receivePayloads(2);
+  uint8_t got[3];
+  rf.read(got, sizeof(got));
+  TEST_ASSERT_FALSE(spi.isSelected());
+  TEST_ASSERT_EQUAL_UINT8(1, spi.rxCount());
+  rf.read(got, sizeof(got));
+  TEST_ASSERT_EQUAL_UINT8(1, got[0]);
+  TEST_ASSERT_EQUAL_UINT8(0, spi.rxCount());
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_configures_radio);
+  RUN_TEST(test_start_listening_enters_rx);
+  RUN_TEST(test_read_returns_received_payload);
+  RUN_TEST(test_payloads_come_out_in_order);
+  RUN_TEST(test_flush_rx_empties_fifo);
+  RUN_TEST(test_transactions_per_packet);
+  RUN_TEST(test_burst_stops_at_max_packets);
+  RUN_TEST(test_length_aware_read_stops_after_crc);
+  RUN_TEST(test_length_aware_read_leaves_rest_of_buffer);
+  RUN_TEST(test_length_aware_read_of_head_only_ends_transaction);
+  return UNITY_END();
+}
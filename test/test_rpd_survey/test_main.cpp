@@ -0,0 +1,117 @@
+/*
+  Host tests of RpdSurvey, the received power detector hit ratios of the survey capture mode.
+
+  Run with: pio test -e native -f test_rpd_survey
+*/
+
+#include <unity.h>
+
+#include "RpdSurvey.cpp"
+
+static RpdSurvey survey;
+static Survey_t blocks[RPD_SURVEY_BLOCKS];
+
+void setUp(void)
+{
+  survey.clear();
+}
+
+void tearDown(void)
+{
+}
+
+// The hit ratio of a channel from the collected blocks.
+static uint8_t ratioOf(const uint8_t channel)
+{
+  const Survey_t &s = blocks[channel / SURVEY_BLOCK_CHANNELS];
+  return s.hitRatio[channel - s.firstChannel];
+}
+
+static void test_blocks_cover_all_channels(void)
+{
+  survey.collect(blocks);
+  uint8_t next = 0;
+  for (uint8_t b = 0; b < RPD_SURVEY_BLOCKS; ++b)
+  {
+    TEST_ASSERT_EQUAL_UINT8(next, blocks[b].firstChannel);
+    TEST_ASSERT_TRUE(blocks[b].numChannels >= 1);
+    TEST_ASSERT_TRUE(blocks[b].numChannels <= SURVEY_BLOCK_CHANNELS);
+    next += blocks[b].numChannels;
+  }
+  TEST_ASSERT_EQUAL_UINT8(RF_NUM_CHANNELS, next);
+}
+
+static void test_ratios(void)
+{
+  // 10 sweeps of RPD_SURVEY_SAMPLES samples: none, all, a quarter and a third of them hit.
+  for (uint8_t sweep = 0; sweep < 10; ++sweep)
+  {
+    survey.add(0, 0, RPD_SURVEY_SAMPLES);
+    survey.add(2, RPD_SURVEY_SAMPLES, RPD_SURVEY_SAMPLES);
+    survey.add(80, sweep & 1 ? 1 : 0, RPD_SURVEY_SAMPLES / 2);
+    survey.add(RF_NUM_CHANNELS - 1, sweep % 3 ? 0 : 3, 3);
+  }
+  survey.collect(blocks);
+  TEST_ASSERT_EQUAL_UINT16(10 * RPD_SURVEY_SAMPLES, blocks[0].samples);
+  TEST_ASSERT_EQUAL_UINT8(0, ratioOf(0));
+  TEST_ASSERT_EQUAL_UINT8(255, ratioOf(2));
+  TEST_ASSERT_EQUAL_UINT8((5 * 255 + 10) / 20, ratioOf(80));
+  // 12 hits in 30 samples: 0.4 * 255 = 102.
+  TEST_ASSERT_EQUAL_UINT8(102, ratioOf(RF_NUM_CHANNELS - 1));
+  // Channels never visited report nothing.
+  TEST_ASSERT_EQUAL_UINT8(0, ratioOf(1));
+  TEST_ASSERT_EQUAL_UINT16(0, blocks[1].samples);
+}
+
+static void test_rounding(void)
+{
+  // 1 in 3 is 85 exactly; 2 in 3 170; 1 in 512 rounds down to 0, 1 in 510 up to 1.
+  survey.add(10, 1, 3);
+  survey.add(11, 2, 3);
+  for (uint8_t i = 0; i < 128; ++i)
+  {
+    survey.add(12, i == 0, 4);
+    survey.add(13, i == 0, i < 127 ? 4 : 2);
+  }
+  survey.collect(blocks);
+  TEST_ASSERT_EQUAL_UINT8(85, ratioOf(10));
+  TEST_ASSERT_EQUAL_UINT8(170, ratioOf(11));
+  TEST_ASSERT_EQUAL_UINT8(0, ratioOf(12));
+  TEST_ASSERT_EQUAL_UINT8(1, ratioOf(13));
+}
+
+static void test_saturation_keeps_ratio(void)
+{
+  // Far more samples than the counters hold: the ratio of those counted stays right.
+  for (uint32_t i = 0; i < 40000; ++i)
+    survey.add(0, i & 1 ? RPD_SURVEY_SAMPLES : 0, RPD_SURVEY_SAMPLES);
+  survey.collect(blocks);
+  const uint16_t samples = blocks[0].samples;
+  TEST_ASSERT_TRUE(samples > 0xFFFF - RPD_SURVEY_SAMPLES);
+  // Every other visit hit; the last one counted didn't.
+  const uint32_t hits = samples / 2 - RPD_SURVEY_SAMPLES / 2;
+  TEST_ASSERT_EQUAL_UINT8((hits * 255 + samples / 2) / samples, ratioOf(0));
+  TEST_ASSERT_TRUE(ratioOf(0) >= 127);
+}
+
+static void test_collect_clears(void)
+{
+  survey.add(40, 1, 1);
+  survey.add(RF_NUM_CHANNELS, 1, 1); // Not a channel: ignored
+  survey.collect(blocks);
+  TEST_ASSERT_EQUAL_UINT8(255, ratioOf(40));
+  survey.collect(blocks);
+  TEST_ASSERT_EQUAL_UINT8(0, ratioOf(40));
+  TEST_ASSERT_EQUAL_UINT16(0, blocks[0].samples);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_blocks_cover_all_channels);
+  RUN_TEST(test_ratios);
+  RUN_TEST(test_rounding);
+  RUN_TEST(test_saturation_keeps_ratio);
+  RUN_TEST(test_collect_clears);
+  return UNITY_END();
+}
@@ -0,0 +1,140 @@
+/*
+  Host tests of SerialTx output in hex (text) mode, plus a throughput comparison of its lookup table
+  encoder against the printf("%02x") per byte it replaced.
+
+  Run with: pio test -e native -f test_serial_tx
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+// The UART: takes everything written into sink.
+class HardwareSerial
+{
+public:
+  uint8_t sink[4096];
+  size_t len;
+
+  int availableForWrite() { return sizeof(sink) - len; }
+
+  size_t write(const uint8_t *data, size_t n)
+  {
+    memcpy(sink + len, data, n);
+    len += n;
+    return n;
+  }
+};
+
+#include "SerialTx.cpp"
+
+#define BENCH_RECORDS (200000UL)
+
+static HardwareSerial serial;
+static SerialTx serialTx(serial, true);
+
+// A record as the sniffer sends it: type & length, packet header and the frame of a MySensors node.
+static const uint8_t lenAndType[] = { 0x32 };
+static const uint8_t header[] = { 0x10, 0x27, 0x00, 0x00, 0x00, 0x01, 0x4c, 0x00 };
+static const uint8_t frame[] = { 0x01, 0x3c, 0x82, 0x05, 0x00, 0xff, 0x01, 0x02, 0x11, 0x80, 0x0a, 0x7e, 0xd3, 0x2b, 0xa5, 0x5a };
+
+void setUp(void)
+{
+  serial.len = 0;
+}
+
+void tearDown(void)
+{
+}
+
+// The text output from before SerialTx: every byte through printf("%02x"), a space after each field.
+static size_t printfField(char *out, const uint8_t *p, size_t len)
+{
+  char *start = out;
+  while (len--)
+    out += snprintf(out, 3, "%02x", *p++);
+  *out++ = ' ';
+  return out - start;
+}
+
+static size_t printfRecord(char *out)
+{
+  size_t len = printfField(out, lenAndType, sizeof(lenAndType));
+  len += printfField(out + len, header, sizeof(header));
+  len += printfField(out + len, frame, sizeof(frame));
+  memcpy(out + len, "\r\n", 2);
+  return len + 2;
+}
+
+static void putRecord(void)
+{
+  serialTx.put(lenAndType, sizeof(lenAndType));
+  serialTx.put(header, sizeof(header));
+  serialTx.put(frame, sizeof(frame));
+  serialTx.endRecord();
+}
+
+static void test_hex_record_matches_printf(void)
+{
+  char expected[128];
+  const size_t len = printfRecord(expected);
+  putRecord();
+  TEST_ASSERT_EQUAL_UINT32(len, serialTx.flush());
+  TEST_ASSERT_EQUAL_UINT32(len, serial.len);
+  TEST_ASSERT_EQUAL_MEMORY(expected, serial.sink, len);
+  TEST_ASSERT_FALSE(serialTx.pending());
+}
+
+static void test_every_byte_value(void)
+{
+  uint8_t all[256];
+  char expected[256 * 2 + 1];
+  for (uint16_t i = 0; i < 256; ++i)
+    all[i] = (uint8_t)i;
+  TEST_ASSERT_EQUAL_UINT32(sizeof(expected), printfField(expected, all, sizeof(all)));
+  serialTx.put(all, sizeof(all));
+  (void)serialTx.flush();
+  TEST_ASSERT_EQUAL_UINT32(sizeof(expected), serial.len);
+  TEST_ASSERT_EQUAL_MEMORY(expected, serial.sink, sizeof(expected));
+}
+
+static double recordsPerSecond(const std::chrono::steady_clock::time_point start)
+{
+  const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return BENCH_RECORDS / s;
+}
+
+static void test_benchmark_against_printf(void)
+{
+  static char line[128];
+  char msg[96];
+  volatile size_t total = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < BENCH_RECORDS; ++n)
+    total += printfRecord(line);
+  const double printfRate = recordsPerSecond(start);
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < BENCH_RECORDS; ++n)
+  {
+    putRecord();
+    serial.len = 0;
+    total += serialTx.flush();
+  }
+  const double tableRate = recordsPerSecond(start);
+
+  TEST_ASSERT_EQUAL_UINT32(2 * BENCH_RECORDS * printfRecord(line), total);
+  snprintf(msg, sizeof(msg), "printf %.2f Mrecords/s, lookup table %.2f Mrecords/s", printfRate / 1e6, tableRate / 1e6);
+  TEST_MESSAGE(msg);
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_hex_record_matches_printf);
+  RUN_TEST(test_every_byte_value);
+  RUN_TEST(test_benchmark_against_printf);
+  return UNITY_END();
+}
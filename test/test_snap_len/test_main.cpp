@@ -0,0 +1,87 @@
+/*
+  Host tests of snapFrameLen(), the truncation of captured frames to the configured snap length.
+
+  Run with: pio test -e native -f test_snap_len
+*/
+
+#include <unity.h>
+#include <string.h>
+
+#include "NRF24_sniff_protocol.h"
+
+#define NODE_LEN (2)
+#define CRC_LEN (2)
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Bytes of a complete frame: node address bytes, 9 bit control field, payload & CRC, rounded up.
+static uint8_t frameLen(const uint8_t payloadLen)
+{
+  return (8 * NODE_LEN + 9 + 8 * payloadLen + 8 * CRC_LEN + 7) / 8;
+}
+
+// Payload byte n of a frame, taken from the captured bytes the way the host does.
+static uint8_t payloadByte(const uint8_t *frame, const uint8_t n)
+{
+  return (uint8_t)((frame[NODE_LEN + 1 + n] << 1) | (frame[NODE_LEN + 2 + n] >> 7));
+}
+
+static void test_snaplen_all_keeps_frame(void)
+{
+  for (uint8_t payloadLen = 0; payloadLen <= 32; ++payloadLen)
+    TEST_ASSERT_EQUAL_UINT8(frameLen(payloadLen), snapFrameLen(frameLen(payloadLen), NODE_LEN, SNAPLEN_ALL));
+}
+
+static void test_header_only(void)
+{
+  // The control byte & the byte holding its 9th bit.
+  TEST_ASSERT_EQUAL_UINT8(NODE_LEN + 2, snapFrameLen(frameLen(32), NODE_LEN, 0));
+  TEST_ASSERT_EQUAL_UINT8(NODE_LEN + 2, snapFrameLen(frameLen(0), NODE_LEN, 0));
+  TEST_ASSERT_EQUAL_UINT8(2, snapFrameLen(frameLen(8), 0, 0));
+}
+
+static void test_keeps_snaplen_payload_bytes(void)
+{
+  uint8_t frame[NODE_LEN + 2 + 32 + CRC_LEN];
+  for (uint8_t i = 0; i < sizeof(frame); ++i)
+    frame[i] = (uint8_t)(i * 37 + 11);
+  for (uint8_t snapLen = 0; snapLen < 32; ++snapLen)
+  {
+    const uint8_t len = snapFrameLen(frameLen(32), NODE_LEN, snapLen);
+    // Every payload byte kept is complete, and none more.
+    TEST_ASSERT_EQUAL_UINT8(NODE_LEN + 2 + snapLen, len);
+    if (snapLen)
+    {
+      uint8_t kept[NODE_LEN + 2 + 32 + CRC_LEN];
+      memset(kept, 0, sizeof(kept));
+      memcpy(kept, frame, len);
+      TEST_ASSERT_EQUAL_HEX8(payloadByte(frame, snapLen - 1), payloadByte(kept, snapLen - 1));
+    }
+  }
+}
+
+static void test_short_frames(void)
+{
+  // The CRC bytes count against the snap length too: one of just the payload cuts the CRC off.
+  TEST_ASSERT_EQUAL_UINT8(NODE_LEN + 2 + 4, snapFrameLen(frameLen(4), NODE_LEN, 4));
+  TEST_ASSERT_EQUAL_UINT8(frameLen(4), snapFrameLen(frameLen(4), NODE_LEN, 4 + CRC_LEN));
+  TEST_ASSERT_EQUAL_UINT8(frameLen(4), snapFrameLen(frameLen(4), NODE_LEN, 20));
+  // Already cut short by the payload size read from the radio.
+  TEST_ASSERT_EQUAL_UINT8(NODE_LEN + 3, snapFrameLen(NODE_LEN + 3, NODE_LEN, 8));
+}
+
+int main(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_snaplen_all_keeps_frame);
+  RUN_TEST(test_header_only);
+  RUN_TEST(test_keeps_snaplen_payload_bytes);
+  RUN_TEST(test_short_frames);
+  return UNITY_END();
+}